@@ -4,6 +4,11 @@
 #include "gg_aabb.h"
 #include "gg_render.h"
 #include "gg_collider.h"
+#include "gg_atlas.h"
+#include "gg_anim.h"
+#include "gg_entity.h"
+#include "gg_parallax.h"
+#include "gg_profiler.h"
 
 #define STB_ASSERT(x) assert(x);
 #define STBI_ONLY_PNG
@@ -11,6 +16,7 @@
 #include "stb_image.h"
 
 #include <float.h>
+#include <stdio.h>
 
 static void output_sine_wave(game_state_t *game_state, game_audio_t *audio)
 {
@@ -52,28 +58,6 @@ static unsigned char *get_tile_from_world_pos(tilemap_t *tilemap, v2 pos)
     return get_tile(tilemap, tile_x, tile_y);
 }
 
-static u32 get_next_entity(entity_t *entities)
-{
-    static const entity_t zero_entity = {0};
-    for (u32 i = 1; i < GG_MAX_ENTITIES; ++i) {
-        entity_t *entity = &entities[i];
-        if (!entity->exists) {
-            *entity = zero_entity;
-            entity->exists = 1;
-            return i;
-        }
-    }
-
-    return 0;
-}
-
-static void free_entity(entity_t *entities, u32 index)
-{
-    static const entity_t zero_entity = {0};
-    assert(index < GG_MAX_ENTITIES);
-    entities[index] = zero_entity;
-}
-
 static b8 is_tile_empty(unsigned char *tile)
 {
     return *tile == 0;
@@ -108,14 +92,22 @@ static b8 test_wall(f32 test_x,
 static void update_entities(game_state_t *game_state, game_input_t *input, log_fn log)
 {
     world_t *world = &game_state->world;
+    entity_pool_t *entities = &world->entities;
+
+    // NOTE(Wes): Every entity is stepped with drag as the only force, then
+    // each controller adds its input to the entity it moves.
+    entity_integrate(entities, input->delta_time);
+
+    // Gravity
+    // entity_add_acceleration(entities, entity, world->gravity, input->delta_time);
 
-    // NOTE(Wes): Save input data from each controller.
-    v2 new_accels[GG_MAX_ENTITIES] = {0};
     for (u32 i = 0; i < GG_MAX_CONTROLLERS; ++i) {
-        u32 entity_index = world->controlled_entities[i];
-        if (entity_index != 0) {
-            entity_t *entity = &world->entities[entity_index];
-            if (!entity->exists) {
+        entity_handle_t handle = world->controlled_entities[i];
+        if (handle != 0) {
+            // NOTE(Wes): A controller whose entity was freed lets go of it.
+            entity_t *entity = entity_get(entities, handle);
+            if (!entity) {
+                world->controlled_entities[i] = 0;
                 continue;
             }
             game_controller_input_t *controller = &input->controllers[i];
@@ -145,55 +137,30 @@ static void update_entities(game_state_t *game_state, game_input_t *input, log_f
                     left_stick.y = 1.0f;
                 }
             }
-            new_accels[entity_index] = v2_mul(left_stick, entity->acceleration_factor);
+            entity_add_acceleration(entities, entity, v2_mul(left_stick, entity->acceleration_factor), input->delta_time);
         }
     }
 
-    for (u32 i = 1; i < GG_MAX_ENTITIES; ++i) {
-        entity_t *entity = &world->entities[i];
-        if (!entity->exists) {
+    for (u32 motion_index = 0; motion_index < entities->live_count; ++motion_index) {
+        entity_motion_t *motion = entities->motions[motion_index / GG_ENTITY_BLOCK_SIZE];
+        u32 lane = motion_index % GG_ENTITY_BLOCK_SIZE;
+        v2 pos_delta = V2(motion->move_x[lane], motion->move_y[lane]);
+        if (pos_delta.x == 0.0f && pos_delta.y == 0.0f) {
             continue;
         }
 
-        // Ensures we never move exactly onto the tile we are colliding
-        // with.
-        v2 new_accel = new_accels[i];
-
-        // Gravity
-        // new_accel = v2_add(new_accel, world->gravity);
-
-        // Friction force. USE ODE here!
-        v2 friction = v2_mul(entity->velocity, entity->velocity_factor);
-        new_accel = v2_add(new_accel, friction);
-
-// TODO(Wes): Decide which position calculation we prefer.
-#if 1
-        // Velocity verlet integration.
-        v2 average_accel = v2_div(v2_add(entity->acceleration, new_accel), 2);
-        v2 new_entity_pos = v2_mul(v2_mul(entity->acceleration, 0.5f), input->delta_time * input->delta_time);
-        new_entity_pos = v2_add(v2_mul(entity->velocity, input->delta_time), new_entity_pos);
-        new_entity_pos = v2_add(entity->position, new_entity_pos);
-        entity->velocity = v2_add(v2_mul(average_accel, input->delta_time), entity->velocity);
-        entity->acceleration = new_accel;
-#else
-        // NOTE(Wes): Euler integration
-        v2 entity->position = entity->position;
-        v2 new_entity_pos = v2_mul(v2_mul(entity->acceleration, 0.5f), input->delta_time * input->delta_time);
-        new_entity_pos = v2_add(v2_mul(entity->velocity, input->delta_time), new_entity_pos);
-        new_entity_pos = v2_add(entity->position, new_entity_pos);
-        entity->velocity = v2_add(v2_mul(new_accel, input->delta_time), entity->velocity);
-        entity->acceleration = new_accel;
-#endif
-
-        v2 pos_delta = v2_sub(new_entity_pos, entity->position);
+        entity_t *entity = entity_at(entities, motion->slot[lane]);
+        v2 position = V2(motion->position_x[lane], motion->position_y[lane]);
+        v2 velocity = V2(motion->velocity_x[lane], motion->velocity_y[lane]);
+        v2 new_entity_pos = v2_add(position, pos_delta);
 
         // NOTE(Wes): Collision detection
         //            Check that the intended position of the player is on a tile that is empty.
         //            Otherwise find the closest position to the edge of the tile and continue
         //            velocity from that point in a direction that is "safe".
-        v2 min_pos = V2(kmin(new_entity_pos.x, entity->position.x), kmin(new_entity_pos.y, entity->position.y));
-        v2 max_pos = V2(kmax(new_entity_pos.x + entity->size.x, entity->position.x + entity->size.x),
-                        kmax(new_entity_pos.y + entity->size.y, entity->position.y + entity->size.y));
+        v2 min_pos = V2(kmin(new_entity_pos.x, position.x), kmin(new_entity_pos.y, position.y));
+        v2 max_pos = V2(kmax(new_entity_pos.x + entity->size.x, position.x + entity->size.x),
+                        kmax(new_entity_pos.y + entity->size.y, position.y + entity->size.y));
 
         tilemap_t *tilemap = &world->tilemap;
         u32 min_tile_x = (u32)(min_pos.x / (tilemap->tile_size.x));
@@ -222,8 +189,8 @@ static void update_entities(game_state_t *game_state, game_input_t *input, log_f
                         max_corner = v2_add(max_corner, entity->size);
 
                         // Test left wall
-                        if (test_wall(entity->position.x,
-                                      entity->position.y,
+                        if (test_wall(position.x,
+                                      position.y,
                                       max_corner.x,
                                       min_corner.y,
                                       max_corner.y,
@@ -233,8 +200,8 @@ static void update_entities(game_state_t *game_state, game_input_t *input, log_f
                             wall_normal = V2(1.0f, 0.0f);
                         }
                         // Test right wall
-                        if (test_wall(entity->position.x,
-                                      entity->position.y,
+                        if (test_wall(position.x,
+                                      position.y,
                                       min_corner.x,
                                       min_corner.y,
                                       max_corner.y,
@@ -244,8 +211,8 @@ static void update_entities(game_state_t *game_state, game_input_t *input, log_f
                             wall_normal = V2(-1.0f, 0.0f);
                         }
                         // Test bottom wall
-                        if (test_wall(entity->position.y,
-                                      entity->position.x,
+                        if (test_wall(position.y,
+                                      position.x,
                                       max_corner.y,
                                       min_corner.x,
                                       max_corner.x,
@@ -255,8 +222,8 @@ static void update_entities(game_state_t *game_state, game_input_t *input, log_f
                             wall_normal = V2(0.0f, 1.0f);
                         }
                         // Test top wall
-                        if (test_wall(entity->position.y,
-                                      entity->position.x,
+                        if (test_wall(position.y,
+                                      position.x,
                                       min_corner.y,
                                       min_corner.x,
                                       max_corner.x,
@@ -268,14 +235,19 @@ static void update_entities(game_state_t *game_state, game_input_t *input, log_f
                     }
                 }
             }
-            entity->position = v2_add(entity->position, v2_mul(pos_delta, t_min));
+            position = v2_add(position, v2_mul(pos_delta, t_min));
 
             // If we've hit a wall then wall_normal will be non-zero.
-            entity->velocity = v2_sub(entity->velocity, v2_mul(wall_normal, v2_dot(entity->velocity, wall_normal)));
+            velocity = v2_sub(velocity, v2_mul(wall_normal, v2_dot(velocity, wall_normal)));
             pos_delta = v2_sub(pos_delta, v2_mul(wall_normal, v2_dot(pos_delta, wall_normal)));
 
             t_remaining -= t_remaining * t_min;
         }
+
+        motion->position_x[lane] = position.x;
+        motion->position_y[lane] = position.y;
+        motion->velocity_x[lane] = velocity.x;
+        motion->velocity_y[lane] = velocity.y;
     }
 }
 
@@ -324,7 +296,317 @@ static image_t load_image(const char *path, load_file_fn load_file)
     return result;
 }
 
-game_memory_t *dbg_global_memory;
+typedef struct {
+    const char *directory; // Frames are named 1.png, 2.png, ...
+    u32 frame_count;
+    f32 frames_per_second;
+    b8 loops;
+} anim_clip_desc_t;
+
+#define GG_MAX_ANIM_FRAMES 8
+static const anim_clip_desc_t anim_clip_descs[anim_clip_count] = {
+    {"data/player/walk_with_sword", 6, 12.0f, 1},
+    {"data/player/attack_with_sword", 6, 15.0f, 0},
+    {"data/player/Sword Stop", 3, 6.0f, 1},
+    {"data/player/Walk With Bow", 6, 12.0f, 1},
+    {"data/player/Attack With Bow", 5, 15.0f, 0},
+    {"data/player/Bow Stop", 3, 6.0f, 1},
+    {"data/player/Push", 6, 10.0f, 1},
+};
+
+typedef struct {
+    const char *path;
+    f32 scroll_factor;
+} parallax_layer_desc_t;
+
+// NOTE(Wes): Back to front. Bg 1 and Bg 3-6 are alternative full screen
+// backdrops so only the front most of them is ever visible, the layer system
+// skips the ones it hides. Bg 2 is a strip of trees that sits on top.
+static const parallax_layer_desc_t parallax_layer_descs[] = {
+    {"data/Background/Bg 6.png", 0.1f},
+    {"data/Background/Bg 5.png", 0.1f},
+    {"data/Background/Bg 4.png", 0.1f},
+    {"data/Background/Bg 3.png", 0.1f},
+    {"data/Background/Bg 1.png", 0.2f},
+    {"data/Background/Bg 2.png", 0.5f},
+};
+
+static const char *sprite_paths[sprite_id_count] = {
+    "data/tiles/Box 01.png",
+    "data/player/test.png",
+    "data/teleporter/blue.png",
+    "data/teleporter/gray.png",
+    "data/teleporter/green.png",
+    "data/teleporter/red.png",
+    "data/teleporter/yellow.png",
+};
+
+// NOTE(Wes): Packs every sprite into the atlas. The decoded images are only
+// needed until they have been copied into an atlas page.
+static void load_sprites(game_state_t *game_state, load_file_fn load_file)
+{
+    image_t images[sprite_id_count];
+    for (u32 i = 0; i < sprite_id_count; ++i) {
+        images[i] = load_image(sprite_paths[i], load_file);
+    }
+
+    b8 packed = atlas_add_images(&game_state->atlas, images, game_state->sprites, sprite_id_count);
+    assert(packed);
+
+    for (u32 i = 0; i < sprite_id_count; ++i) {
+        stbi_image_free(images[i].data);
+    }
+}
+
+// NOTE(Wes): Packs each frame sequence into its own atlas strip.
+static void load_anim_clips(game_state_t *game_state, load_file_fn load_file)
+{
+    for (u32 clip_id = 0; clip_id < anim_clip_count; ++clip_id) {
+        const anim_clip_desc_t *desc = &anim_clip_descs[clip_id];
+        assert(desc->frame_count <= GG_MAX_ANIM_FRAMES);
+
+        image_t frames[GG_MAX_ANIM_FRAMES];
+        for (u32 i = 0; i < desc->frame_count; ++i) {
+            char path[256];
+            snprintf(path, sizeof(path), "%s/%u.png", desc->directory, i + 1);
+            frames[i] = load_image(path, load_file);
+        }
+
+        b8 loaded = anim_load_clip(&game_state->clips[clip_id],
+                                   &game_state->atlas,
+                                   &game_state->frame_arena,
+                                   frames,
+                                   desc->frame_count,
+                                   1.0f / desc->frames_per_second,
+                                   desc->loops);
+        assert(loaded);
+
+        for (u32 i = 0; i < desc->frame_count; ++i) {
+            stbi_image_free(frames[i].data);
+        }
+    }
+}
+
+static void load_parallax_layers(game_state_t *game_state, load_file_fn load_file)
+{
+    parallax_init(&game_state->parallax, V2(128.0f, 72.0f));
+    for (u32 i = 0; i < ARRAY_LEN(parallax_layer_descs); ++i) {
+        const parallax_layer_desc_t *desc = &parallax_layer_descs[i];
+        image_t source = load_image(desc->path, load_file);
+        b8 added = parallax_add_layer(&game_state->parallax, &source, desc->scroll_factor);
+        assert(added);
+    }
+}
+
+// NOTE(Wes): Entities are despawned through here rather than entity_free so
+// an animated entity gives its animation state back, see GG_MAX_ANIM_STATES.
+static void despawn_entity(game_state_t *game_state, entity_handle_t handle)
+{
+    entity_t *entity = entity_get(&game_state->world.entities, handle);
+    if (!entity) {
+        return;
+    }
+    if (entity->anim) {
+        anim_free(&game_state->anims, entity->anim);
+        entity->anim = 0;
+    }
+    entity_free(&game_state->world.entities, handle);
+}
+
+// NOTE(Wes): Picks the clip each animated entity should be playing from its
+// movement and then advances every animation.
+static void update_anims(game_state_t *game_state, f32 delta_time)
+{
+    world_t *world = &game_state->world;
+    for (u32 i = 1; i < world->entities.count; ++i) {
+        entity_t *entity = entity_at(&world->entities, i);
+        if (!entity->exists || !entity->anim) {
+            continue;
+        }
+
+        const f32 walk_speed_sq = 1.0f;
+        v2 velocity = entity_velocity(&world->entities, entity);
+        if (velocity.x > 0.1f) {
+            entity->facing = 1.0f;
+        } else if (velocity.x < -0.1f) {
+            entity->facing = -1.0f;
+        }
+
+        u16 clip = v2_len_sq(velocity) > walk_speed_sq ? anim_clip_walk_with_sword : anim_clip_sword_stop;
+        anim_play(&game_state->anims, entity->anim, clip);
+    }
+
+    anim_update(&game_state->anims, game_state->clips, delta_time);
+}
+
+#ifdef GG_INTERNAL
+// NOTE(Wes): Asset ids in render captures are indices into this table: the
+// atlas pages, then the parallax layer caches, then the player normal map.
+// Layer caches are captured as their source and resampled on replay.
+static void capture_render_queue(game_state_t *game_state,
+                                 render_queue_t *queue,
+                                 u32 frame_width,
+                                 u32 frame_height,
+                                 game_callbacks_t *callbacks,
+                                 const char *path)
+{
+    render_capture_asset_t assets[GG_ATLAS_MAX_PAGES + GG_MAX_PARALLAX_LAYERS + 1] = {0};
+    u32 asset_count = 0;
+    for (u32 i = 0; i < GG_ATLAS_MAX_PAGES; ++i) {
+        assets[asset_count++].image = &game_state->atlas.pages[i].image;
+    }
+    for (u32 i = 0; i < GG_MAX_PARALLAX_LAYERS; ++i) {
+        assets[asset_count].image = &game_state->parallax.layers[i].cache;
+        assets[asset_count++].source = &game_state->parallax.layers[i].source;
+    }
+    assets[asset_count++].image = &game_state->player_normal;
+
+    temp_memory_t temp = begin_temp_memory(&game_state->frame_arena);
+    u32 capture_size = 0;
+    u8 *capture = render_capture_queue(queue,
+                                       frame_width,
+                                       frame_height,
+                                       assets,
+                                       asset_count,
+                                       &game_state->frame_arena,
+                                       &capture_size);
+    if (!capture) {
+        callbacks->log("Render capture failed, a command uses an image without an asset id");
+    } else if (!callbacks->write_file || !callbacks->write_file(path, capture, capture_size)) {
+        callbacks->log("Failed to write render capture %s", path);
+    } else {
+        callbacks->log("Captured %u bytes of render commands to %s", capture_size, path);
+    }
+    end_temp_memory(temp);
+}
+#endif
+
+// NOTE(Wes): Pushes the scene as the world is now. Nothing here advances the
+// game so a frame can be built again from the same state at another size, see
+// game_update_and_render.
+static void push_scene(game_state_t *game_state, render_frame_t *frame, game_frame_buffer_t *frame_buffer, log_fn log)
+{
+    frame->camera = game_state->world.camera;
+    frame->frame_width = frame_buffer->w;
+    frame->frame_height = frame_buffer->h;
+
+    // NOTE(Wes): Start by clearing the screen.
+    render_push_clear(frame->queue, COLOR(1.0f, 0.5f, 0.5f, 0.5f));
+    // render_push_clear(frame->queue, COLOR(1.0f, 1.0f, 0.0f, 0.0f));
+    f32 angle = game_state->elapsed_time * 0.5f;
+    v2 light_origin = v2_mul(V2(kcosf(angle), ksinf(angle)), 10);
+    light_origin = v2_add(light_origin, V2(50.0f, 50.0f));
+    v4 light_color = V4(1.0f, 1.0f, 1.0f, 1.0f);
+    v3 light_pos = V3(light_origin.x, light_origin.y, 15.0f);
+    v4 ambient = V4(1.0f, 1.0f, 1.0f, 1.0f);
+    f32 radius = 100.0f;
+    light_t light = {light_color, light_pos, ambient, radius};
+    frame->light = light;
+
+#if 1
+    parallax_push(&game_state->parallax, frame->queue, &frame->camera, log);
+    tilemap_t *tilemap = &game_state->world.tilemap;
+    for (u32 i = 0; i < 18; ++i) {
+        for (u32 j = 0; j < 32; ++j) {
+            if (tilemap->tiles[j + i * tilemap->tiles_wide]) {
+                v2 tile_origin;
+                tile_origin.x = j * tilemap->tile_size.x;
+                tile_origin.y = i * tilemap->tile_size.y;
+                basis_t tile_basis = {tile_origin, V2(tilemap->tile_size.x, 0.0f), V2(0.0f, tilemap->tile_size.y)};
+                render_push_sprite(frame->queue,
+                                   &tile_basis,
+                                   V4(1.0f, 1.0f, 1.0f, 1.0f),
+                                   &game_state->sprites[sprite_id_tile],
+                                   0,
+                                   &frame->light,
+                                   1);
+                render_push_hollow_rect(frame->queue, &tile_basis, COLOR(1.0f, 0.0f, 1.0f, 1.0f), 0.1f);
+            }
+        }
+    }
+#endif
+
+    for (u32 i = 0; i < GG_MAX_CONTROLLERS; ++i) {
+        entity_t *entity = entity_get(&game_state->world.entities, game_state->world.controlled_entities[i]);
+        if (!entity) {
+            continue;
+        }
+
+        v2 position = entity_position(&game_state->world.entities, entity);
+        if (entity->type == entity_type_player) {
+            if (entity->anim) {
+                // NOTE(Wes): Frames are larger than the collision box. Stand the
+                // frame on the bottom centre of the box and mirror it when
+                // facing left.
+                sprite_t anim_frame = anim_get_frame(&game_state->anims, game_state->clips, entity->anim);
+                f32 draw_h = entity->size.y * 1.25f;
+                f32 draw_w = draw_h * (f32)anim_frame.w / (f32)anim_frame.h;
+                v2 feet = V2(position.x + entity->size.x * 0.5f, position.y + entity->size.y);
+                v2 draw_pos = V2(feet.x - draw_w * 0.5f * entity->facing, feet.y - draw_h);
+                basis_t player_basis = {draw_pos, V2(draw_w * entity->facing, 0.0f), V2(0.0f, draw_h)};
+                render_push_sprite(frame->queue,
+                                   &player_basis,
+                                   V4(1.0f, 1.0f, 1.0f, 1.0f),
+                                   &anim_frame,
+                                   0,
+                                   &frame->light,
+                                   1);
+            } else {
+                v2 draw_offset = V2(0.0f, 0.0f);
+                v2 draw_pos = v2_add(position, draw_offset);
+                basis_t player_basis = {draw_pos, V2(entity->size.x, 0.0f), V2(0.0f, entity->size.y)};
+                render_push_sprite(frame->queue,
+                                   &player_basis,
+                                   V4(1.0f, 1.0f, 1.0f, 1.0f),
+                                   &game_state->sprites[sprite_id_player],
+                                   &game_state->player_normal,
+                                   &frame->light,
+                                   1);
+            }
+        }
+    }
+
+#if 1
+    v2 o = {{60.0f, 36.0f}};
+    v2 x = {{25.0f, -6.0f}};
+    v2 y = v2_perp(x);
+    v2 o2 = {{30.0f, 30.0f}};
+    v2 x2 = {{10.0f, 0.0f}};
+    v2 y2 = v2_perp(x2);
+    basis_t line1_basis = {o, x, y};
+    basis_t line2_basis = {o2, x2, y2};
+
+    v4 line_color1 = COLOR(1.0f, 1.0f, 0.0f, 0.0f);
+    v4 line_color2 = COLOR(1.0f, 0.0f, 1.0f, 0.0f);
+    if (collider_contains_point(&line1_basis, line2_basis.origin)) {
+        line_color2 = COLOR(1.0f, 0.0f, 1.0f, 0.0f);
+    }
+
+    render_push_hollow_rect(frame->queue, &line1_basis, line_color1, 0.2f);
+    render_push_hollow_rect(frame->queue, &line2_basis, line_color2, 0.5f);
+#endif
+}
+
+// NOTE(Wes): Debug views drawn over the scene. Pushed after the capture so
+// captures only hold the scene.
+static void push_overlays(game_state_t *game_state, game_memory_t *memory, render_queue_t *queue, game_frame_buffer_t *frame_buffer)
+{
+#ifdef GG_EDITOR
+    queue->overdraw = 0;
+    if (game_state->editor_enabled && game_state->overdraw_enabled) {
+        queue->overdraw = game_state->overdraw;
+    }
+
+#ifdef GG_INTERNAL
+    profiler_push_overlay(&game_state->profiler, memory->profile, queue, frame_buffer->w, frame_buffer->h);
+#endif
+#endif
+}
+
+#ifdef GG_INTERNAL
+dbg_profile_t *dbg_global_profile;
+#endif
+
 DLL_FN void game_update_and_render(game_memory_t *memory,
                                    game_frame_buffer_t *frame_buffer,
                                    game_audio_t *audio,
@@ -333,13 +615,14 @@ DLL_FN void game_update_and_render(game_memory_t *memory,
                                    game_callbacks_t *callbacks,
                                    game_work_queues_t *work_queues)
 {
-    dbg_global_memory = memory;
-    START_COUNTER(game_update_and_render);
+#ifdef GG_INTERNAL
+    dbg_global_profile = memory->profile;
+#endif
+    BEGIN_BLOCK(game_update_and_render);
 
     assert(sizeof(game_state_t) <= memory->permanent_store_size);
     game_state_t *game_state = (game_state_t *)memory->permanent_store;
     if (!memory->is_initialized) {
-        game_state->world.camera.units_to_pixels = 15.0f / 1.0f;
         game_state->world.camera.position.x = 0.0f;
         game_state->world.camera.position.y = 0.0f;
         game_state->world.gravity.x = 0.0f;
@@ -378,21 +661,72 @@ DLL_FN void game_update_and_render(game_memory_t *memory,
         game_state->world.tilemap.tiles_wide = 32;
         game_state->world.tilemap.tiles_high = 18;
 
-        game_state->background_image = load_image("data/background/Bg 1.png", callbacks->load_file);
-        game_state->tile_image = load_image("data/tiles/Box 01.png", callbacks->load_file);
-        game_state->player_image = load_image("data/player/test.png", callbacks->load_file);
-
         init_arena(&game_state->arena,
                    memory->permanent_store_size - sizeof(game_state_t),
                    memory->permanent_store + sizeof(game_state_t));
         init_arena(&game_state->frame_arena, memory->transient_store_size, memory->transient_store);
+        entity_pool_init(&game_state->world.entities, &game_state->arena);
+
+        load_parallax_layers(game_state, callbacks->load_file);
+        parallax_alloc_caches(&game_state->parallax,
+                              &game_state->frame_arena,
+                              GG_MAX_FRAME_WIDTH / game_state->parallax.size.x);
+        atlas_init(&game_state->atlas, &game_state->arena, GG_ATLAS_PAGE_SIZE);
+        load_sprites(game_state, callbacks->load_file);
+        load_anim_clips(game_state, callbacks->load_file);
+        anim_init_states(&game_state->anims);
 
         // TODO(Wes): This breaks the hot reloading. Fix it.
-        game_state->render_queue = render_alloc_queue(&game_state->frame_arena, 40000, &game_state->world.camera);
+        for (u32 i = 0; i < GG_RENDER_FRAMES; ++i) {
+            render_frame_t *frame = &game_state->frames[i];
+            frame->queue = render_alloc_queue(&game_state->frame_arena, 40000, &frame->camera);
+        }
+#ifdef GG_EDITOR
+        game_state->overdraw = push_array(&game_state->frame_arena, GG_MAX_FRAME_WIDTH * GG_MAX_FRAME_HEIGHT, u32);
+#ifdef GG_INTERNAL
+        profiler_alloc_overlay(&game_state->profiler, &game_state->frame_arena);
+#endif
+#endif
+#ifdef GG_INTERNAL
+        game_state->last_render_queue =
+            render_alloc_queue(&game_state->frame_arena, game_state->frames[0].queue->size, &game_state->last_camera);
+#endif
 
         memory->is_initialized = 1;
     }
 
+    // NOTE(Wes): The view always spans the width of the world. The platform may
+    // render at a lower resolution when it is behind so the scale follows the
+    // frame buffer rather than being fixed.
+    game_state->world.camera.units_to_pixels = (f32)frame_buffer->w / game_state->parallax.size.x;
+
+    // NOTE(Wes): In pipelined mode the frame built by the last call is drawn
+    // by the workers while this call simulates and builds the next one.
+    // Nothing has moved since that frame was built, so when there is none yet
+    // or it was built for another frame buffer size it is built again here
+    // from the same state rather than dropped. Its layer caches are rebuilt
+    // now, before anything reads them, so parallax_push leaves them alone
+    // while the frame is drawn.
+    render_frame_t *drawing = 0;
+    render_frame_t *pending = &game_state->frames[game_state->frame_index ^ 1];
+    if (memory->pipelined) {
+        if (!game_state->frame_pending || pending->frame_width != frame_buffer->w ||
+            pending->frame_height != frame_buffer->h) {
+            pending->queue->index = 0;
+            push_scene(game_state, pending, frame_buffer, callbacks->log);
+            push_overlays(game_state, memory, pending->queue, frame_buffer);
+        }
+        drawing = pending;
+        render_begin_draw_queue(drawing->queue, frame_buffer, work_queues, &game_state->draw);
+    } else if (game_state->frame_pending) {
+        pending->queue->index = 0;
+    }
+    game_state->frame_pending = 0;
+    render_frame_t *current = &game_state->frames[game_state->frame_index];
+    game_state->render_queue = current->queue;
+
+    BEGIN_BLOCK(game_update);
+
 #ifdef GG_EDITOR
     for (u32 i = 0; i < GG_MAX_CONTROLLERS; ++i) {
         game_controller_input_t *controller = &input->controllers[i];
@@ -400,163 +734,160 @@ DLL_FN void game_update_and_render(game_memory_t *memory,
             game_state->editor_enabled = !game_state->editor_enabled;
         }
     }
+
+    // NOTE(Wes): The overdraw view only toggles on the press, not every frame
+    // the button is held.
+    b8 overdraw_down = 0;
+    for (u32 i = 0; i < GG_MAX_CONTROLLERS; ++i) {
+        overdraw_down |= input->controllers[i].editor_overdraw.ended_down;
+    }
+    if (game_state->editor_enabled && overdraw_down && !game_state->overdraw_was_down) {
+        game_state->overdraw_enabled = !game_state->overdraw_enabled;
+    }
+    game_state->overdraw_was_down = overdraw_down;
+
+#ifdef GG_INTERNAL
+    profiler_update(&game_state->profiler, memory->profile, input);
+#endif
 #endif
 
     // NOTE(Wes): Check for controller based entity spawn.
     for (u32 i = 0; i < GG_MAX_CONTROLLERS; ++i) {
         game_controller_input_t *controller = &input->controllers[i];
-        u32 controlled_entity = game_state->world.controlled_entities[i];
-        if (controller->start.ended_down && !controlled_entity) {
-            controlled_entity = get_next_entity(game_state->world.entities);
+        entity_handle_t controlled_entity = game_state->world.controlled_entities[i];
+        if (controller->start.ended_down && !entity_get(&game_state->world.entities, controlled_entity)) {
+            controlled_entity = entity_alloc(&game_state->world.entities);
             game_state->world.controlled_entities[i] = controlled_entity;
+            if (!controlled_entity) {
+                continue;
+            }
 
             // NOTE(Wes): Initialize the player
-            entity_t *entity = &game_state->world.entities[controlled_entity];
+            entity_t *entity = entity_get(&game_state->world.entities, controlled_entity);
             entity->type = entity_type_player;
-            entity->position.x = 80.0f;
-            entity->position.y = 54.0f;
+            entity_set_position(&game_state->world.entities, entity, V2(80.0f, 54.0f));
             entity->size.x = 2.0f;
             entity->size.y = 4.0f;
-            entity->exists = 1;
-            entity->velocity_factor = -7.0f; // Drag
+            entity_set_velocity_factor(&game_state->world.entities, entity, -7.0f); // Drag
             entity->acceleration_factor = 150.0f;
+            entity->facing = 1.0f;
+            entity->anim = anim_alloc(&game_state->anims, anim_clip_sword_stop);
         }
     }
 
     update_entities(game_state, input, callbacks->log);
+    update_anims(game_state, input->delta_time);
 
     // Update draw offset and units_to_pixels so that camera always sees all
     // players
 
     v2 min_pos = V2(FLT_MAX, FLT_MAX);
-    v2 max_pos = V2(FLT_MIN, FLT_MIN);
+    v2 max_pos = V2(-FLT_MAX, -FLT_MAX);
+    b8 any_players = 0;
 
     for (u32 i = 0; i < GG_MAX_CONTROLLERS; ++i) {
-        u32 controlled_entity = game_state->world.controlled_entities[i];
-        if (controlled_entity) {
-            entity_t *entity = &game_state->world.entities[controlled_entity];
+        entity_t *entity = entity_get(&game_state->world.entities, game_state->world.controlled_entities[i]);
+        if (entity) {
             if (entity->type == entity_type_player) {
-                if (entity->position.x < min_pos.x) {
-                    min_pos.x = entity->position.x;
+                any_players = 1;
+                v2 position = entity_position(&game_state->world.entities, entity);
+                if (position.x < min_pos.x) {
+                    min_pos.x = position.x;
                 }
-                if (entity->position.y < min_pos.y) {
-                    min_pos.y = entity->position.y;
+                if (position.y < min_pos.y) {
+                    min_pos.y = position.y;
                 }
-                if (entity->position.x > max_pos.x) {
-                    max_pos.x = entity->position.x;
+                if (position.x > max_pos.x) {
+                    max_pos.x = position.x;
                 }
-                if (entity->position.y > max_pos.y) {
-                    max_pos.y = entity->position.y;
+                if (position.y > max_pos.y) {
+                    max_pos.y = position.y;
                 }
             }
         }
     }
 
     // min_pos = V2(0, 0);
-    tilemap_t *tilemap = &game_state->world.tilemap;
     // max_pos = V2(tilemap->tile_size.x * tilemap->tiles_wide, tilemap->tile_size.y * tilemap->tiles_high);
 
-    v2 camera_edge_buffer = V2(10.0f, 10.0f);
-    min_pos = v2_sub(min_pos, camera_edge_buffer);
-    max_pos = v2_add(max_pos, camera_edge_buffer);
-    v2 new_camera_pos = v2_div(v2_add(min_pos, max_pos), 2.0f);
+    // NOTE(Wes): Without any players there is nothing to follow so the camera stays put.
+    if (any_players) {
+        v2 camera_edge_buffer = V2(10.0f, 10.0f);
+        min_pos = v2_sub(min_pos, camera_edge_buffer);
+        max_pos = v2_add(max_pos, camera_edge_buffer);
+        v2 new_camera_pos = v2_div(v2_add(min_pos, max_pos), 2.0f);
+
+        f32 cam_move_speed = 4.0f;
+        game_state->world.camera.position =
+            v2_add(v2_mul(game_state->world.camera.position, (1.0f - (input->delta_time * cam_move_speed))),
+                   v2_mul(new_camera_pos, (input->delta_time * cam_move_speed)));
+        game_state->world.camera.position = new_camera_pos;
+    }
 
-    f32 cam_move_speed = 4.0f;
-    game_state->world.camera.position =
-        v2_add(v2_mul(game_state->world.camera.position, (1.0f - (input->delta_time * cam_move_speed))),
-               v2_mul(new_camera_pos, (input->delta_time * cam_move_speed)));
-    game_state->world.camera.position = new_camera_pos;
+    END_BLOCK(game_update);
 
-    // NOTE(Wes): Start by clearing the screen.
-    render_push_clear(game_state->render_queue, COLOR(1.0f, 0.5f, 0.5f, 0.5f));
-    // render_push_clear(game_state->render_queue, COLOR(1.0f, 1.0f, 0.0f, 0.0f));
+    BEGIN_BLOCK(game_render);
     game_state->elapsed_time += input->delta_time;
-    f32 angle = game_state->elapsed_time * 0.5f;
-    v2 light_origin = v2_mul(V2(kcosf(angle), ksinf(angle)), 10);
-    light_origin = v2_add(light_origin, V2(50.0f, 50.0f));
-    v4 light_color = V4(1.0f, 1.0f, 1.0f, 1.0f);
-    v3 light_pos = V3(light_origin.x, light_origin.y, 15.0f);
-    v4 ambient = V4(1.0f, 1.0f, 1.0f, 1.0f);
-    f32 radius = 100.0f;
-    light_t light = {light_color, light_pos, ambient, radius};
-
-#if 1
-    v2 background_pos = V2(0.0f, 0.0f);
-    v2 background_size = V2(128.0f, 72.0f);
-    basis_t background_basis = {background_pos, V2(background_size.x, 0.0f), V2(0.0f, background_size.y)};
-    render_push_image(game_state->render_queue,
-                      &background_basis,
-                      V4(1.0f, 1.0f, 1.0f, 1.0f),
-                      &game_state->background_image,
-                      0,
-                      &light,
-                      1);
-    for (u32 i = 0; i < 18; ++i) {
-        for (u32 j = 0; j < 32; ++j) {
-            if (tilemap->tiles[j + i * tilemap->tiles_wide]) {
-                v2 tile_origin;
-                tile_origin.x = j * tilemap->tile_size.x;
-                tile_origin.y = i * tilemap->tile_size.y;
-                basis_t tile_basis = {tile_origin, V2(tilemap->tile_size.x, 0.0f), V2(0.0f, tilemap->tile_size.y)};
-                render_push_image(game_state->render_queue,
-                                  &tile_basis,
-                                  V4(1.0f, 1.0f, 1.0f, 1.0f),
-                                  &game_state->tile_image,
-                                  0,
-                                  &light,
-                                  1);
-                render_push_hollow_rect(game_state->render_queue, &tile_basis, COLOR(1.0f, 0.0f, 1.0f, 1.0f), 0.1f);
-            }
+    push_scene(game_state, current, frame_buffer, callbacks->log);
+
+#ifdef GG_INTERNAL
+    if (memory->render_capture_path) {
+        if (!memory->render_capture_previous) {
+            capture_render_queue(game_state,
+                                 game_state->render_queue,
+                                 frame_buffer->w,
+                                 frame_buffer->h,
+                                 callbacks,
+                                 memory->render_capture_path);
+        } else if (game_state->last_render_queue->index) {
+            capture_render_queue(game_state,
+                                 game_state->last_render_queue,
+                                 game_state->last_frame_width,
+                                 game_state->last_frame_height,
+                                 callbacks,
+                                 memory->render_capture_path);
+        } else {
+            callbacks->log("No copy of the previous frame to capture to %s", memory->render_capture_path);
         }
+        memory->render_capture_path = 0;
+        memory->render_capture_previous = 0;
+    }
+    // NOTE(Wes): Only needed when the platform watches for frames over budget.
+    game_state->last_render_queue->index = 0;
+    if (memory->profile && memory->profile->budget_ms > 0.0f) {
+        game_state->last_frame_width = frame_buffer->w;
+        game_state->last_frame_height = frame_buffer->h;
+        render_copy_queue(game_state->last_render_queue,
+                          game_state->render_queue,
+                          game_state->last_lights,
+                          GG_MAX_LAST_LIGHTS);
     }
 #endif
 
-    for (u32 i = 0; i < GG_MAX_CONTROLLERS; ++i) {
-        u32 controlled_entity = game_state->world.controlled_entities[i];
-        if (controlled_entity == 0) {
-            continue;
-        }
-        entity_t *entity = &game_state->world.entities[controlled_entity];
-        if (!entity->exists) {
-            continue;
-        }
-
-        if (entity->type == entity_type_player) {
-            v2 draw_offset = V2(0.0f, 0.0f);
-            v2 draw_pos = v2_add(entity->position, draw_offset);
-            basis_t player_basis = {draw_pos, V2(entity->size.x, 0.0f), V2(0.0f, entity->size.y)};
-            render_push_image(game_state->render_queue,
-                              &player_basis,
-                              V4(1.0f, 1.0f, 1.0f, 1.0f),
-                              &game_state->player_image,
-                              &game_state->player_normal,
-                              &light,
-                              1);
-        }
+    // NOTE(Wes): Everything after this may change what the last frame's
+    // commands point at, eg. the profiler overlay image.
+    if (drawing) {
+        render_end_draw_queue(&game_state->draw, work_queues);
+#ifdef GG_EDITOR
+        render_draw_overdraw(drawing->queue, frame_buffer);
+#endif
+        drawing->queue->index = 0;
     }
 
-#if 1
-    v2 o = {{60.0f, 36.0f}};
-    v2 x = {{25.0f, -6.0f}};
-    v2 y = v2_perp(x);
-    v2 o2 = {{30.0f, 30.0f}};
-    v2 x2 = {{10.0f, 0.0f}};
-    v2 y2 = v2_perp(x2);
-    basis_t line1_basis = {o, x, y};
-    basis_t line2_basis = {o2, x2, y2};
-
-    v4 line_color1 = COLOR(1.0f, 1.0f, 0.0f, 0.0f);
-    v4 line_color2 = COLOR(1.0f, 0.0f, 1.0f, 0.0f);
-    if (collider_contains_point(&line1_basis, line2_basis.origin)) {
-        line_color2 = COLOR(1.0f, 0.0f, 1.0f, 0.0f);
+    push_overlays(game_state, memory, game_state->render_queue, frame_buffer);
+    if (!memory->pipelined) {
+        render_draw_queue(game_state->render_queue, frame_buffer, work_queues);
+#ifdef GG_EDITOR
+        render_draw_overdraw(game_state->render_queue, frame_buffer);
+#endif
+    } else {
+        game_state->frame_pending = 1;
+        game_state->frame_index ^= 1;
     }
 
-    render_push_hollow_rect(game_state->render_queue, &line1_basis, line_color1, 0.2f);
-    render_push_hollow_rect(game_state->render_queue, &line2_basis, line_color2, 0.5f);
-#endif
-    render_draw_queue(game_state->render_queue, frame_buffer, work_queues);
+    END_BLOCK(game_render);
 
     output_sine_wave(game_state, audio);
 
-    END_COUNTER(game_update_and_render);
+    END_BLOCK(game_update_and_render);
 }
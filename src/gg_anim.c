@@ -0,0 +1,142 @@
+#include "gg_anim.h"
+#include "gg_atlas.h"
+
+b8 anim_load_clip(anim_clip_t *clip,
+                  atlas_t *atlas,
+                  memory_arena_t *temp_arena,
+                  image_t *frames,
+                  u32 frame_count,
+                  f32 seconds_per_frame,
+                  b8 loops)
+{
+    assert(frame_count > 0);
+    i32 frame_w = (i32)frames[0].w;
+    i32 frame_h = (i32)frames[0].h;
+    for (u32 i = 0; i < frame_count; ++i) {
+        if (!frames[i].data || frames[i].w != (u32)frame_w || frames[i].h != (u32)frame_h) {
+            return 0;
+        }
+    }
+
+    // NOTE(Wes): The atlas pads the outside of the strip, we only need to
+    // leave room for the borders between frames.
+    i32 stride = frame_w + GG_ATLAS_PADDING * 2;
+    i32 strip_w = stride * (i32)frame_count - GG_ATLAS_PADDING * 2;
+
+    temp_memory_t temp = begin_temp_memory(temp_arena);
+    image_t strip;
+    strip.w = (u32)strip_w;
+    strip.h = (u32)frame_h;
+    strip.data = push_array(temp_arena, strip_w * frame_h, u32);
+
+    for (u32 i = 0; i < frame_count; ++i) {
+        image_t *frame = &frames[i];
+        i32 base_x = (i32)i * stride;
+        for (i32 y = 0; y < frame_h; ++y) {
+            u32 *src_row = frame->data + y * frame_w;
+            u32 *dst_row = strip.data + y * strip_w;
+            for (i32 x = -GG_ATLAS_PADDING; x < frame_w + GG_ATLAS_PADDING; ++x) {
+                i32 dst_x = base_x + x;
+                if (dst_x < 0 || dst_x >= strip_w) {
+                    continue;
+                }
+                i32 src_x = x < 0 ? 0 : (x >= frame_w ? frame_w - 1 : x);
+                dst_row[dst_x] = src_row[src_x];
+            }
+        }
+    }
+
+    b8 result = atlas_add_image(atlas, &strip, &clip->strip);
+    end_temp_memory(temp);
+
+    clip->frame_count = frame_count;
+    clip->frame_stride = (u32)stride;
+    clip->seconds_per_frame = seconds_per_frame;
+    clip->loops = loops;
+    return result;
+}
+
+void anim_init_states(anim_states_t *states)
+{
+    states->count = 1;
+    states->first_free = 0;
+    states->clip[0] = GG_ANIM_NONE;
+    states->frame[0] = 0;
+    states->time[0] = 0.0f;
+}
+
+u32 anim_alloc(anim_states_t *states, u16 clip)
+{
+    u32 anim = states->first_free;
+    if (anim) {
+        states->first_free = states->next_free[anim];
+    } else if (states->count < GG_MAX_ANIM_STATES) {
+        anim = states->count++;
+    } else {
+        return 0;
+    }
+
+    states->clip[anim] = clip;
+    states->frame[anim] = 0;
+    states->time[anim] = 0.0f;
+    return anim;
+}
+
+void anim_free(anim_states_t *states, u32 anim)
+{
+    assert(anim > 0 && anim < states->count);
+    states->clip[anim] = GG_ANIM_NONE;
+    states->next_free[anim] = (u16)states->first_free;
+    states->first_free = anim;
+}
+
+void anim_play(anim_states_t *states, u32 anim, u16 clip)
+{
+    assert(anim < states->count);
+    if (states->clip[anim] != clip) {
+        states->clip[anim] = clip;
+        states->frame[anim] = 0;
+        states->time[anim] = 0.0f;
+    }
+}
+
+void anim_update(anim_states_t *states, anim_clip_t *clips, f32 delta_time)
+{
+    u16 *clip_ids = states->clip;
+    u16 *frames = states->frame;
+    f32 *times = states->time;
+    for (u32 i = 1; i < states->count; ++i) {
+        u16 clip_id = clip_ids[i];
+        if (clip_id == GG_ANIM_NONE) {
+            continue;
+        }
+
+        anim_clip_t *clip = &clips[clip_id];
+        f32 seconds_per_frame = clip->seconds_per_frame;
+        if (seconds_per_frame <= 0.0f) {
+            continue;
+        }
+
+        f32 time = times[i] + delta_time;
+        u32 frame = frames[i];
+        while (time >= seconds_per_frame) {
+            time -= seconds_per_frame;
+            if (++frame >= clip->frame_count) {
+                frame = clip->loops ? 0 : clip->frame_count - 1;
+            }
+        }
+        times[i] = time;
+        frames[i] = (u16)frame;
+    }
+}
+
+sprite_t anim_get_frame(anim_states_t *states, anim_clip_t *clips, u32 anim)
+{
+    assert(anim < states->count);
+    assert(states->clip[anim] != GG_ANIM_NONE);
+    anim_clip_t *clip = &clips[states->clip[anim]];
+    sprite_t result = clip->strip;
+    result.x += states->frame[anim] * clip->frame_stride;
+    result.w = clip->strip.w - (clip->frame_count - 1) * clip->frame_stride;
+    return result;
+}
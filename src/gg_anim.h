@@ -0,0 +1,32 @@
+#pragma once
+
+#include "gg_types.h"
+
+// Packs the frames side by side into a single atlas strip. Every frame keeps
+// its own extruded border so bilinear sampling never bleeds into the next
+// frame. The strip is assembled in temporary memory taken from the arena.
+b8 anim_load_clip(anim_clip_t *clip,
+                  atlas_t *atlas,
+                  memory_arena_t *temp_arena,
+                  image_t *frames,
+                  u32 frame_count,
+                  f32 seconds_per_frame,
+                  b8 loops);
+
+// Resets the animation states so that only the "null" animation exists.
+void anim_init_states(anim_states_t *states);
+
+// Returns a new animation playing the clip from its first frame, 0 when full.
+u32 anim_alloc(anim_states_t *states, u16 clip);
+
+void anim_free(anim_states_t *states, u32 anim);
+
+// Switches the clip being played. Playing the current clip again does not
+// restart it.
+void anim_play(anim_states_t *states, u32 anim, u16 clip);
+
+// Advances every live animation by delta_time seconds.
+void anim_update(anim_states_t *states, anim_clip_t *clips, f32 delta_time);
+
+// Returns the atlas sub-rect of the frame the animation is currently showing.
+sprite_t anim_get_frame(anim_states_t *states, anim_clip_t *clips, u32 anim);
@@ -0,0 +1,219 @@
+#include "gg_atlas.h"
+
+#include <string.h>
+
+void atlas_init(atlas_t *atlas, memory_arena_t *arena, u32 page_size)
+{
+    assert(page_size <= GG_ATLAS_PAGE_SIZE);
+    atlas->arena = arena;
+    atlas->page_size = page_size;
+    atlas->page_count = 0;
+}
+
+static atlas_page_t *atlas_alloc_page(atlas_t *atlas)
+{
+    if (atlas->page_count == GG_ATLAS_MAX_PAGES) {
+        return 0;
+    }
+
+    atlas_page_t *page = &atlas->pages[atlas->page_count++];
+    page->image.w = atlas->page_size;
+    page->image.h = atlas->page_size;
+    page->image.data = push_array(atlas->arena, atlas->page_size * atlas->page_size, u32);
+    memset(page->image.data, 0, atlas->page_size * atlas->page_size * sizeof(u32));
+
+    // NOTE(Wes): An empty page is a single node spanning the whole width at height 0.
+    page->node_count = 1;
+    page->nodes[0].x = 0;
+    page->nodes[0].y = 0;
+    page->nodes[0].w = (u16)atlas->page_size;
+    return page;
+}
+
+// Returns the y position a rect of the specified size would rest at if its
+// left edge was placed on the node at index, or -1 if it does not fit.
+static i32 atlas_skyline_fit(atlas_page_t *page, u32 page_size, u32 index, u32 w, u32 h)
+{
+    u32 x = page->nodes[index].x;
+    if (x + w > page_size) {
+        return -1;
+    }
+
+    u32 y = 0;
+    i32 width_left = (i32)w;
+    while (width_left > 0) {
+        atlas_skyline_node_t *node = &page->nodes[index++];
+        if (node->y > y) {
+            y = node->y;
+        }
+        if (y + h > page_size) {
+            return -1;
+        }
+        width_left -= node->w;
+    }
+
+    return (i32)y;
+}
+
+static void atlas_skyline_remove(atlas_page_t *page, u32 index)
+{
+    memmove(&page->nodes[index],
+            &page->nodes[index + 1],
+            (page->node_count - index - 1) * sizeof(atlas_skyline_node_t));
+    page->node_count--;
+}
+
+static void atlas_skyline_insert(atlas_page_t *page, u32 index, u32 x, u32 y, u32 w, u32 h)
+{
+    assert(page->node_count < ARRAY_LEN(page->nodes));
+    memmove(&page->nodes[index + 1],
+            &page->nodes[index],
+            (page->node_count - index) * sizeof(atlas_skyline_node_t));
+    page->node_count++;
+
+    atlas_skyline_node_t *new_node = &page->nodes[index];
+    new_node->x = (u16)x;
+    new_node->y = (u16)(y + h);
+    new_node->w = (u16)w;
+
+    // NOTE(Wes): Shrink or remove the nodes now covered by the new node.
+    for (u32 i = index + 1; i < page->node_count;) {
+        atlas_skyline_node_t *prev = &page->nodes[i - 1];
+        atlas_skyline_node_t *node = &page->nodes[i];
+        u32 prev_end = prev->x + prev->w;
+        if (node->x >= prev_end) {
+            break;
+        }
+
+        u32 shrink = prev_end - node->x;
+        if (node->w > shrink) {
+            node->x += (u16)shrink;
+            node->w -= (u16)shrink;
+            break;
+        }
+        atlas_skyline_remove(page, i);
+    }
+
+    // NOTE(Wes): Merge neighbouring nodes at the same height.
+    for (u32 i = 0; i + 1 < page->node_count;) {
+        if (page->nodes[i].y == page->nodes[i + 1].y) {
+            page->nodes[i].w += page->nodes[i + 1].w;
+            atlas_skyline_remove(page, i + 1);
+        } else {
+            ++i;
+        }
+    }
+}
+
+// Bottom-left skyline placement. Picks the lowest resting position, breaking
+// ties with the narrowest node so wide gaps are kept for wide images.
+static b8 atlas_page_place(atlas_page_t *page, u32 page_size, u32 w, u32 h, u32 *out_x, u32 *out_y)
+{
+    i32 best_index = -1;
+    u32 best_y = UINT_MAX;
+    u32 best_w = UINT_MAX;
+    for (u32 i = 0; i < page->node_count; ++i) {
+        i32 y = atlas_skyline_fit(page, page_size, i, w, h);
+        if (y < 0) {
+            continue;
+        }
+        if ((u32)y < best_y || ((u32)y == best_y && page->nodes[i].w < best_w)) {
+            best_index = (i32)i;
+            best_y = (u32)y;
+            best_w = page->nodes[i].w;
+        }
+    }
+
+    if (best_index < 0) {
+        return 0;
+    }
+
+    *out_x = page->nodes[best_index].x;
+    *out_y = best_y;
+    atlas_skyline_insert(page, (u32)best_index, *out_x, best_y, w, h);
+    return 1;
+}
+
+// Copies the image into the page at (x, y) + padding and extrudes its edges
+// into the padding.
+static void atlas_blit(atlas_page_t *page, u32 x, u32 y, image_t *image)
+{
+    i32 w = (i32)image->w;
+    i32 h = (i32)image->h;
+    for (i32 src_y = -GG_ATLAS_PADDING; src_y < h + GG_ATLAS_PADDING; ++src_y) {
+        i32 clamped_y = src_y < 0 ? 0 : (src_y >= h ? h - 1 : src_y);
+        u32 *src_row = image->data + clamped_y * w;
+        u32 *dst_row = page->image.data + (y + GG_ATLAS_PADDING + src_y) * page->image.w + x + GG_ATLAS_PADDING;
+        for (i32 src_x = -GG_ATLAS_PADDING; src_x < w + GG_ATLAS_PADDING; ++src_x) {
+            i32 clamped_x = src_x < 0 ? 0 : (src_x >= w ? w - 1 : src_x);
+            dst_row[src_x] = src_row[clamped_x];
+        }
+    }
+}
+
+b8 atlas_add_image(atlas_t *atlas, image_t *image, sprite_t *sprite)
+{
+    assert(atlas);
+    assert(image);
+    assert(sprite);
+    if (!image->data || !image->w || !image->h) {
+        return 0;
+    }
+
+    u32 padded_w = image->w + GG_ATLAS_PADDING * 2;
+    u32 padded_h = image->h + GG_ATLAS_PADDING * 2;
+    if (padded_w > atlas->page_size || padded_h > atlas->page_size) {
+        return 0;
+    }
+
+    u32 x = 0;
+    u32 y = 0;
+    atlas_page_t *page = 0;
+    for (u32 i = 0; i < atlas->page_count; ++i) {
+        if (atlas_page_place(&atlas->pages[i], atlas->page_size, padded_w, padded_h, &x, &y)) {
+            page = &atlas->pages[i];
+            break;
+        }
+    }
+
+    if (!page) {
+        page = atlas_alloc_page(atlas);
+        if (!page || !atlas_page_place(page, atlas->page_size, padded_w, padded_h, &x, &y)) {
+            return 0;
+        }
+    }
+
+    atlas_blit(page, x, y, image);
+
+    sprite->image = &page->image;
+    sprite->x = x + GG_ATLAS_PADDING;
+    sprite->y = y + GG_ATLAS_PADDING;
+    sprite->w = image->w;
+    sprite->h = image->h;
+    return 1;
+}
+
+b8 atlas_add_images(atlas_t *atlas, image_t *images, sprite_t *sprites, u32 count)
+{
+    // NOTE(Wes): Insertion sort the indices by height. Batches are small.
+    u32 order[256];
+    assert(count <= ARRAY_LEN(order));
+    for (u32 i = 0; i < count; ++i) {
+        u32 j = i;
+        while (j > 0 && images[order[j - 1]].h < images[i].h) {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = i;
+    }
+
+    b8 result = 1;
+    for (u32 i = 0; i < count; ++i) {
+        u32 index = order[i];
+        if (!atlas_add_image(atlas, &images[index], &sprites[index])) {
+            result = 0;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "gg_types.h"
+
+// Prepares an empty atlas. Pages are allocated from the arena as they are needed.
+void atlas_init(atlas_t *atlas, memory_arena_t *arena, u32 page_size);
+
+// Copies the image into the first atlas page with room for it and returns the
+// sub-rect it was packed into. Returns 0 if the image does not fit in a page.
+b8 atlas_add_image(atlas_t *atlas, image_t *image, sprite_t *sprite);
+
+// Packs a batch of images tallest first, which packs considerably tighter than
+// adding them in load order. sprites[i] receives the sub-rect of images[i].
+b8 atlas_add_images(atlas_t *atlas, image_t *images, sprite_t *sprites, u32 count);
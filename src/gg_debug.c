@@ -0,0 +1,536 @@
+// NOTE(Wes): The profiler is owned by the platform and is shared by every host.
+// It is included after gg_platform.h. The game only records into it, see gg_debug.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef GG_INTERNAL
+
+// Used by the hosts' trace hotkey.
+#define DBG_TRACE_PATH "trace.json"
+#define DBG_TRACE_FRAME_COUNT 120
+
+dbg_profile_t *dbg_global_profile;
+
+static u64 dbg_get_wall_clock(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (u64)now.tv_sec * 1000000000ull + (u64)now.tv_nsec;
+}
+
+static dbg_profile_t *dbg_alloc_profile(void)
+{
+    // NOTE(Wes): The event buffers are large but are only touched as threads
+    // register, so most of this is never committed.
+    dbg_profile_t *profile = (dbg_profile_t *)calloc(1, sizeof(dbg_profile_t));
+    if (profile) {
+        profile->last_frame_ns = dbg_get_wall_clock();
+        profile->last_frame_tsc = rdtsc();
+        profile->max_spikes = DBG_MAX_SPIKES;
+    }
+    return profile;
+}
+
+static u16 dbg_find_node(dbg_profile_t *profile, u16 parent, u16 block)
+{
+    for (u32 i = 0; i < profile->node_count; ++i) {
+        dbg_node_t *node = &profile->nodes[i];
+        if (node->parent == parent && node->block == block) {
+            return (u16)i;
+        }
+    }
+    if (profile->node_count == DBG_MAX_NODES) {
+        return DBG_NO_PARENT;
+    }
+
+    dbg_node_t *node = &profile->nodes[profile->node_count];
+    memset(node, 0, sizeof(*node));
+    node->block = block;
+    node->parent = parent;
+    return (u16)profile->node_count++;
+}
+
+// Starts keeping every event of the next frame_count frames. The trace is
+// written to path when the last of them ends. Returns 0 if a trace is already
+// being recorded.
+static b8 dbg_begin_trace(dbg_profile_t *profile, u32 frame_count, const char *path)
+{
+    if (!profile || profile->trace_frames_left || !frame_count) {
+        return 0;
+    }
+    profile->trace_path = path;
+    profile->trace_frames_left = frame_count;
+    profile->trace_event_count = 0;
+    profile->trace_dropped_count = 0;
+    profile->trace_start_tsc = rdtsc();
+    profile->trace_start_ns = dbg_get_wall_clock();
+    return 1;
+}
+
+static void dbg_push_trace_event(dbg_profile_t *profile, u64 tsc, u16 block, u8 type, u8 thread)
+{
+    if (profile->trace_event_count == profile->trace_capacity) {
+        u32 capacity = profile->trace_capacity ? profile->trace_capacity * 2 : (1 << 16);
+        dbg_trace_event_t *events = 0;
+        if (capacity <= DBG_MAX_TRACE_EVENTS) {
+            events = (dbg_trace_event_t *)realloc(profile->trace_events, capacity * sizeof(dbg_trace_event_t));
+        }
+        if (!events) {
+            ++profile->trace_dropped_count;
+            return;
+        }
+        profile->trace_events = events;
+        profile->trace_capacity = capacity;
+    }
+
+    dbg_trace_event_t *event = &profile->trace_events[profile->trace_event_count++];
+    event->tsc = tsc;
+    event->block = block;
+    event->type = type;
+    event->thread = thread;
+}
+
+// NOTE(Wes): Chrome trace event JSON, which chrome://tracing and Perfetto
+// both open. Timestamps are in microseconds from the start of the trace
+// using the TSC rate measured over the trace.
+static b8 dbg_write_trace(dbg_profile_t *profile)
+{
+    FILE *handle = fopen(profile->trace_path, "wb");
+    if (!handle) {
+        return 0;
+    }
+
+    u64 elapsed_ns = dbg_get_wall_clock() - profile->trace_start_ns;
+    u64 elapsed_cycles = rdtsc() - profile->trace_start_tsc;
+    f64 us_per_cycle = elapsed_cycles ? (elapsed_ns / 1000.0) / elapsed_cycles : 0.0;
+
+    fprintf(handle, "{\"traceEvents\":[\n");
+    fprintf(handle, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"gg\"}}");
+    for (i32 i = 0; i < profile->thread_count; ++i) {
+        fprintf(handle,
+                ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                i,
+                i);
+    }
+
+    // NOTE(Wes): Ends of blocks that were open when the trace started have
+    // no begin in the trace, so they are left out.
+    u32 depths[DBG_MAX_THREADS] = {0};
+    for (u32 i = 0; i < profile->trace_event_count; ++i) {
+        dbg_trace_event_t *event = &profile->trace_events[i];
+        f64 ts = (i64)(event->tsc - profile->trace_start_tsc) * us_per_cycle;
+        const char *name = profile->blocks[event->block].name;
+        switch (event->type) {
+        case dbg_event_begin:
+            ++depths[event->thread];
+            fprintf(handle, ",\n{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}", name, ts, event->thread);
+            break;
+        case dbg_event_end:
+            if (depths[event->thread]) {
+                --depths[event->thread];
+                fprintf(handle, ",\n{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}", ts, event->thread);
+            }
+            break;
+        case dbg_event_mark:
+            fprintf(handle, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}", name, ts, event->thread);
+            break;
+        case dbg_event_frame:
+            fprintf(handle, ",\n{\"name\":\"frame\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":1,\"tid\":0}", ts);
+            break;
+        }
+    }
+    fprintf(handle, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    b8 written = !ferror(handle);
+    fclose(handle);
+    return written;
+}
+
+// NOTE(Wes): Names of the blocks that time each subsystem and of the
+// subsystems in the stats file. The whole frame is the time between merges.
+static const char *dbg_subsystem_blocks[dbg_subsystem_count] = {0, "input", "game_update", "game_render", "present"};
+static const char *dbg_subsystem_names[dbg_subsystem_count] = {"frame", "input", "update", "render", "present"};
+
+// Opens the CSV file the frame time percentiles are written to.
+static b8 dbg_open_stats(dbg_profile_t *profile, const char *path)
+{
+    FILE *handle = fopen(path, "w");
+    if (!handle) {
+        return 0;
+    }
+    fprintf(handle, "frame,subsystem,count,p50_ms,p90_ms,p99_ms,max_ms\n");
+    profile->stats_file = handle;
+    return 1;
+}
+
+static void dbg_close_stats(dbg_profile_t *profile)
+{
+    if (profile && profile->stats_file) {
+        fclose((FILE *)profile->stats_file);
+        profile->stats_file = 0;
+    }
+}
+
+static u32 dbg_histogram_bucket(f32 ms)
+{
+    i32 bucket = (i32)(ms * 10.0f);
+    return bucket < 0 ? 0 : (bucket >= DBG_HISTOGRAM_BUCKETS ? DBG_HISTOGRAM_BUCKETS - 1 : bucket);
+}
+
+static void dbg_histogram_add(dbg_histogram_t *histogram, f32 ms)
+{
+    if (histogram->count == DBG_STATS_WINDOW) {
+        --histogram->buckets[dbg_histogram_bucket(histogram->samples[histogram->next_sample])];
+    } else {
+        ++histogram->count;
+    }
+    ++histogram->buckets[dbg_histogram_bucket(ms)];
+    histogram->samples[histogram->next_sample] = ms;
+    histogram->next_sample = (histogram->next_sample + 1) % DBG_STATS_WINDOW;
+}
+
+static f32 dbg_histogram_max(dbg_histogram_t *histogram)
+{
+    f32 max_ms = 0.0f;
+    for (u32 i = 0; i < histogram->count; ++i) {
+        max_ms = histogram->samples[i] > max_ms ? histogram->samples[i] : max_ms;
+    }
+    return max_ms;
+}
+
+// Returns the upper edge of the bucket holding the percentile.
+static f32 dbg_histogram_percentile(dbg_histogram_t *histogram, u32 percent, f32 max_ms)
+{
+    u32 rank = (histogram->count * percent + 99) / 100;
+    u32 seen = 0;
+    for (u32 i = 0; i < DBG_HISTOGRAM_BUCKETS; ++i) {
+        seen += histogram->buckets[i];
+        if (seen >= rank && seen) {
+            f32 ms = (i + 1) / 10.0f;
+            return ms < max_ms ? ms : max_ms;
+        }
+    }
+    return max_ms;
+}
+
+// Writes the stats of a frame that went over budget as JSON.
+static b8 dbg_write_spike(dbg_profile_t *profile, dbg_frame_t *frame, f32 *subsystem_ms, const char *path)
+{
+    FILE *handle = fopen(path, "w");
+    if (!handle) {
+        return 0;
+    }
+
+    fprintf(handle, "{\"frame\":%u,\"budget_ms\":%.3f,\"subsystems\":{", profile->frame_number, profile->budget_ms);
+    for (u32 i = 0; i < dbg_subsystem_count; ++i) {
+        fprintf(handle, "%s\"%s\":%.3f", i ? "," : "", dbg_subsystem_names[i], subsystem_ms[i]);
+    }
+    fprintf(handle, "},\n\"blocks\":[");
+    f64 ms_per_cycle = frame->cycles ? (frame->ns / 1e6) / frame->cycles : 0.0;
+    b8 first = 1;
+    for (u32 i = 0; i < profile->node_count; ++i) {
+        if (!frame->node_calls[i]) {
+            continue;
+        }
+        dbg_node_t *node = &profile->nodes[i];
+        fprintf(handle,
+                "%s\n{\"node\":%u,\"parent\":%d,\"name\":\"%s\",\"calls\":%u,\"hits\":%u,\"cycles\":%llu,\"ms\":%.3f}",
+                first ? "" : ",",
+                i,
+                node->parent == DBG_NO_PARENT ? -1 : (i32)node->parent,
+                profile->blocks[node->block].name,
+                frame->node_calls[i],
+                frame->node_hits[i],
+                (unsigned long long)frame->node_cycles[i],
+                frame->node_cycles[i] * ms_per_cycle);
+        first = 0;
+    }
+    fprintf(handle, "\n]}\n");
+
+    b8 written = !ferror(handle);
+    fclose(handle);
+    return written;
+}
+
+static void dbg_update_subsystems(dbg_profile_t *profile, dbg_frame_t *frame, u64 *block_cycles, log_fn log)
+{
+    f64 ms_per_cycle = frame->cycles ? (frame->ns / 1e6) / frame->cycles : 0.0;
+    f32 subsystem_ms[dbg_subsystem_count] = {0};
+    subsystem_ms[dbg_subsystem_frame] = (f32)(frame->ns / 1e6);
+    dbg_histogram_add(&profile->histograms[dbg_subsystem_frame], subsystem_ms[dbg_subsystem_frame]);
+    for (u32 i = 1; i < dbg_subsystem_count; ++i) {
+        if (!profile->subsystem_blocks[i]) {
+            for (u32 block = 0; block < profile->block_count; ++block) {
+                if (strcmp(profile->blocks[block].name, dbg_subsystem_blocks[i]) == 0) {
+                    profile->subsystem_blocks[i] = block + 1;
+                }
+            }
+        }
+        // NOTE(Wes): Subsystems a host does not have, eg. present when
+        // headless, are left out rather than counted as free.
+        if (profile->subsystem_blocks[i]) {
+            subsystem_ms[i] = (f32)(block_cycles[profile->subsystem_blocks[i] - 1] * ms_per_cycle);
+            dbg_histogram_add(&profile->histograms[i], subsystem_ms[i]);
+        }
+    }
+
+    FILE *handle = (FILE *)profile->stats_file;
+    if (handle && profile->frame_number % DBG_STATS_PERIOD == 0) {
+        for (u32 i = 0; i < dbg_subsystem_count; ++i) {
+            dbg_histogram_t *histogram = &profile->histograms[i];
+            if (histogram->count) {
+                f32 max_ms = dbg_histogram_max(histogram);
+                fprintf(handle,
+                        "%u,%s,%u,%.1f,%.1f,%.1f,%.3f\n",
+                        profile->frame_number,
+                        dbg_subsystem_names[i],
+                        histogram->count,
+                        dbg_histogram_percentile(histogram, 50, max_ms),
+                        dbg_histogram_percentile(histogram, 90, max_ms),
+                        dbg_histogram_percentile(histogram, 99, max_ms),
+                        max_ms);
+            }
+        }
+        fflush(handle);
+    }
+
+    b8 over_budget = profile->budget_ms > 0.0f && subsystem_ms[dbg_subsystem_frame] > profile->budget_ms;
+    b8 cooled_down = !profile->spike_count || profile->frame_number - profile->last_spike_frame >= DBG_SPIKE_COOLDOWN;
+    if (over_budget && cooled_down && profile->spike_count < profile->max_spikes) {
+        const char *dir = profile->spike_dir ? profile->spike_dir : ".";
+        char path[256];
+        snprintf(path, sizeof(path), "%s/spike_%u.json", dir, profile->frame_number);
+        if (dbg_write_spike(profile, frame, subsystem_ms, path)) {
+            log("Frame %u took %.2f ms, over the %.2f ms budget, wrote %s",
+                profile->frame_number,
+                subsystem_ms[dbg_subsystem_frame],
+                profile->budget_ms,
+                path);
+        } else {
+            log("Failed to write %s", path);
+        }
+        snprintf(profile->spike_capture_path,
+                 sizeof(profile->spike_capture_path),
+                 "%s/spike_%u.ggrq",
+                 dir,
+                 profile->frame_number);
+        profile->spike_pending = 1;
+        profile->last_spike_frame = profile->frame_number;
+        ++profile->spike_count;
+        if (profile->spike_count == profile->max_spikes) {
+            log("Wrote %u spikes, no more will be written this run", profile->spike_count);
+        }
+    }
+}
+
+// Asks the game to capture the render queue of the frame that went over
+// budget. Called after dbg_end_frame, before the next frame.
+static void dbg_request_spike_capture(dbg_profile_t *profile, game_memory_t *memory)
+{
+    if (profile && profile->spike_pending && !memory->render_capture_path) {
+        memory->render_capture_path = profile->spike_capture_path;
+        memory->render_capture_previous = 1;
+        profile->spike_pending = 0;
+    }
+}
+
+typedef struct {
+    dbg_event_t begin;
+    u16 node;
+    u64 child_cycles;
+} dbg_open_block_t;
+
+// Merges every thread's events into the call tree and resets the buffers.
+// NOTE(Wes): Must be called while no other thread is recording, ie. after
+// the frame's work has been finished. Background lane entries may still be
+// running as they do not record, see dbg_pause_recording.
+static void dbg_end_frame(dbg_profile_t *profile, log_fn log)
+{
+    if (!profile) {
+        return;
+    }
+
+    dbg_frame_t *frame = &profile->paused_frame;
+    if (!profile->history_paused) {
+        frame = &profile->history[profile->history_count % DBG_FRAME_HISTORY];
+    }
+    memset(frame, 0, sizeof(*frame));
+    u64 block_cycles[DBG_MAX_BLOCKS] = {0};
+
+    for (i32 thread_index = 0; thread_index < profile->thread_count; ++thread_index) {
+        dbg_thread_t *thread = &profile->threads[thread_index];
+        dbg_open_block_t stack[DBG_MAX_DEPTH];
+        u32 depth = 0;
+
+        if (profile->trace_frames_left) {
+            // NOTE(Wes): Carried over begins were traced with their own frame.
+            for (u32 event_index = thread->carried_count; event_index < thread->event_count; ++event_index) {
+                dbg_event_t *event = &thread->events[event_index];
+                dbg_push_trace_event(profile, event->tsc, event->block, (u8)event->type, (u8)thread_index);
+            }
+        }
+
+        for (u32 event_index = 0; event_index < thread->event_count; ++event_index) {
+            dbg_event_t *event = &thread->events[event_index];
+            if (event->type == dbg_event_mark) {
+                continue;
+            }
+            if (event->type == dbg_event_begin) {
+                if (depth == DBG_MAX_DEPTH) {
+                    continue;
+                }
+                u16 parent = depth ? stack[depth - 1].node : DBG_NO_PARENT;
+                dbg_open_block_t *open = &stack[depth++];
+                open->begin = *event;
+                open->node = dbg_find_node(profile, parent, event->block);
+                open->child_cycles = 0;
+                continue;
+            }
+
+            // NOTE(Wes): An end without a matching begin closes whatever was
+            // opened after it, otherwise it is ignored.
+            u32 match = depth;
+            while (match && stack[match - 1].begin.block != event->block) {
+                --match;
+            }
+            if (!match) {
+                continue;
+            }
+            depth = match - 1;
+
+            dbg_open_block_t *open = &stack[depth];
+            u64 cycles = event->tsc - open->begin.tsc;
+            if (open->node != DBG_NO_PARENT) {
+                dbg_node_t *node = &profile->nodes[open->node];
+                node->calls += 1;
+                node->hits += event->count;
+                node->cycles += cycles;
+                node->self_cycles += cycles > open->child_cycles ? cycles - open->child_cycles : 0;
+                node->thread_mask |= (u64)1 << thread_index;
+                frame->node_calls[open->node] += 1;
+                frame->node_hits[open->node] += event->count;
+                frame->node_cycles[open->node] += cycles;
+            }
+            block_cycles[event->block] += cycles;
+            if (depth) {
+                stack[depth - 1].child_cycles += cycles;
+            }
+        }
+
+        // NOTE(Wes): Blocks still open, eg. a frame that spans the merge,
+        // are carried over to be closed next frame. Their children so far
+        // are already counted so they are forgotten here.
+        for (u32 i = 0; i < depth; ++i) {
+            thread->events[i] = stack[i].begin;
+        }
+        thread->event_count = depth;
+        thread->carried_count = depth;
+    }
+
+    ++profile->frame_count;
+
+    u64 now_ns = dbg_get_wall_clock();
+    u64 now_tsc = rdtsc();
+    frame->ns = now_ns - profile->last_frame_ns;
+    frame->cycles = now_tsc - profile->last_frame_tsc;
+    if (!profile->history_paused) {
+        ++profile->history_count;
+    }
+    profile->last_frame_ns = now_ns;
+    profile->last_frame_tsc = now_tsc;
+    ++profile->frame_number;
+
+    dbg_update_subsystems(profile, frame, block_cycles, log);
+
+    if (profile->trace_frames_left) {
+        dbg_push_trace_event(profile, rdtsc(), 0, dbg_event_frame, 0);
+        if (--profile->trace_frames_left == 0) {
+            if (dbg_write_trace(profile)) {
+                log("Wrote trace of %u events to %s, %u dropped",
+                    profile->trace_event_count,
+                    profile->trace_path,
+                    profile->trace_dropped_count);
+            } else {
+                log("Failed to write trace %s", profile->trace_path);
+            }
+            profile->trace_event_count = 0;
+        }
+    }
+}
+
+// NOTE(Wes): The tree itself is kept as the frame history refers to its nodes.
+static void dbg_clear_stats(dbg_profile_t *profile)
+{
+    for (u32 i = 0; i < profile->node_count; ++i) {
+        dbg_node_t *node = &profile->nodes[i];
+        node->calls = 0;
+        node->hits = 0;
+        node->cycles = 0;
+        node->self_cycles = 0;
+        node->thread_mask = 0;
+    }
+    profile->frame_count = 0;
+    for (i32 i = 0; i < profile->thread_count; ++i) {
+        profile->threads[i].dropped_count = 0;
+    }
+}
+
+static u32 dbg_count_bits(u64 value)
+{
+    u32 count = 0;
+    for (; value; value &= value - 1) {
+        ++count;
+    }
+    return count;
+}
+
+static void dbg_print_node(dbg_profile_t *profile, u16 parent, u32 depth, log_fn log)
+{
+    u32 frames = profile->frame_count ? profile->frame_count : 1;
+    for (u32 i = 0; i < profile->node_count; ++i) {
+        dbg_node_t *node = &profile->nodes[i];
+        if (node->parent != parent || !node->calls) {
+            continue;
+        }
+
+        char indent[2 * DBG_MAX_DEPTH + 1];
+        u32 indent_size = gg_min(2 * depth, 2 * DBG_MAX_DEPTH);
+        memset(indent, ' ', indent_size);
+        indent[indent_size] = 0;
+        i32 name_width = indent_size < 24 ? 24 - (i32)indent_size : 0;
+
+        log("%s%-*s cy/f %10llu self %10llu calls/f %6u cy/h %8llu threads %u",
+            indent,
+            name_width,
+            profile->blocks[node->block].name,
+            (unsigned long long)(node->cycles / frames),
+            (unsigned long long)(node->self_cycles / frames),
+            node->calls / frames,
+            (unsigned long long)(node->hits ? node->cycles / node->hits : 0),
+            dbg_count_bits(node->thread_mask));
+
+        dbg_print_node(profile, (u16)i, depth + 1, log);
+    }
+}
+
+static void dbg_print_profile(dbg_profile_t *profile, log_fn log)
+{
+    if (!profile || !profile->frame_count) {
+        return;
+    }
+
+    u32 dropped_count = 0;
+    for (i32 i = 0; i < profile->thread_count; ++i) {
+        dropped_count += profile->threads[i].dropped_count;
+    }
+    log("PROFILE %u frames, %d threads, %u unregistered threads, %u dropped events",
+        profile->frame_count,
+        profile->thread_count,
+        profile->unregistered_count,
+        dropped_count);
+    dbg_print_node(profile, DBG_NO_PARENT, 1, log);
+}
+
+#endif
@@ -0,0 +1,360 @@
+#pragma once
+
+// NOTE(Wes): Timed blocks. Every thread records begin and end events into its
+// own buffer so nothing is shared while recording. The platform merges the
+// buffers into a call tree at the end of each frame with dbg_end_frame.
+// Blocks register themselves by name the first time they are hit.
+//
+//     BEGIN_BLOCK(render_image);
+//     ...
+//     END_BLOCK(render_image);
+//
+// END_BLOCK_N adds count hits instead of one, eg. pixels processed. DBG_MARK
+// records an instant event which only shows up in traces.
+
+#include <string.h>
+
+#ifdef _MSC_VER
+#define GG_THREAD_LOCAL __declspec(thread)
+#else
+#define GG_THREAD_LOCAL __thread
+#endif
+
+#define DBG_MAX_BLOCKS 256
+#define DBG_MAX_THREADS (WQ_MAX_THREADS + 1) // Every worker and the main thread.
+#define DBG_MAX_THREAD_EVENTS (1 << 16)
+#define DBG_MAX_NODES 512
+#define DBG_MAX_DEPTH 32
+#define DBG_NO_PARENT 0xFFFF
+#define DBG_MAX_TRACE_EVENTS (1 << 22)
+#define DBG_FRAME_HISTORY 128
+#define DBG_HISTOGRAM_BUCKETS 1000 // 0.1 ms each, the last one also counts anything slower.
+#define DBG_STATS_PERIOD 120 // Frames between rows of the stats file.
+#define DBG_STATS_WINDOW 600 // Frames the percentiles cover.
+#define DBG_SPIKE_COOLDOWN 60
+#define DBG_MAX_SPIKES 16 // Default cap on the spikes written per run.
+
+typedef enum {
+    dbg_event_begin,
+    dbg_event_end,
+    dbg_event_mark,
+    dbg_event_frame, // Only in traces, written by dbg_end_frame.
+} dbg_event_type_t;
+
+typedef struct {
+    u64 tsc;
+    u16 block;
+    u16 type;
+    u32 count; // Hits added by an end event.
+} dbg_event_t;
+
+typedef struct {
+    // NOTE(Wes): Names are copied as the game library can be reloaded.
+    char name[32];
+    char file[32];
+    u32 line;
+} dbg_block_t;
+
+typedef struct {
+    u64 thread_id;
+    u32 event_count;
+    u32 dropped_count;
+    u32 carried_count; // Begins at the start of events carried over from the last frame.
+    u32 paused_depth;  // Nothing is recorded while non zero, see dbg_pause_recording.
+    dbg_event_t events[DBG_MAX_THREAD_EVENTS];
+} dbg_thread_t;
+
+typedef struct {
+    u64 tsc;
+    u16 block;
+    u8 type;
+    u8 thread;
+} dbg_trace_event_t;
+
+// A block at a particular place in the call tree, summed over every thread
+// and every frame since the stats were last cleared.
+typedef struct {
+    u16 block;
+    u16 parent; // Node index or DBG_NO_PARENT.
+    u32 calls;
+    u64 hits;
+    u64 cycles;      // Including children.
+    u64 self_cycles; // Excluding children.
+    u64 thread_mask; // Bit per thread index that ran the block.
+} dbg_node_t;
+
+// Stats of a single frame, indexed like dbg_profile_t.nodes.
+typedef struct {
+    u64 ns; // Wall time since the previous frame ended.
+    u64 cycles;
+    u32 node_calls[DBG_MAX_NODES];
+    u32 node_hits[DBG_MAX_NODES];
+    u64 node_cycles[DBG_MAX_NODES];
+} dbg_frame_t;
+
+// NOTE(Wes): Parts of a frame that get their own frame time percentiles. Each
+// but the whole frame is timed by the block of the same name, see
+// dbg_subsystem_blocks.
+typedef enum {
+    dbg_subsystem_frame,
+    dbg_subsystem_input,
+    dbg_subsystem_update,
+    dbg_subsystem_render,
+    dbg_subsystem_present,
+    dbg_subsystem_count
+} dbg_subsystem_t;
+
+// NOTE(Wes): Covers the last DBG_STATS_WINDOW samples. The samples are kept
+// so the oldest can be taken back out of its bucket as a new one comes in.
+typedef struct {
+    u32 count;
+    u32 next_sample;
+    u32 buckets[DBG_HISTOGRAM_BUCKETS];
+    f32 samples[DBG_STATS_WINDOW];
+} dbg_histogram_t;
+
+typedef struct {
+    volatile i32 lock;
+    volatile i32 thread_count;
+    u32 unregistered_count; // Threads that found every buffer taken, their events are lost.
+    u32 block_count;
+    dbg_block_t blocks[DBG_MAX_BLOCKS];
+
+    u32 frame_count; // Frames merged since the stats were last cleared.
+    u32 node_count;  // Nodes are kept when the stats are cleared.
+    dbg_node_t nodes[DBG_MAX_NODES];
+
+    // NOTE(Wes): The last DBG_FRAME_HISTORY frames, frame i is stored at
+    // i % DBG_FRAME_HISTORY. The game may pause the history to inspect a
+    // frame, merging carries on regardless.
+    u32 history_count;
+    b8 history_paused;
+    u64 last_frame_ns;
+    u64 last_frame_tsc;
+    dbg_frame_t history[DBG_FRAME_HISTORY];
+    dbg_frame_t paused_frame; // Stats of the latest frame while the history is paused.
+    u32 frame_number;         // Every frame merged, never reset.
+
+    // NOTE(Wes): Every DBG_STATS_PERIOD frames the percentiles of the last
+    // DBG_STATS_WINDOW frames are written to the CSV file opened by
+    // dbg_open_stats.
+    void *stats_file;
+    u32 subsystem_blocks[dbg_subsystem_count]; // Block index + 1, found by name.
+    dbg_histogram_t histograms[dbg_subsystem_count];
+
+    // NOTE(Wes): A frame slower than the budget has its stats written and its
+    // render queue captured, see dbg_request_spike_capture. 0 disables it.
+    // The files go in spike_dir, or the working directory when it is 0, and
+    // stop after max_spikes.
+    f32 budget_ms;
+    const char *spike_dir;
+    u32 max_spikes;
+    u32 spike_count;
+    u32 last_spike_frame;
+    b8 spike_pending;
+    char spike_capture_path[256];
+
+    // NOTE(Wes): A trace keeps every event of a window of frames and is
+    // written as Chrome trace JSON once the window ends, see dbg_begin_trace.
+    const char *trace_path;
+    u32 trace_frames_left;
+    u32 trace_event_count;
+    u32 trace_capacity;
+    u32 trace_dropped_count;
+    u64 trace_start_tsc;
+    u64 trace_start_ns;
+    dbg_trace_event_t *trace_events;
+
+    dbg_thread_t threads[DBG_MAX_THREADS];
+} dbg_profile_t;
+
+#ifdef GG_INTERNAL
+
+// NOTE(Wes): Defined by every module that records blocks. Null disables recording.
+extern dbg_profile_t *dbg_global_profile;
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define dbg_atomic_cas(destination, new_value, comparand) \
+    _InterlockedCompareExchange((volatile long *)(destination), (new_value), (comparand))
+#else
+#define dbg_atomic_cas(destination, new_value, comparand) \
+    __sync_val_compare_and_swap((destination), (comparand), (new_value))
+#endif
+
+// NOTE(Wes): The thread pointer the OS keeps in fs or gs. Unlike a thread
+// local it is the same in the platform and in the game library.
+static inline u64 dbg_get_thread_id(void)
+{
+    u64 thread_id;
+#if defined(_MSC_VER)
+    thread_id = __readgsqword(0x30);
+#elif defined(__APPLE__)
+    __asm__("mov %%gs:0x0, %0" : "=r"(thread_id));
+#else
+    __asm__("mov %%fs:0x0, %0" : "=r"(thread_id));
+#endif
+    return thread_id;
+}
+
+static void dbg_lock(dbg_profile_t *profile)
+{
+    while (dbg_atomic_cas(&profile->lock, 1, 0) != 0) {
+    }
+}
+
+static void dbg_unlock(dbg_profile_t *profile)
+{
+    dbg_atomic_cas(&profile->lock, 0, 1);
+}
+
+static void dbg_copy_name(char *dest, const char *src, u32 size)
+{
+    u32 i = 0;
+    for (; i < size - 1 && src[i]; ++i) {
+        dest[i] = src[i];
+    }
+    dest[i] = 0;
+}
+
+// Returns the block's index + 1.
+static u32 dbg_register_block(dbg_profile_t *profile, const char *name, const char *file, u32 line)
+{
+    // NOTE(Wes): Blocks are matched by name so a block that is used in several
+    // places, or that is registered again after a reload, keeps its index.
+    const char *file_name = file;
+    for (const char *at = file; *at; ++at) {
+        if (*at == '/' || *at == '\\') {
+            file_name = at + 1;
+        }
+    }
+
+    dbg_lock(profile);
+    u32 index = 0;
+    for (; index < profile->block_count; ++index) {
+        if (strncmp(profile->blocks[index].name, name, sizeof(profile->blocks[index].name) - 1) == 0) {
+            break;
+        }
+    }
+    if (index == profile->block_count && index < DBG_MAX_BLOCKS) {
+        dbg_block_t *block = &profile->blocks[index];
+        dbg_copy_name(block->name, name, sizeof(block->name));
+        dbg_copy_name(block->file, file_name, sizeof(block->file));
+        block->line = line;
+        ++profile->block_count;
+    }
+    dbg_unlock(profile);
+
+    return index < DBG_MAX_BLOCKS ? index + 1 : 0;
+}
+
+static dbg_thread_t *dbg_register_thread(dbg_profile_t *profile)
+{
+    u64 thread_id = dbg_get_thread_id();
+    dbg_thread_t *result = 0;
+
+    dbg_lock(profile);
+    for (i32 i = 0; i < profile->thread_count; ++i) {
+        if (profile->threads[i].thread_id == thread_id) {
+            result = &profile->threads[i];
+            break;
+        }
+    }
+    if (!result && profile->thread_count < DBG_MAX_THREADS) {
+        result = &profile->threads[profile->thread_count];
+        result->thread_id = thread_id;
+        result->event_count = 0;
+        result->dropped_count = 0;
+        ++profile->thread_count;
+    }
+    if (!result) {
+        ++profile->unregistered_count;
+    }
+    dbg_unlock(profile);
+
+    return result;
+}
+
+static GG_THREAD_LOCAL dbg_thread_t *dbg_thread_cache;
+static GG_THREAD_LOCAL b8 dbg_thread_unregistered;
+
+static inline dbg_thread_t *dbg_get_thread(dbg_profile_t *profile)
+{
+    dbg_thread_t *thread = dbg_thread_cache;
+    if (!thread && !dbg_thread_unregistered) {
+        thread = dbg_thread_cache = dbg_register_thread(profile);
+        dbg_thread_unregistered = !thread;
+    }
+    return thread;
+}
+
+// NOTE(Wes): Work that can still be running when dbg_end_frame merges the
+// buffers, ie. background lane entries, must not record into them. The
+// pause is kept in the thread's buffer so it holds for blocks in the game
+// library as well as the platform. Pauses nest.
+static inline void dbg_pause_recording(void)
+{
+    dbg_thread_t *thread = dbg_global_profile ? dbg_get_thread(dbg_global_profile) : 0;
+    if (thread) {
+        ++thread->paused_depth;
+    }
+}
+
+static inline void dbg_resume_recording(void)
+{
+    dbg_thread_t *thread = dbg_global_profile ? dbg_get_thread(dbg_global_profile) : 0;
+    if (thread) {
+        assert(thread->paused_depth);
+        --thread->paused_depth;
+    }
+}
+
+static inline void dbg_record_event(u32 *block_id, const char *name, const char *file, u32 line, u16 type, u32 count)
+{
+    dbg_profile_t *profile = dbg_global_profile;
+    if (!profile) {
+        return;
+    }
+    if (!*block_id) {
+        *block_id = dbg_register_block(profile, name, file, line);
+    }
+    dbg_thread_t *thread = dbg_get_thread(profile);
+    if (!*block_id || !thread || thread->paused_depth) {
+        return;
+    }
+
+    if (thread->event_count == DBG_MAX_THREAD_EVENTS) {
+        ++thread->dropped_count;
+        return;
+    }
+    dbg_event_t *event = &thread->events[thread->event_count];
+    event->tsc = rdtsc();
+    event->block = (u16)(*block_id - 1);
+    event->type = type;
+    event->count = count;
+    // NOTE(Wes): The event is complete before it is counted.
+    ++thread->event_count;
+}
+
+#define BEGIN_BLOCK(name) \
+    static u32 dbg_block_##name; \
+    dbg_record_event(&dbg_block_##name, #name, __FILE__, __LINE__, dbg_event_begin, 0)
+#define END_BLOCK(name) dbg_record_event(&dbg_block_##name, #name, __FILE__, __LINE__, dbg_event_end, 1)
+#define END_BLOCK_N(name, count) \
+    dbg_record_event(&dbg_block_##name, #name, __FILE__, __LINE__, dbg_event_end, (u32)(count))
+#define DBG_MARK(name) \
+    do { \
+        static u32 dbg_mark_##name; \
+        dbg_record_event(&dbg_mark_##name, #name, __FILE__, __LINE__, dbg_event_mark, 0); \
+    } while (0)
+
+#else
+
+#define BEGIN_BLOCK(name)
+#define END_BLOCK(name)
+#define END_BLOCK_N(name, count)
+#define DBG_MARK(name)
+#define dbg_pause_recording()
+#define dbg_resume_recording()
+
+#endif
@@ -0,0 +1,232 @@
+#include "gg_entity.h"
+#include "gg_vec.h"
+
+#include <xmmintrin.h>
+
+// Pushes another block of slots, returns 0 if the arena or the handle's index
+// bits are used up.
+static b8 entity_grow(entity_pool_t *pool)
+{
+    u32 block_index = pool->capacity / GG_ENTITY_BLOCK_SIZE;
+    if (block_index >= GG_MAX_ENTITY_BLOCKS || pool->arena->index + GG_ENTITY_BLOCK_BYTES > pool->arena->size) {
+        return 0;
+    }
+
+    entity_t *block = push_array(pool->arena, GG_ENTITY_BLOCK_SIZE, entity_t);
+    for (u32 i = 0; i < GG_ENTITY_BLOCK_SIZE; ++i) {
+        block[i].exists = 0;
+        block[i].generation = 0;
+    }
+    pool->blocks[block_index] = block;
+    // NOTE(Wes): There are never more live entities than slots so a motion
+    // block is pushed with every slot block.
+    pool->motions[block_index] = push_struct(pool->arena, entity_motion_t);
+    pool->capacity += GG_ENTITY_BLOCK_SIZE;
+    return 1;
+}
+
+void entity_pool_init(entity_pool_t *pool, memory_arena_t *arena)
+{
+    pool->arena = arena;
+    pool->count = 1;
+    pool->capacity = 0;
+    pool->live_count = 0;
+    pool->first_free = 0;
+    b8 grown = entity_grow(pool);
+    assert(grown);
+}
+
+entity_t *entity_at(entity_pool_t *pool, u32 index)
+{
+    assert(index < pool->count);
+    return &pool->blocks[index / GG_ENTITY_BLOCK_SIZE][index % GG_ENTITY_BLOCK_SIZE];
+}
+
+entity_handle_t entity_handle(entity_pool_t *pool, u32 index)
+{
+    entity_t *entity = entity_at(pool, index);
+    assert(entity->exists);
+    return index | entity->generation << GG_ENTITY_INDEX_BITS;
+}
+
+entity_handle_t entity_alloc(entity_pool_t *pool)
+{
+    u32 index = pool->first_free;
+    if (index) {
+        pool->first_free = entity_at(pool, index)->next_free;
+    } else if (pool->count < pool->capacity || entity_grow(pool)) {
+        index = pool->count++;
+    } else {
+        return 0;
+    }
+
+    static const entity_t zero_entity = {0};
+    entity_t *entity = entity_at(pool, index);
+    u32 generation = entity->generation;
+    *entity = zero_entity;
+    entity->generation = generation;
+    entity->exists = 1;
+    entity->motion_index = pool->live_count++;
+
+    entity_motion_t *motion = pool->motions[entity->motion_index / GG_ENTITY_BLOCK_SIZE];
+    u32 lane = entity->motion_index % GG_ENTITY_BLOCK_SIZE;
+    motion->position_x[lane] = 0.0f;
+    motion->position_y[lane] = 0.0f;
+    motion->velocity_x[lane] = 0.0f;
+    motion->velocity_y[lane] = 0.0f;
+    motion->acceleration_x[lane] = 0.0f;
+    motion->acceleration_y[lane] = 0.0f;
+    motion->velocity_factor[lane] = 0.0f;
+    motion->move_x[lane] = 0.0f;
+    motion->move_y[lane] = 0.0f;
+    motion->slot[lane] = index;
+    return index | generation << GG_ENTITY_INDEX_BITS;
+}
+
+void entity_free(entity_pool_t *pool, entity_handle_t handle)
+{
+    entity_t *entity = entity_get(pool, handle);
+    if (!entity) {
+        return;
+    }
+
+    // NOTE(Wes): Keeps the motions of live entities packed.
+    u32 last_index = --pool->live_count;
+    if (entity->motion_index != last_index) {
+        entity_motion_t *to = pool->motions[entity->motion_index / GG_ENTITY_BLOCK_SIZE];
+        entity_motion_t *from = pool->motions[last_index / GG_ENTITY_BLOCK_SIZE];
+        u32 to_lane = entity->motion_index % GG_ENTITY_BLOCK_SIZE;
+        u32 from_lane = last_index % GG_ENTITY_BLOCK_SIZE;
+        to->position_x[to_lane] = from->position_x[from_lane];
+        to->position_y[to_lane] = from->position_y[from_lane];
+        to->velocity_x[to_lane] = from->velocity_x[from_lane];
+        to->velocity_y[to_lane] = from->velocity_y[from_lane];
+        to->acceleration_x[to_lane] = from->acceleration_x[from_lane];
+        to->acceleration_y[to_lane] = from->acceleration_y[from_lane];
+        to->velocity_factor[to_lane] = from->velocity_factor[from_lane];
+        to->move_x[to_lane] = from->move_x[from_lane];
+        to->move_y[to_lane] = from->move_y[from_lane];
+        to->slot[to_lane] = from->slot[from_lane];
+        entity_at(pool, to->slot[to_lane])->motion_index = entity->motion_index;
+    }
+
+    entity->exists = 0;
+    entity->generation = (entity->generation + 1) & GG_ENTITY_GENERATION_MASK;
+    entity->next_free = pool->first_free;
+    pool->first_free = handle & GG_ENTITY_INDEX_MASK;
+}
+
+entity_t *entity_get(entity_pool_t *pool, entity_handle_t handle)
+{
+    u32 index = handle & GG_ENTITY_INDEX_MASK;
+    if (index == 0 || index >= pool->count) {
+        return 0;
+    }
+
+    entity_t *entity = entity_at(pool, index);
+    if (!entity->exists || entity->generation != handle >> GG_ENTITY_INDEX_BITS) {
+        return 0;
+    }
+    return entity;
+}
+
+v2 entity_position(entity_pool_t *pool, entity_t *entity)
+{
+    entity_motion_t *motion = pool->motions[entity->motion_index / GG_ENTITY_BLOCK_SIZE];
+    u32 lane = entity->motion_index % GG_ENTITY_BLOCK_SIZE;
+    return V2(motion->position_x[lane], motion->position_y[lane]);
+}
+
+v2 entity_velocity(entity_pool_t *pool, entity_t *entity)
+{
+    entity_motion_t *motion = pool->motions[entity->motion_index / GG_ENTITY_BLOCK_SIZE];
+    u32 lane = entity->motion_index % GG_ENTITY_BLOCK_SIZE;
+    return V2(motion->velocity_x[lane], motion->velocity_y[lane]);
+}
+
+void entity_set_position(entity_pool_t *pool, entity_t *entity, v2 position)
+{
+    entity_motion_t *motion = pool->motions[entity->motion_index / GG_ENTITY_BLOCK_SIZE];
+    u32 lane = entity->motion_index % GG_ENTITY_BLOCK_SIZE;
+    motion->position_x[lane] = position.x;
+    motion->position_y[lane] = position.y;
+}
+
+void entity_set_velocity_factor(entity_pool_t *pool, entity_t *entity, f32 velocity_factor)
+{
+    entity_motion_t *motion = pool->motions[entity->motion_index / GG_ENTITY_BLOCK_SIZE];
+    motion->velocity_factor[entity->motion_index % GG_ENTITY_BLOCK_SIZE] = velocity_factor;
+}
+
+void entity_integrate(entity_pool_t *pool, f32 delta_time)
+{
+    __m128 dt = _mm_set1_ps(delta_time);
+    __m128 half_dt = _mm_set1_ps(0.5f * delta_time);
+    __m128 half_dt_sq = _mm_set1_ps(0.5f * delta_time * delta_time);
+
+    for (u32 block_start = 0; block_start < pool->live_count; block_start += GG_ENTITY_BLOCK_SIZE) {
+        entity_motion_t *motion = pool->motions[block_start / GG_ENTITY_BLOCK_SIZE];
+        u32 count = pool->live_count - block_start;
+        count = count < GG_ENTITY_BLOCK_SIZE ? count : GG_ENTITY_BLOCK_SIZE;
+
+        // NOTE(Wes): Rounds up to whole groups of 4. The lanes past the last
+        // live motion are stale or zero and nothing reads what is written
+        // there.
+        for (u32 i = 0; i < count; i += 4) {
+            __m128 velocity_x = _mm_loadu_ps(motion->velocity_x + i);
+            __m128 velocity_y = _mm_loadu_ps(motion->velocity_y + i);
+            __m128 acceleration_x = _mm_loadu_ps(motion->acceleration_x + i);
+            __m128 acceleration_y = _mm_loadu_ps(motion->acceleration_y + i);
+            __m128 velocity_factor = _mm_loadu_ps(motion->velocity_factor + i);
+
+            __m128 new_acceleration_x = _mm_mul_ps(velocity_x, velocity_factor);
+            __m128 new_acceleration_y = _mm_mul_ps(velocity_y, velocity_factor);
+
+            _mm_storeu_ps(motion->move_x + i,
+                          _mm_add_ps(_mm_mul_ps(velocity_x, dt), _mm_mul_ps(acceleration_x, half_dt_sq)));
+            _mm_storeu_ps(motion->move_y + i,
+                          _mm_add_ps(_mm_mul_ps(velocity_y, dt), _mm_mul_ps(acceleration_y, half_dt_sq)));
+            _mm_storeu_ps(motion->velocity_x + i,
+                          _mm_add_ps(velocity_x, _mm_mul_ps(_mm_add_ps(acceleration_x, new_acceleration_x), half_dt)));
+            _mm_storeu_ps(motion->velocity_y + i,
+                          _mm_add_ps(velocity_y, _mm_mul_ps(_mm_add_ps(acceleration_y, new_acceleration_y), half_dt)));
+            _mm_storeu_ps(motion->acceleration_x + i, new_acceleration_x);
+            _mm_storeu_ps(motion->acceleration_y + i, new_acceleration_y);
+        }
+    }
+}
+
+void entity_integrate_reference(entity_pool_t *pool, f32 delta_time)
+{
+    for (u32 i = 0; i < pool->live_count; ++i) {
+        entity_motion_t *motion = pool->motions[i / GG_ENTITY_BLOCK_SIZE];
+        u32 lane = i % GG_ENTITY_BLOCK_SIZE;
+        v2 velocity = V2(motion->velocity_x[lane], motion->velocity_y[lane]);
+        v2 acceleration = V2(motion->acceleration_x[lane], motion->acceleration_y[lane]);
+        v2 new_acceleration = v2_mul(velocity, motion->velocity_factor[lane]);
+
+        v2 average_acceleration = v2_div(v2_add(acceleration, new_acceleration), 2);
+        v2 move = v2_mul(v2_mul(acceleration, 0.5f), delta_time * delta_time);
+        move = v2_add(v2_mul(velocity, delta_time), move);
+        velocity = v2_add(v2_mul(average_acceleration, delta_time), velocity);
+
+        motion->move_x[lane] = move.x;
+        motion->move_y[lane] = move.y;
+        motion->velocity_x[lane] = velocity.x;
+        motion->velocity_y[lane] = velocity.y;
+        motion->acceleration_x[lane] = new_acceleration.x;
+        motion->acceleration_y[lane] = new_acceleration.y;
+    }
+}
+
+void entity_add_acceleration(entity_pool_t *pool, entity_t *entity, v2 acceleration, f32 delta_time)
+{
+    // NOTE(Wes): The move only depends on the old acceleration, so only the
+    // half of the new one that goes into velocity changes.
+    entity_motion_t *motion = pool->motions[entity->motion_index / GG_ENTITY_BLOCK_SIZE];
+    u32 lane = entity->motion_index % GG_ENTITY_BLOCK_SIZE;
+    motion->velocity_x[lane] += acceleration.x * 0.5f * delta_time;
+    motion->velocity_y[lane] += acceleration.y * 0.5f * delta_time;
+    motion->acceleration_x[lane] += acceleration.x;
+    motion->acceleration_y[lane] += acceleration.y;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "gg_types.h"
+
+// NOTE(Wes): Arena space taken by each block of GG_ENTITY_BLOCK_SIZE slots.
+#define GG_ENTITY_BLOCK_BYTES (GG_ENTITY_BLOCK_SIZE * sizeof(entity_t) + sizeof(entity_motion_t))
+
+// Starts the pool with a single block taken from the arena. Later blocks are
+// taken from the same arena, which must outlive the pool.
+void entity_pool_init(entity_pool_t *pool, memory_arena_t *arena);
+
+// Returns a handle to a new zeroed entity that exists, 0 when the pool cannot
+// grow any further.
+entity_handle_t entity_alloc(entity_pool_t *pool);
+
+// Frees the entity. Freeing a stale handle does nothing.
+void entity_free(entity_pool_t *pool, entity_handle_t handle);
+
+// Returns the entity the handle refers to, 0 if it has been freed since.
+entity_t *entity_get(entity_pool_t *pool, entity_handle_t handle);
+
+// Returns the slot at index, which is below pool->count, whether it exists or
+// not. Used to walk every slot.
+entity_t *entity_at(entity_pool_t *pool, u32 index);
+
+// Returns the handle of the existing entity at index.
+entity_handle_t entity_handle(entity_pool_t *pool, u32 index);
+
+v2 entity_position(entity_pool_t *pool, entity_t *entity);
+v2 entity_velocity(entity_pool_t *pool, entity_t *entity);
+void entity_set_position(entity_pool_t *pool, entity_t *entity, v2 position);
+
+// Drag, multiplied by the velocity to get the acceleration it causes.
+void entity_set_velocity_factor(entity_pool_t *pool, entity_t *entity, f32 velocity_factor);
+
+// Velocity verlet step of every live entity with drag as the only force.
+// Velocity and acceleration are updated, the position change is left in
+// move_x and move_y for the caller to apply once it has checked collisions.
+void entity_integrate(entity_pool_t *pool, f32 delta_time);
+
+// One entity at a time, to check entity_integrate against.
+void entity_integrate_reference(entity_pool_t *pool, f32 delta_time);
+
+// Adds a force other than drag to the step entity_integrate just took, the
+// same as if it had been part of the new acceleration.
+void entity_add_acceleration(entity_pool_t *pool, entity_t *entity, v2 acceleration, f32 delta_time);
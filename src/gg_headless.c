@@ -0,0 +1,435 @@
+// NOTE(Wes): Headless host. Loads the game library and runs it into an in
+// memory frame buffer without a window, audio or SDL so the game can be run on
+// build and perf machines. Input is either synthesized or replayed from a
+// recording saved by the SDL host.
+
+#include "gg_platform.h"
+
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define Kilobytes(Value) ((Value)*1024LL)
+#define Megabytes(Value) (Kilobytes(Value) * 1024LL)
+#define Gigabytes(Value) (Megabytes(Value) * 1024LL)
+#define Terabytes(Value) (Gigabytes(Value) * 1024LL)
+
+#include "gg_platform_linux.c"
+#include "gg_work_queue.c"
+#include "gg_debug.c"
+
+typedef void (*game_update_and_render_fn_t)(game_memory_t *,
+                                            game_frame_buffer_t *,
+                                            game_audio_t *,
+                                            game_input_t *,
+                                            game_output_t *,
+                                            game_callbacks_t *,
+                                            game_work_queues_t *);
+
+typedef struct {
+    const char *game_lib;
+    const char *input_path;
+    const char *dump_path;
+    const char *capture_path;
+    u32 capture_frame;
+    const char *trace_path;
+    u32 trace_frame;
+    u32 trace_frame_count;
+    const char *stats_path;
+    f32 budget_ms;
+    const char *spike_dir;
+    u32 max_spikes; // Overrides DBG_MAX_SPIKES when max_spikes_set.
+    b8 max_spikes_set;
+    u32 frame_count;
+    u32 width;
+    u32 height;
+    b8 uncapped;
+    b8 overdraw;
+    b8 profiler;
+    const char *config_path;
+    i32 worker_count; // Overrides the config when worker_count_set.
+    b8 worker_count_set;
+    b8 pin_threads;
+    b8 pipelined;
+} headless_options_t;
+
+static loaded_file_t load_file(const char *path)
+{
+    loaded_file_t file = { 0 };
+    FILE *handle = fopen(path, "rb");
+    if (!handle) {
+        fprintf(stderr, "Failed to open file %s\n", path);
+        return file;
+    }
+
+    fseek(handle, 0, SEEK_END);
+    file.size = (u64)ftell(handle);
+    fseek(handle, 0, SEEK_SET);
+    file.contents = malloc((size_t)file.size);
+    if (file.contents && fread(file.contents, 1, (size_t)file.size, handle) == file.size) {
+        file.success = 1;
+    }
+    fclose(handle);
+
+    return file;
+}
+
+static void unload_file(loaded_file_t *loaded_file)
+{
+    assert(loaded_file);
+    free(loaded_file->contents);
+}
+
+static b8 write_file(const char *path, void *contents, u64 size)
+{
+    FILE *handle = fopen(path, "wb");
+    if (!handle) {
+        fprintf(stderr, "Failed to open file %s for writing\n", path);
+        return 0;
+    }
+
+    b8 written = fwrite(contents, 1, (size_t)size, handle) == size;
+    fclose(handle);
+    return written;
+}
+
+static void gg_log(const char *format, ...)
+{
+    assert(format);
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+}
+
+static void update_button(game_button_state_t *old_state, game_button_state_t *new_state, b8 down)
+{
+    new_state->ended_down = down;
+    new_state->half_transition_count = (old_state->ended_down == down) ? 0 : 1;
+}
+
+// Presses start to spawn a player, then walks back and forth jumping every
+// so often so the camera, animation and collision code all get exercised.
+static void synthesize_input(u32 frame, game_input_t *old_input, game_input_t *new_input, b8 overdraw, b8 profiler)
+{
+    game_controller_input_t *old_controller = &old_input->controllers[0];
+    game_controller_input_t *new_controller = &new_input->controllers[0];
+    new_controller->is_connected = 1;
+    new_controller->is_analog = 0;
+
+    u32 walk_frame = frame % 240;
+    update_button(&old_controller->start, &new_controller->start, frame == 1);
+    update_button(&old_controller->move_right, &new_controller->move_right, frame > 1 && walk_frame < 120);
+    update_button(&old_controller->move_left, &new_controller->move_left, frame > 1 && walk_frame >= 120);
+    update_button(&old_controller->action_down, &new_controller->action_down, frame > 1 && (frame % 90) < 5);
+
+#ifdef GG_EDITOR
+    // NOTE(Wes): Enter the editor and turn on the overdraw view and or the profiler overlay.
+    update_button(&old_controller->editor_mode, &new_controller->editor_mode, overdraw && frame == 1);
+    update_button(&old_controller->editor_overdraw, &new_controller->editor_overdraw, overdraw && frame == 2);
+    update_button(&old_controller->editor_profiler, &new_controller->editor_profiler, profiler && frame == 2);
+#endif
+}
+
+static game_input_t *load_input_recording(const char *path, u32 *event_count)
+{
+    loaded_file_t file = load_file(path);
+    if (!file.success || file.size < sizeof(game_input_recording_header_t)) {
+        return 0;
+    }
+
+    game_input_recording_header_t *header = (game_input_recording_header_t *)file.contents;
+    if (header->magic != GG_INPUT_RECORDING_MAGIC || header->input_size != sizeof(game_input_t) ||
+        header->event_count == 0 ||
+        file.size < sizeof(*header) + (u64)header->event_count * sizeof(game_input_t)) {
+        fprintf(stderr, "%s is not a compatible input recording\n", path);
+        unload_file(&file);
+        return 0;
+    }
+
+    *event_count = header->event_count;
+    return (game_input_t *)(header + 1);
+}
+
+// Writes the frame buffer as a binary PPM.
+static b8 write_frame_buffer(const char *path, game_frame_buffer_t *frame_buffer)
+{
+    FILE *handle = fopen(path, "wb");
+    if (!handle) {
+        return 0;
+    }
+
+    fprintf(handle, "P6\n%u %u\n255\n", frame_buffer->w, frame_buffer->h);
+    u8 *row_rgb = (u8 *)malloc(frame_buffer->w * 3);
+    for (u32 y = 0; y < frame_buffer->h; ++y) {
+        u32 *row = (u32 *)(frame_buffer->data + y * frame_buffer->pitch);
+        for (u32 x = 0; x < frame_buffer->w; ++x) {
+            row_rgb[x * 3 + 0] = (u8)(row[x] >> 16);
+            row_rgb[x * 3 + 1] = (u8)(row[x] >> 8);
+            row_rgb[x * 3 + 2] = (u8)(row[x]);
+        }
+        fwrite(row_rgb, 1, frame_buffer->w * 3, handle);
+    }
+    free(row_rgb);
+    fclose(handle);
+
+    return 1;
+}
+
+static void print_usage(void)
+{
+    printf("usage: gg_headless [-game <lib>] [-frames <n>] [-size <w> <h>] [-input <recording>]\n"
+           "                   [-dump <out.ppm>] [-capture <frame> <out.ggrq>]\n"
+           "                   [-trace <first frame> <frame count> <out.json>] [-stats <out.csv>] [-budget <ms>]\n"
+           "                   [-spike-dir <dir>] [-max-spikes <n>]\n"
+           "                   [-uncapped] [-overdraw] [-profiler] [-pipelined]\n"
+           "                   [-config <file>] [-workers <n>] [-pin]\n");
+}
+
+static b8 parse_options(i32 argc, char *argv[], headless_options_t *options)
+{
+    options->game_lib = "build/" GAME_LIB_NAME;
+    options->frame_count = 600;
+    options->width = GG_MAX_FRAME_WIDTH;
+    options->height = GG_MAX_FRAME_HEIGHT;
+    options->config_path = WQ_CONFIG_PATH;
+
+    for (i32 i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-game") == 0 && i + 1 < argc) {
+            options->game_lib = argv[++i];
+        } else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            options->frame_count = (u32)strtoul(argv[++i], 0, 10);
+        } else if (strcmp(argv[i], "-size") == 0 && i + 2 < argc) {
+            options->width = (u32)strtoul(argv[++i], 0, 10);
+            options->height = (u32)strtoul(argv[++i], 0, 10);
+        } else if (strcmp(argv[i], "-input") == 0 && i + 1 < argc) {
+            options->input_path = argv[++i];
+        } else if (strcmp(argv[i], "-dump") == 0 && i + 1 < argc) {
+            options->dump_path = argv[++i];
+        } else if (strcmp(argv[i], "-capture") == 0 && i + 2 < argc) {
+            options->capture_frame = (u32)strtoul(argv[++i], 0, 10);
+            options->capture_path = argv[++i];
+        } else if (strcmp(argv[i], "-trace") == 0 && i + 3 < argc) {
+            options->trace_frame = (u32)strtoul(argv[++i], 0, 10);
+            options->trace_frame_count = (u32)strtoul(argv[++i], 0, 10);
+            options->trace_path = argv[++i];
+        } else if (strcmp(argv[i], "-stats") == 0 && i + 1 < argc) {
+            options->stats_path = argv[++i];
+        } else if (strcmp(argv[i], "-budget") == 0 && i + 1 < argc) {
+            options->budget_ms = strtof(argv[++i], 0);
+        } else if (strcmp(argv[i], "-spike-dir") == 0 && i + 1 < argc) {
+            options->spike_dir = argv[++i];
+        } else if (strcmp(argv[i], "-max-spikes") == 0 && i + 1 < argc) {
+            options->max_spikes = (u32)strtoul(argv[++i], 0, 10);
+            options->max_spikes_set = 1;
+        } else if (strcmp(argv[i], "-overdraw") == 0) {
+            options->overdraw = 1;
+        } else if (strcmp(argv[i], "-profiler") == 0) {
+            options->profiler = 1;
+        } else if (strcmp(argv[i], "-pipelined") == 0) {
+            options->pipelined = 1;
+        } else if (strcmp(argv[i], "-uncapped") == 0) {
+            options->uncapped = 1;
+        } else if (strcmp(argv[i], "-config") == 0 && i + 1 < argc) {
+            options->config_path = argv[++i];
+        } else if (strcmp(argv[i], "-workers") == 0 && i + 1 < argc) {
+            options->worker_count = (i32)strtol(argv[++i], 0, 10);
+            options->worker_count_set = 1;
+        } else if (strcmp(argv[i], "-pin") == 0) {
+            options->pin_threads = 1;
+        } else {
+            return 0;
+        }
+    }
+
+    // NOTE(Wes): The rasterizer works on 4 pixels at a time.
+    return options->width && options->height && (options->width & 3) == 0 &&
+           options->width <= GG_MAX_FRAME_WIDTH && options->height <= GG_MAX_FRAME_HEIGHT;
+}
+
+int main(int argc, char *argv[])
+{
+    headless_options_t options = {0};
+    if (!parse_options(argc, argv, &options)) {
+        print_usage();
+        return 1;
+    }
+
+    void *game_lib = dlopen(options.game_lib, RTLD_NOW);
+    if (!game_lib) {
+        fprintf(stderr, "Failed to load %s: %s\n", options.game_lib, dlerror());
+        return 1;
+    }
+    game_update_and_render_fn_t update_and_render_fn =
+        (game_update_and_render_fn_t)dlsym(game_lib, "game_update_and_render");
+    if (!update_and_render_fn) {
+        fprintf(stderr, "%s does not export game_update_and_render\n", options.game_lib);
+        return 1;
+    }
+
+    game_input_t *recorded_input = 0;
+    u32 recorded_input_count = 0;
+    if (options.input_path) {
+        recorded_input = load_input_recording(options.input_path, &recorded_input_count);
+        if (!recorded_input) {
+            return 1;
+        }
+    }
+
+    wq_config_t wq_config;
+    wqDefaultConfig(&wq_config);
+    wqLoadConfig(&wq_config, options.config_path);
+    if (options.worker_count_set) {
+        wq_config.worker_count = options.worker_count;
+    }
+    if (options.pin_threads) {
+        wq_config.pin_threads = 1;
+    }
+    cpu_topology_t topology;
+    get_cpu_topology(&topology);
+
+    static wq_t render_work_queue;
+    wqCreate(&render_work_queue);
+    static thread_info_t thread_infos[WQ_MAX_THREADS];
+    u32 worker_count = wqStartPool(&render_work_queue, thread_infos, &wq_config, &topology);
+
+    game_work_queues_t game_work_queues;
+    game_work_queues.render_work_queue = &render_work_queue;
+    game_work_queues.add_work = wqEnqueue;
+    game_work_queues.finish_work = wqFinishWork;
+    game_work_queues.add_jobs = wqAddJobs;
+    game_work_queues.wait_counter = wqWaitCounter;
+    game_work_queues.parallel_for = wqParallelFor;
+
+    game_memory_t game_memory = allocate_game_memory((void *)Terabytes(2));
+    if (!game_memory.permanent_store) {
+        fprintf(stderr, "Failed to allocate game memory\n");
+        return 1;
+    }
+    game_memory.pipelined = options.pipelined;
+#ifdef GG_INTERNAL
+    game_memory.profile = dbg_alloc_profile();
+    dbg_global_profile = game_memory.profile;
+    game_memory.profile->budget_ms = options.budget_ms;
+    game_memory.profile->spike_dir = options.spike_dir;
+    if (options.max_spikes_set) {
+        game_memory.profile->max_spikes = options.max_spikes;
+    }
+    if (options.stats_path && !dbg_open_stats(game_memory.profile, options.stats_path)) {
+        fprintf(stderr, "Failed to open %s for writing\n", options.stats_path);
+    }
+#endif
+
+    // Ensure our frame buffer is on a 16 byte boundary so we can use it with SSE intructions.
+    game_frame_buffer_t frame_buffer = {0};
+    frame_buffer.w = options.width;
+    frame_buffer.h = options.height;
+    frame_buffer.pitch = options.width * GG_BYTES_PP;
+    frame_buffer.data = (u8 *)aligned_alloc(16, frame_buffer.pitch * frame_buffer.h);
+
+    game_callbacks_t callbacks = {0};
+    callbacks.load_file = &load_file;
+    callbacks.unload_file = &unload_file;
+    callbacks.log = &gg_log;
+    callbacks.write_file = &write_file;
+
+    static game_audio_t audio;
+    audio.samples_per_second = 48000;
+    audio.sample_count = (audio.samples_per_second / 60) * 2;
+    game_output_t output = {0};
+    game_input_t input[2] = {0};
+    game_input_t *new_input = &input[0];
+    game_input_t *old_input = &input[1];
+
+    // NOTE(Wes): Simulated time always advances by a fixed step so runs are
+    // repeatable whether or not they are capped.
+    f32 frame_sec = 1.0f / GG_TARGET_FPS;
+    u64 frame_ns = 1000000000ull / GG_TARGET_FPS;
+    u64 min_ns = (u64)-1;
+    u64 max_ns = 0;
+    u64 total_ns = 0;
+    u64 run_start = get_wall_clock();
+    u64 run_cpu_start = get_process_cpu_time();
+    u64 next_frame = run_start;
+
+    for (u32 frame = 0; frame < options.frame_count; ++frame) {
+        if (recorded_input) {
+            *new_input = recorded_input[frame % recorded_input_count];
+        } else {
+            synthesize_input(frame, old_input, new_input, options.overdraw, options.profiler);
+        }
+        new_input->delta_time = frame_sec;
+#ifdef GG_INTERNAL
+        if (options.capture_path && frame == options.capture_frame) {
+            game_memory.render_capture_path = options.capture_path;
+        }
+        if (options.trace_path && frame == options.trace_frame) {
+            dbg_begin_trace(game_memory.profile, options.trace_frame_count, options.trace_path);
+        }
+#endif
+
+        u64 start = get_wall_clock();
+        update_and_render_fn(&game_memory, &frame_buffer, &audio, new_input,
+                             &output, &callbacks, &game_work_queues);
+        u64 elapsed = get_wall_clock() - start;
+#ifdef GG_INTERNAL
+        dbg_end_frame(game_memory.profile, &gg_log);
+        dbg_request_spike_capture(game_memory.profile, &game_memory);
+#endif
+
+        total_ns += elapsed;
+        min_ns = elapsed < min_ns ? elapsed : min_ns;
+        max_ns = elapsed > max_ns ? elapsed : max_ns;
+
+        game_input_t *temp = new_input;
+        new_input = old_input;
+        old_input = temp;
+
+        if (!options.uncapped) {
+            next_frame += frame_ns;
+            struct timespec wake = {(time_t)(next_frame / 1000000000ull), (long)(next_frame % 1000000000ull)};
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, 0);
+        }
+    }
+
+    f64 run_sec = (get_wall_clock() - run_start) / 1e9;
+    f64 cpu_sec = (get_process_cpu_time() - run_cpu_start) / 1e9;
+    if (options.frame_count) {
+        printf("cores %u physical, %u logical, %u workers%s\n",
+               topology.physical_count,
+               topology.logical_count,
+               worker_count,
+               wq_config.pin_threads ? ", pinned" : "");
+        printf("frames %u, %ux%u, %s%s\n",
+               options.frame_count,
+               options.width,
+               options.height,
+               options.uncapped ? "uncapped" : "capped",
+               options.pipelined ? ", pipelined" : "");
+        printf("frame ms avg %.03f min %.03f max %.03f\n",
+               total_ns / 1e6 / options.frame_count,
+               min_ns / 1e6,
+               max_ns / 1e6);
+        printf("wall %.03f s, %.01f fps\n", run_sec, options.frame_count / run_sec);
+        // NOTE(Wes): Summed over every thread, idle workers should add nothing.
+        printf("cpu %.03f s, %.01f%% of a core\n", cpu_sec, 100.0 * cpu_sec / run_sec);
+        printf("scratch high water %u of %u KB per thread\n",
+               wqScratchHighWater(&render_work_queue) / 1024,
+               WQ_SCRATCH_SIZE / 1024);
+    }
+
+#ifdef GG_INTERNAL
+    dbg_print_profile(game_memory.profile, &gg_log);
+    dbg_close_stats(game_memory.profile);
+#endif
+
+    if (options.dump_path && !write_frame_buffer(options.dump_path, &frame_buffer)) {
+        fprintf(stderr, "Failed to write %s\n", options.dump_path);
+        return 1;
+    }
+
+    return 0;
+}
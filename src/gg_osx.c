@@ -6,6 +6,8 @@
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <mach-o/dyld.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -15,13 +17,17 @@
 #include <unistd.h>
 #include <xmmintrin.h>
 #include <stdlib.h>
-#include <stdatomic.h>
+
+#include "gg_debug.c"
 
 #define Kilobytes(Value) ((Value)*1024LL)
 #define Megabytes(Value) (Kilobytes(Value) * 1024LL)
 #define Gigabytes(Value) (Megabytes(Value) * 1024LL)
 #define Terabytes(Value) (Gigabytes(Value) * 1024LL)
 
+#include "gg_platform_osx.c"
+#include "gg_work_queue.c"
+
 SDL_GameController *controller_handles[GG_MAX_CONTROLLERS];
 SDL_Haptic *haptic_handles[GG_MAX_CONTROLLERS];
 
@@ -230,6 +236,21 @@ static void osx_handle_keyup(SDL_Keycode key, game_controller_input_t *old_input
     case SDLK_e:
         osx_process_keyup(&(old_input->editor_mode), &(new_input->editor_mode));
         break;
+    case SDLK_o:
+        osx_process_keyup(&(old_input->editor_overdraw), &(new_input->editor_overdraw));
+        break;
+    case SDLK_i:
+        osx_process_keyup(&(old_input->editor_profiler), &(new_input->editor_profiler));
+        break;
+    case SDLK_COMMA:
+        osx_process_keyup(&(old_input->editor_profiler_prev), &(new_input->editor_profiler_prev));
+        break;
+    case SDLK_PERIOD:
+        osx_process_keyup(&(old_input->editor_profiler_next), &(new_input->editor_profiler_next));
+        break;
+    case SDLK_SLASH:
+        osx_process_keyup(&(old_input->editor_profiler_slowest), &(new_input->editor_profiler_slowest));
+        break;
 #endif
     }
 }
@@ -263,6 +284,21 @@ static void osx_handle_keydown(SDL_Keycode key, game_controller_input_t *old_inp
     case SDLK_e:
         osx_process_keydown(&(old_input->editor_mode), &(new_input->editor_mode));
         break;
+    case SDLK_o:
+        osx_process_keydown(&(old_input->editor_overdraw), &(new_input->editor_overdraw));
+        break;
+    case SDLK_i:
+        osx_process_keydown(&(old_input->editor_profiler), &(new_input->editor_profiler));
+        break;
+    case SDLK_COMMA:
+        osx_process_keydown(&(old_input->editor_profiler_prev), &(new_input->editor_profiler_prev));
+        break;
+    case SDLK_PERIOD:
+        osx_process_keydown(&(old_input->editor_profiler_next), &(new_input->editor_profiler_next));
+        break;
+    case SDLK_SLASH:
+        osx_process_keydown(&(old_input->editor_profiler_slowest), &(new_input->editor_profiler_slowest));
+        break;
 #endif
     }
 }
@@ -321,145 +357,28 @@ static void osx_unload_file(loaded_file_t *loaded_file)
     munmap(loaded_file->contents, loaded_file->size);
 }
 
-static void osx_handle_debug_counters(game_memory_t *memory, b8 must_print)
-{
-#ifdef GG_INTERNAL
-    if (must_print) {
-        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "DEBUG COUNTERS");
-    }
-    for (u32 i = 0; i < ARRAY_LEN(memory->counters); ++i) {
-        dbg_counter_t *counter = &memory->counters[i];
-        if (must_print) {
-            if (counter->hits != 0) {
-                SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "\tcy %"PRIu64", h %u, cy/h %"PRIu64, 
-                            counter->cycles,
-                            counter->hits,
-                            counter->cycles / counter->hits);
-            }
-        }
-        if (counter->hits)
-        {
-            counter->cycles = 0;
-            counter->hits = 0;
-        }
-    }
-#endif
-}
-
-// Queue stuff ===============================
-
-typedef struct {
-    wq_fn work_fn;
-    void *data;
-} wq_entry_t;
-
-#define WQ_SIZE 1024
-typedef struct wq_t {
-    // Try keep start and end off the same cache line
-    // as they will be owned by different threads.
-    atomic_i32 start;
-    wq_entry_t entries[WQ_SIZE];
-    atomic_i32 end;
-    atomic_i32 remaining_work_count;
-    SDL_sem *semaphore;
-} wq_t;
-
-void wqCreate(wq_t *wq, SDL_sem *semaphore)
-{
-    wq->start = 0;
-    wq->end = 0;
-    wq->remaining_work_count = 0;
-    wq->semaphore = semaphore;
-}
-
-b8 wqIsEmpty(wq_t *wq)
-{
-    return wq->start == wq->end;
-}
-
-b8 wqIsFull(wq_t *wq)
+static void osx_log(const char *format, ...)
 {
-    i32 next_end = (wq->end + 1) % WQ_SIZE;
-    return next_end == wq->start;
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "%s", buffer);
 }
 
-b8 wqEnqueue(wq_t *wq, wq_fn work_fn, void *data)
+static void osx_handle_debug_profile(game_memory_t *memory, b8 must_print)
 {
-    i32 start = wq->start;
-    i32 end = wq->end;
-    i32 next_end = (end + 1) % WQ_SIZE;
-    if (start == next_end) {
-        // Queue is full.
-        return 0;
-    }
-
-    wq_entry_t *entry = wq->entries + end;
-    entry->work_fn = work_fn;
-    entry->data = data;
-    atomic_fetch_add(&wq->remaining_work_count, 1);
-    wq->end = next_end;
-
-    SDL_SemPost(wq->semaphore);
-    return 1;
-}
-
-b8 wqDequeue(wq_t *wq, wq_entry_t *entry)
-{
-    while (!wqIsEmpty(wq)) {
-        i32 start = wq->start;
-        i32 next_start = (start + 1) % WQ_SIZE;
-        if (atomic_compare_exchange_weak(&wq->start, &start, next_start)) {
-            wq_entry_t *wq_entry = wq->entries + start;
-            entry->work_fn = wq_entry->work_fn;
-            entry->data = wq_entry->data;
-            return 1;
-        }
-    }
-
-    return 0;
-}
-
-void wqFinishWork(wq_t *wq)
-{
-    wq_entry_t entry;
-    while (wq->remaining_work_count > 0) {
-        if (wqDequeue(wq, &entry)) {
-            entry.work_fn(entry.data);
-            atomic_fetch_sub(&wq->remaining_work_count, 1);
-        }
+#ifdef GG_INTERNAL
+    dbg_end_frame(memory->profile, &osx_log);
+    dbg_request_spike_capture(memory->profile, memory);
+    if (must_print) {
+        dbg_print_profile(memory->profile, &osx_log);
+        dbg_clear_stats(memory->profile);
     }
+#endif
 }
 
-// ===========================================
-
-// Thread stuff
-// ===========================================
-typedef struct {
-    u32 index;
-    wq_t *work_queue;
-} thread_info_t;
-
-int thread_fn(void *data)
-{
-    thread_info_t *thread_info = (thread_info_t *)data;
-    wq_t *work_queue = thread_info->work_queue;
-
-    wq_entry_t entry;
-    for (;;) {
-       if (wqDequeue(work_queue, &entry)) {
-           entry.work_fn(entry.data);
-           atomic_fetch_sub(&work_queue->remaining_work_count, 1);
-       }
-       else
-       {
-           SDL_SemWait(work_queue->semaphore);
-       }
-    }
-    return 1;
-}
-// TODO Read the core count to set the thread count.
-#define WORKER_THREAD_COUNT 8
-// ===========================================
 
 int main(void)
 {
@@ -467,23 +386,27 @@ int main(void)
         // TODO(Wes): SDL_Init didn't work!
     }
 
-    SDL_sem *semaphore = SDL_CreateSemaphore(0);
-    wq_t render_work_queue;
-    wqCreate(&render_work_queue, semaphore);
-    thread_info_t thread_infos[WORKER_THREAD_COUNT];
-
-    SDL_Thread* threads[WORKER_THREAD_COUNT];
-    for (u32 i = 0; i < WORKER_THREAD_COUNT; i++) {
-        thread_info_t *thread_info = thread_infos + i;
-        thread_info->index = i;
-        thread_info->work_queue = &render_work_queue;
-        threads[i] = SDL_CreateThread(thread_fn, "gg_worker", (void *)thread_info);
-    }
+    // NOTE(Wes): No command line here, only the config file.
+    wq_config_t wq_config;
+    wqDefaultConfig(&wq_config);
+    wqLoadConfig(&wq_config, WQ_CONFIG_PATH);
+    cpu_topology_t topology;
+    get_cpu_topology(&topology);
+
+    static wq_t render_work_queue;
+    wqCreate(&render_work_queue);
+    static thread_info_t thread_infos[WQ_MAX_THREADS];
+    u32 worker_count = wqStartPool(&render_work_queue, thread_infos, &wq_config, &topology);
+    osx_log("Cores %u physical, %u logical, %u workers",
+            topology.physical_count, topology.logical_count, worker_count);
 
     game_work_queues_t game_work_queues;
     game_work_queues.render_work_queue = &render_work_queue;
     game_work_queues.add_work = wqEnqueue;
     game_work_queues.finish_work = wqFinishWork;
+    game_work_queues.add_jobs = wqAddJobs;
+    game_work_queues.wait_counter = wqWaitCounter;
+    game_work_queues.parallel_for = wqParallelFor;
 
     i32 window_width = 960;
     i32 window_height = 540;
@@ -498,8 +421,8 @@ int main(void)
 #else
     u32 render_flags = SDL_RENDERER_ACCELERATED;
 #endif
-    u32 frame_buffer_width = 1920;
-    u32 frame_buffer_height = 1080;
+    u32 frame_buffer_width = GG_MAX_FRAME_WIDTH;
+    u32 frame_buffer_height = GG_MAX_FRAME_HEIGHT;
     SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, render_flags);
     SDL_RenderSetLogicalSize(renderer, frame_buffer_width, frame_buffer_height);
 
@@ -526,6 +449,10 @@ int main(void)
     }*/
 
     game_memory_t game_memory = osx_allocate_game_memory((void *)Terabytes(2));
+#ifdef GG_INTERNAL
+    game_memory.profile = dbg_alloc_profile();
+    dbg_global_profile = game_memory.profile;
+#endif
 
     osx_game_so_paths_t game_so_paths = osx_get_game_so_paths();
     osx_game_t game = {0};
@@ -595,6 +522,7 @@ int main(void)
     b8 quitting = 0;
     // SDL_PauseAudioDevice(audio_device, 0);
     while (!quitting) {
+        BEGIN_BLOCK(input);
         while (SDL_PollEvent(&event)) {
             switch (event.type) {
             case SDL_QUIT:
@@ -642,6 +570,12 @@ int main(void)
                 if (event.key.keysym.sym == SDLK_ESCAPE) {
                     quitting = 1;
                 }
+#ifdef GG_INTERNAL
+                if (event.key.keysym.sym == SDLK_F4 &&
+                    dbg_begin_trace(game_memory.profile, DBG_TRACE_FRAME_COUNT, DBG_TRACE_PATH)) {
+                    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Tracing %d frames", DBG_TRACE_FRAME_COUNT);
+                }
+#endif
 
                 // NOTE(Wes): Pass other keys to the game.
                 if (kb_controller_index != -1) {
@@ -651,6 +585,7 @@ int main(void)
                 }
             }
         }
+        END_BLOCK(input);
 
         // TODO(Wes): Debug builds only.
         time_t last_modified = osx_get_last_modified(game_so_paths.so);
@@ -659,6 +594,7 @@ int main(void)
             dlclose(game.so);
             copyfile(game_so_paths.so, game_so_paths.temp_so, 0, COPYFILE_ALL);
             osx_load_game(&game, game_so_paths.temp_so);
+            wqResetGrains(&render_work_queue);
             game.so_last_modified = osx_get_last_modified(game_so_paths.so);
         }
 
@@ -683,11 +619,13 @@ int main(void)
         game.update_and_render_fn(&game_memory, &frame_buffer, &audio, new_input,
                                   &output, &callbacks, &game_work_queues);
         //SDL_UnlockTexture(texture);
+        BEGIN_BLOCK(present);
         SDL_UpdateTexture(texture, 0, pixels, frame_buffer.pitch);
 
         SDL_RenderClear(renderer);
         SDL_RenderCopy(renderer, texture, 0, 0);
         SDL_RenderPresent(renderer);
+        END_BLOCK(present);
 
         // SDL_QueueAudio(audio_device, (void *)audio.samples,
         // audio.sample_count *
@@ -718,13 +656,17 @@ int main(void)
             SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "-------------------");
             SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Frame time %.02f ms", frame_sec * 1000);
             SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "FPS %.01f", 120 / frame_accumulator);
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Scratch high water %u of %u KB",
+                        wqScratchHighWater(&render_work_queue) / 1024,
+                        WQ_SCRATCH_SIZE / 1024);
             frame_accumulator = 0.0f;
             // SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Queued
             // audio bytes %d",
             // queued_audio_size);
             must_print = true;
         }
-        osx_handle_debug_counters(&game_memory, must_print);
+        osx_handle_debug_profile(&game_memory, must_print);
     }
 
     SDL_Quit();
@@ -0,0 +1,131 @@
+#include "gg_parallax.h"
+#include "gg_math.h"
+#include "gg_render.h"
+
+void parallax_init(parallax_t *parallax, v2 size)
+{
+    parallax->size = size;
+    parallax->reference_height = 0;
+    parallax->layer_count = 0;
+}
+
+b8 parallax_add_layer(parallax_t *parallax, image_t *source, f32 scroll_factor)
+{
+    if (parallax->layer_count == GG_MAX_PARALLAX_LAYERS || !source->data) {
+        return 0;
+    }
+
+    parallax_layer_t *layer = &parallax->layers[parallax->layer_count++];
+    layer->source = *source;
+    layer->cache.data = 0;
+    layer->cache.w = 0;
+    layer->cache.h = 0;
+    layer->cache_capacity = 0;
+    layer->cached_units_to_pixels = 0.0f;
+    layer->scroll_factor = scroll_factor;
+
+    // NOTE(Wes): Texels are RGBA so alpha is the low byte.
+    layer->opaque = 1;
+    u32 texel_count = source->w * source->h;
+    for (u32 i = 0; i < texel_count; ++i) {
+        if ((source->data[i] & 0xFF) != 0xFF) {
+            layer->opaque = 0;
+            break;
+        }
+    }
+
+    if (source->h > parallax->reference_height) {
+        parallax->reference_height = source->h;
+    }
+
+    return 1;
+}
+
+// Size in pixels of the layer's cache at the camera scale.
+static void parallax_cache_size(parallax_t *parallax, parallax_layer_t *layer, f32 units_to_pixels, u32 *w, u32 *h)
+{
+    f32 layer_height = parallax->size.y * (f32)layer->source.h / (f32)parallax->reference_height;
+    *w = (u32)(parallax->size.x * units_to_pixels + 0.5f);
+    *h = (u32)(layer_height * units_to_pixels + 0.5f);
+}
+
+// NOTE(Wes): Everything behind the front most opaque full height layer is
+// covered by it.
+static u32 parallax_first_visible(parallax_t *parallax)
+{
+    u32 first_visible = 0;
+    for (u32 i = 0; i < parallax->layer_count; ++i) {
+        parallax_layer_t *layer = &parallax->layers[i];
+        if (layer->opaque && layer->source.h == parallax->reference_height) {
+            first_visible = i;
+        }
+    }
+    return first_visible;
+}
+
+void parallax_alloc_caches(parallax_t *parallax, memory_arena_t *cache_arena, f32 max_units_to_pixels)
+{
+    // NOTE(Wes): Hidden layers are never drawn so they get no cache.
+    for (u32 i = parallax_first_visible(parallax); i < parallax->layer_count; ++i) {
+        parallax_layer_t *layer = &parallax->layers[i];
+        u32 w, h;
+        parallax_cache_size(parallax, layer, max_units_to_pixels, &w, &h);
+        layer->cache.data = push_array(cache_arena, w * h, u32);
+        layer->cache_capacity = w * h;
+    }
+}
+
+static void parallax_update_cache(parallax_t *parallax, parallax_layer_t *layer, f32 units_to_pixels, log_fn log)
+{
+    u32 w, h;
+    parallax_cache_size(parallax, layer, units_to_pixels, &w, &h);
+
+    // NOTE(Wes): A scale past the one the caches were allocated for leaves the
+    // layer out. The scale is still recorded so this is logged once per scale
+    // rather than every frame.
+    layer->cached_units_to_pixels = units_to_pixels;
+    layer->cache.w = 0;
+    layer->cache.h = 0;
+    if (w * h > layer->cache_capacity) {
+        log("Parallax layer cache of %u pixels is too small for %ux%u, the layer is not drawn",
+            layer->cache_capacity,
+            w,
+            h);
+        return;
+    }
+    if (w == 0 || h == 0) {
+        return;
+    }
+
+    layer->cache.w = w;
+    layer->cache.h = h;
+    render_resample_image(&layer->source, &layer->cache);
+}
+
+void parallax_push(parallax_t *parallax, render_queue_t *queue, camera_t *camera, log_fn log)
+{
+    if (!parallax->layer_count) {
+        return;
+    }
+
+    u32 first_visible = parallax_first_visible(parallax);
+    f32 units_to_pixels = camera->units_to_pixels;
+    i32 screen_h = (i32)(parallax->size.y * units_to_pixels + 0.5f);
+    for (u32 i = first_visible; i < parallax->layer_count; ++i) {
+        parallax_layer_t *layer = &parallax->layers[i];
+        if (layer->cached_units_to_pixels != units_to_pixels) {
+            parallax_update_cache(parallax, layer, units_to_pixels, log);
+        }
+        if (!layer->cache.w) {
+            continue;
+        }
+
+        // NOTE(Wes): Scroll relative to the centre of the world so the layers
+        // line up when the camera is centred.
+        f32 scroll = (camera->position.x - parallax->size.x * 0.5f) * layer->scroll_factor * units_to_pixels;
+        scroll = fmodf(scroll, (f32)layer->cache.w);
+        i32 x = -kfloor(scroll);
+        i32 y = screen_h - (i32)layer->cache.h;
+        render_push_layer(queue, &layer->cache, x, y, layer->opaque);
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "gg_types.h"
+
+// Prepares an empty layer stack covering size world units.
+void parallax_init(parallax_t *parallax, v2 size);
+
+// Adds a layer in front of the existing ones. A scroll factor of 0 keeps the
+// layer fixed to the screen, 1 moves it with the world.
+b8 parallax_add_layer(parallax_t *parallax, image_t *source, f32 scroll_factor);
+
+// Gives every layer that can be seen a cache big enough for the largest camera
+// scale. Called once all the layers are added.
+void parallax_alloc_caches(parallax_t *parallax, memory_arena_t *cache_arena, f32 max_units_to_pixels);
+
+// Resamples any layer whose cache does not match the camera scale and pushes
+// the visible layers as integer offset row copies. Layers hidden behind an
+// opaque layer that covers the whole screen are not drawn. A cache too small
+// for the camera scale is logged and its layer left out.
+void parallax_push(parallax_t *parallax, render_queue_t *queue, camera_t *camera, log_fn log);
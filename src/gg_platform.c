@@ -7,6 +7,8 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <time.h>
+#include <math.h>
+#include <emmintrin.h>
 
 #define Kilobytes(Value) ((Value)*1024LL)
 #define Megabytes(Value) (Kilobytes(Value) * 1024LL)
@@ -15,10 +17,16 @@
 
 #ifdef _WIN32
 #include "gg_platform_windows.c"
-#elif
+#elif defined(__APPLE__)
 #include "gg_platform_osx.c"
+#else
+#include "gg_platform_linux.c"
 #endif
 
+#include "gg_work_queue.c"
+#include "gg_debug.c"
+#include "gg_upscale.c"
+
 SDL_GameController *controller_handles[GG_MAX_CONTROLLERS];
 SDL_Haptic *haptic_handles[GG_MAX_CONTROLLERS];
 
@@ -69,12 +77,12 @@ static game_lib_paths_t get_game_lib_paths()
     static char lib_path[1024] = {0};
     strncpy(lib_path, base_path, base_path_len);
 	lib_path[1023] = 0;
-    strcat(lib_path, "gg_game.dll");
+    strcat(lib_path, GAME_LIB_NAME);
 
     static char temp_lib_path[1024] = {0};
     strncpy(temp_lib_path, base_path, base_path_len);
 	temp_lib_path[1023] = 0;
-    strcat(temp_lib_path, "gg_game_temp.dll");
+    strcat(temp_lib_path, GAME_TEMP_LIB_NAME);
 
     game_lib_paths_t game_lib_paths;
     game_lib_paths.game_lib = lib_path;
@@ -259,6 +267,21 @@ static void handle_keyup(SDL_Keycode key,
     case SDLK_e:
         process_keyup(&(old_input->editor_mode), &(new_input->editor_mode));
         break;
+    case SDLK_o:
+        process_keyup(&(old_input->editor_overdraw), &(new_input->editor_overdraw));
+        break;
+    case SDLK_i:
+        process_keyup(&(old_input->editor_profiler), &(new_input->editor_profiler));
+        break;
+    case SDLK_COMMA:
+        process_keyup(&(old_input->editor_profiler_prev), &(new_input->editor_profiler_prev));
+        break;
+    case SDLK_PERIOD:
+        process_keyup(&(old_input->editor_profiler_next), &(new_input->editor_profiler_next));
+        break;
+    case SDLK_SLASH:
+        process_keyup(&(old_input->editor_profiler_slowest), &(new_input->editor_profiler_slowest));
+        break;
 #endif
     }
 }
@@ -294,6 +317,21 @@ static void handle_keydown(SDL_Keycode key,
     case SDLK_e:
         process_keydown(&(old_input->editor_mode), &(new_input->editor_mode));
         break;
+    case SDLK_o:
+        process_keydown(&(old_input->editor_overdraw), &(new_input->editor_overdraw));
+        break;
+    case SDLK_i:
+        process_keydown(&(old_input->editor_profiler), &(new_input->editor_profiler));
+        break;
+    case SDLK_COMMA:
+        process_keydown(&(old_input->editor_profiler_prev), &(new_input->editor_profiler_prev));
+        break;
+    case SDLK_PERIOD:
+        process_keydown(&(old_input->editor_profiler_next), &(new_input->editor_profiler_next));
+        break;
+    case SDLK_SLASH:
+        process_keydown(&(old_input->editor_profiler_slowest), &(new_input->editor_profiler_slowest));
+        break;
 #endif
     }
 }
@@ -304,6 +342,25 @@ static void copy_game_memory(game_memory_t *dst, game_memory_t *src)
     memcpy(dst->permanent_store, src->permanent_store, (size_t)src->permanent_store_size);
 }
 
+#define GG_INPUT_RECORDING_PATH "input.ggrec"
+#define GG_RENDER_CAPTURE_PATH "frame.ggrq"
+static void save_input_recording(const char *path, game_record_t *record)
+{
+    FILE *handle = fopen(path, "wb");
+    if (!handle) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to save input recording %s", path);
+        return;
+    }
+
+    game_input_recording_header_t header;
+    header.magic = GG_INPUT_RECORDING_MAGIC;
+    header.input_size = sizeof(game_input_t);
+    header.event_count = record->input_record_index;
+    fwrite(&header, sizeof(header), 1, handle);
+    fwrite(record->input_events, sizeof(game_input_t), record->input_record_index, handle);
+    fclose(handle);
+}
+
 static loaded_file_t load_file(const char *path)
 {
     loaded_file_t file = { 0 };
@@ -344,6 +401,19 @@ static void unload_file(loaded_file_t *loaded_file)
     free(loaded_file->contents);
 }
 
+static b8 write_file(const char *path, void *contents, u64 size)
+{
+    FILE *handle = fopen(path, "wb");
+    if (!handle) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to open file %s for writing", path);
+        return 0;
+    }
+
+    b8 written = fwrite(contents, 1, (size_t)size, handle) == size;
+    fclose(handle);
+    return written;
+}
+
 static void gg_log(const char* format, ...)
 {
     assert(format);
@@ -355,144 +425,351 @@ static void gg_log(const char* format, ...)
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, buffer);
 }
 
-static void handle_debug_counters(game_memory_t *memory, b8 must_print)
+// NOTE(Wes): Merges the frame's timed blocks and prints the averages every
+// so often. Must be called after the frame's work has finished.
+static void handle_debug_profile(game_memory_t *memory, b8 must_print)
 {
 #ifdef GG_INTERNAL
+    dbg_end_frame(memory->profile, &gg_log);
+    dbg_request_spike_capture(memory->profile, memory);
     if (must_print) {
-        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "DEBUG COUNTERS");
-    }
-    for (u32 i = 0; i < ARRAY_LEN(memory->counters); ++i) {
-        dbg_counter_t *counter = &memory->counters[i];
-        if (must_print) {
-            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "\tcy %I64u, h %u, cy/h %I64u", 
-                        counter->cycles, 
-                        counter->hits,
-                        counter->cycles / counter->hits);
-        }
-        if (counter->hits)
-        {
-            counter->cycles = 0;
-            counter->hits = 0;
-        }
+        dbg_print_profile(memory->profile, &gg_log);
+        dbg_clear_stats(memory->profile);
     }
 #endif
 }
 
-// Queue stuff ===============================
+// Dynamic resolution
+// ===========================================
+// NOTE(Wes): When enabled the game renders into a smaller frame buffer
+// whenever recent frames have gone over budget, which is then scaled back up
+// to the presentation size.
+#define DYNRES_HISTORY 16
+#define DYNRES_MIN_SCALE 0.5f
 
 typedef struct {
-    wq_fn work_fn;
-    void *data;
-} wq_entry_t;
-
-#define WQ_SIZE 1024
-typedef struct wq_t {
-    // Try keep start and end off the same cache line
-    // as they will be owned by different threads.
-    volatile i32 start;
-    wq_entry_t entries[WQ_SIZE];
-    volatile i32 end;
-    volatile i32 remaining_work_count;
-    SDL_sem *semaphore;
-} wq_t;
-
-void wqCreate(wq_t *wq, SDL_sem *semaphore)
+    b8 enabled;
+    f32 scale; // Fraction of the presentation width and height.
+    f32 frame_ms[DYNRES_HISTORY];
+    u32 frame_index;
+    u32 frames_since_change;
+} dynres_t;
+
+// Records the time spent on the last frame and picks a new scale once a full
+// history has been gathered at the current one. Returns 1 if the scale changed.
+static b8 dynres_record_frame(dynres_t *dynres, f32 work_ms, f32 budget_ms)
 {
-    wq->start = 0;
-    wq->end = 0;
-    wq->remaining_work_count = 0;
-    wq->semaphore = semaphore;
+    dynres->frame_ms[dynres->frame_index++ % DYNRES_HISTORY] = work_ms;
+    if (++dynres->frames_since_change < DYNRES_HISTORY) {
+        return 0;
+    }
+
+    f32 average_ms = 0.0f;
+    for (u32 i = 0; i < DYNRES_HISTORY; ++i) {
+        average_ms += dynres->frame_ms[i];
+    }
+    average_ms /= DYNRES_HISTORY;
+
+    // NOTE(Wes): Fill cost goes with the pixel count, ie. the square of the
+    // scale. Aim a little under budget so we do not flip back and forth, and
+    // only grow back slowly.
+    f32 target_ms = budget_ms * 0.85f;
+    f32 new_scale = dynres->scale * sqrtf(target_ms / average_ms);
+    if (new_scale > dynres->scale + 0.1f) {
+        new_scale = dynres->scale + 0.1f;
+    }
+    if (new_scale < DYNRES_MIN_SCALE) {
+        new_scale = DYNRES_MIN_SCALE;
+    }
+    if (new_scale > 1.0f) {
+        new_scale = 1.0f;
+    }
+
+    f32 change = new_scale - dynres->scale;
+    if (change < 0.05f && change > -0.05f && new_scale != 1.0f) {
+        return 0;
+    }
+    if (new_scale == dynres->scale) {
+        return 0;
+    }
+
+    dynres->scale = new_scale;
+    dynres->frames_since_change = 0;
+    return 1;
+}
+
+// ===========================================
+
+// Presentation
+// ===========================================
+// NOTE(Wes): Lock is the default as it skips the full frame copy. The blend
+// kernels read back the pixels they draw over though, and locked texture
+// memory is write only as far as SDL promises and often write combined, so
+// on some drivers reading it can cost more than the copy. -present=copy is
+// the fallback for those. The report logs the time spent drawing into the
+// frame next to the upload so the two modes can be compared with F2.
+typedef enum {
+    present_mode_lock, // Render straight into the locked streaming texture.
+    present_mode_copy, // Render into staging memory and upload it with SDL_UpdateTexture.
+    present_mode_count
+} present_mode_t;
+
+static const char *present_mode_names[present_mode_count] = {"lock", "copy"};
+
+typedef struct {
+    present_mode_t mode;
+    SDL_Texture *texture;
+    u32 w;
+    u32 h;
+
+    // NOTE(Wes): Staging memory is double buffered so the frame being
+    // uploaded is never the one being drawn into.
+    u8 *staging[2];
+    u32 staging_index;
+    b8 locked;
+
+    // Upload statistics since the last report.
+    u64 upload_bytes;
+    u64 upload_ticks;
+    u64 draw_start;
+    u64 draw_ticks; // From begin_frame to end_frame, where lock mode pays for reads.
+    u32 upload_frames;
+    u32 lock_fallbacks;
+} presenter_t;
+
+static void presenter_init(presenter_t *presenter, SDL_Texture *texture, u32 w, u32 h, present_mode_t mode)
+{
+    presenter->mode = mode;
+    presenter->texture = texture;
+    presenter->w = w;
+    presenter->h = h;
+    for (u32 i = 0; i < ARRAY_LEN(presenter->staging); ++i) {
+        presenter->staging[i] = (u8 *)malloc(w * h * GG_BYTES_PP);
+        assert(((uintptr_t)presenter->staging[i] & 15) == 0);
+    }
 }
 
-b8 wqIsEmpty(wq_t *wq)
+// Returns the memory the frame should be drawn into. The frame buffer
+// rendering code requires 16 byte aligned rows, if the texture memory does
+// not provide that the frame falls back to staging memory.
+static void presenter_begin_frame(presenter_t *presenter, u8 **data, u32 *pitch)
 {
-    return wq->start == wq->end;
+    u64 start = SDL_GetPerformanceCounter();
+    presenter->locked = 0;
+    if (presenter->mode == present_mode_lock) {
+        void *texture_data = 0;
+        i32 texture_pitch = 0;
+        if (SDL_LockTexture(presenter->texture, 0, &texture_data, &texture_pitch) == 0) {
+            if (((uintptr_t)texture_data & 15) == 0 && (texture_pitch & 15) == 0) {
+                *data = (u8 *)texture_data;
+                *pitch = (u32)texture_pitch;
+                presenter->locked = 1;
+            } else {
+                SDL_UnlockTexture(presenter->texture);
+                presenter->lock_fallbacks++;
+            }
+        } else {
+            presenter->lock_fallbacks++;
+        }
+    }
+    presenter->upload_ticks += SDL_GetPerformanceCounter() - start;
+
+    if (!presenter->locked) {
+        presenter->staging_index ^= 1;
+        *data = presenter->staging[presenter->staging_index];
+        *pitch = presenter->w * GG_BYTES_PP;
+    }
+    presenter->draw_start = SDL_GetPerformanceCounter();
 }
 
-b8 wqIsFull(wq_t *wq)
+static void presenter_end_frame(presenter_t *presenter)
 {
-    i32 next_end = (wq->end + 1) % WQ_SIZE;
-    return next_end == wq->start;
+    u64 start = SDL_GetPerformanceCounter();
+    presenter->draw_ticks += start - presenter->draw_start;
+    if (presenter->locked) {
+        SDL_UnlockTexture(presenter->texture);
+    } else {
+        u32 pitch = presenter->w * GG_BYTES_PP;
+        SDL_UpdateTexture(presenter->texture, 0, presenter->staging[presenter->staging_index], pitch);
+        presenter->upload_bytes += (u64)pitch * presenter->h;
+    }
+    presenter->upload_ticks += SDL_GetPerformanceCounter() - start;
+    presenter->upload_frames++;
 }
 
-b8 wqEnqueue(wq_t *wq, wq_fn work_fn, void *data)
+static void presenter_report(presenter_t *presenter)
 {
-    i32 start = wq->start;
-    i32 end = wq->end;
-    i32 next_end = (end + 1) % WQ_SIZE;
-    if (start == next_end) {
-        // Queue is full.
-        return 0;
+    if (!presenter->upload_frames) {
+        return;
     }
 
-    wq_entry_t *entry = wq->entries + end;
-    entry->work_fn = work_fn;
-    entry->data = data;
-    // Atomic add?
-    atomic_increment(&wq->remaining_work_count);
-    wq->end = next_end;
+    f64 seconds = (f64)presenter->upload_ticks / (f64)SDL_GetPerformanceFrequency();
+    f64 ms_per_frame = seconds * 1000.0 / presenter->upload_frames;
+    f64 mb_per_frame = (f64)presenter->upload_bytes / presenter->upload_frames / (1024.0 * 1024.0);
+    f64 gb_per_second = seconds > 0.0 ? presenter->upload_bytes / seconds / (1024.0 * 1024.0 * 1024.0) : 0.0;
+    f64 draw_ms_per_frame = presenter->draw_ticks * 1000.0 / (f64)SDL_GetPerformanceFrequency() / presenter->upload_frames;
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Present (%s) draw %.02f ms, upload %.02f ms, copied %.02f MB/frame at %.02f GB/s, %u lock fallbacks",
+                present_mode_names[presenter->mode],
+                draw_ms_per_frame,
+                ms_per_frame,
+                mb_per_frame,
+                gb_per_second,
+                presenter->lock_fallbacks);
+
+    presenter->upload_bytes = 0;
+    presenter->upload_ticks = 0;
+    presenter->draw_ticks = 0;
+    presenter->upload_frames = 0;
+    presenter->lock_fallbacks = 0;
+}
 
-    SDL_SemPost(wq->semaphore);
-    return 1;
+// NOTE(Wes): With -present=thread the renderer belongs to a thread of its own
+// so stalls in the driver's upload and present no longer hold up the next
+// update. Video, the window and the event pump stay on the main thread as
+// some platforms only allow them there. The renderer is created by the
+// present thread, as render backends only work on the thread that created
+// them, and only that thread touches it. Cocoa also wants the renderer on
+// the main thread so the flag is refused on macOS.
+//
+// Frames are handed over through a mailbox of three buffers: the main thread
+// draws into one, the present thread uploads another and the third sits in
+// the mailbox. Each side only swaps its buffer with the mailbox so neither
+// ever waits on the other. A frame still in the mailbox when the next one
+// arrives is dropped.
+#define PRESENT_BUFFER_COUNT 3
+#define PRESENT_MAILBOX_NEW 0x100 // Set while the mailbox frame has not been presented.
+#define PRESENT_REPORT_FRAMES 120
+
+typedef struct {
+    SDL_Window *window;
+    u32 render_flags;
+    u32 w;
+    u32 h;
+    u8 *buffers[PRESENT_BUFFER_COUNT];
+    u32 draw_index; // Owned by the main thread.
+    volatile i32 mailbox;
+    volatile i32 published; // Bumped for every frame handed over, the present thread sleeps on it.
+    volatile i32 quit;
+    volatile i32 done;
+
+    // Owned by the present thread.
+    u32 present_index;
+    u64 upload_ticks;
+    u64 present_ticks;
+    u32 present_frames;
+} present_thread_t;
+
+// Stores value in the mailbox and returns what it held.
+static i32 present_swap_mailbox(volatile i32 *mailbox, i32 value)
+{
+    i32 old;
+    do {
+        old = *mailbox;
+    } while (atomic_cas(mailbox, value, old) != old);
+    return old;
 }
 
-b8 wqDequeue(wq_t *wq, wq_entry_t *entry)
+static THREAD_PROC(present_thread_proc)
 {
-    while (!wqIsEmpty(wq)) {
-        i32 start = wq->start;
-        i32 next_start = (start + 1) % WQ_SIZE;
-        i32 original_start = atomic_cas(&wq->start, next_start, start);
-        if (original_start == start) {
-            wq_entry_t *wq_entry = wq->entries + start;
-            entry->work_fn = wq_entry->work_fn;
-            entry->data = wq_entry->data;
-            return 1;
+    present_thread_t *present = (present_thread_t *)data;
+    // NOTE(Wes): Not timed with the profiler, which is merged on the main
+    // thread while this one keeps running.
+    SDL_Renderer *renderer = SDL_CreateRenderer(present->window, -1, present->render_flags);
+    SDL_Texture *texture = 0;
+    if (renderer) {
+        SDL_RenderSetLogicalSize(renderer, present->w, present->h);
+        texture = SDL_CreateTexture(
+            renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, present->w, present->h);
+    }
+    if (!texture) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Present thread failed to create a renderer: %s", SDL_GetError());
+    }
+
+    f64 ms_per_tick = 1000.0 / (f64)SDL_GetPerformanceFrequency();
+    while (!present->quit) {
+        // NOTE(Wes): Read before the mailbox so a frame handed over after the
+        // look changes it and the wait returns at once.
+        i32 published = present->published;
+        if (!(present->mailbox & PRESENT_MAILBOX_NEW)) {
+            wait_on_address(&present->published, published);
+            continue;
+        }
+        present->present_index =
+            (u32)(present_swap_mailbox(&present->mailbox, (i32)present->present_index) & ~PRESENT_MAILBOX_NEW);
+        if (!texture) {
+            continue;
+        }
+
+        u64 start = SDL_GetPerformanceCounter();
+        SDL_UpdateTexture(texture, 0, present->buffers[present->present_index], present->w * GG_BYTES_PP);
+        u64 uploaded = SDL_GetPerformanceCounter();
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, texture, 0, 0);
+        SDL_RenderPresent(renderer);
+        present->upload_ticks += uploaded - start;
+        present->present_ticks += SDL_GetPerformanceCounter() - uploaded;
+
+        if (++present->present_frames == PRESENT_REPORT_FRAMES) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Present thread upload %.02f ms, present %.02f ms",
+                        present->upload_ticks * ms_per_tick / present->present_frames,
+                        present->present_ticks * ms_per_tick / present->present_frames);
+            present->upload_ticks = 0;
+            present->present_ticks = 0;
+            present->present_frames = 0;
         }
     }
 
+    if (texture) {
+        SDL_DestroyTexture(texture);
+    }
+    if (renderer) {
+        SDL_DestroyRenderer(renderer);
+    }
+    present->done = 1;
+    wake_by_address(&present->done, 1);
     return 0;
 }
 
-void wqFinishWork(wq_t *wq)
+static void present_thread_start(present_thread_t *present, SDL_Window *window, u32 render_flags, u32 w, u32 h)
 {
-    wq_entry_t entry;
-    while (wq->remaining_work_count > 0) {
-        if (wqDequeue(wq, &entry)) {
-            entry.work_fn(entry.data);
-            atomic_decrement(&wq->remaining_work_count);
-        }
+    present->window = window;
+    present->render_flags = render_flags;
+    present->w = w;
+    present->h = h;
+    for (u32 i = 0; i < PRESENT_BUFFER_COUNT; ++i) {
+        present->buffers[i] = (u8 *)calloc(w * h, GG_BYTES_PP);
+        assert(((uintptr_t)present->buffers[i] & 15) == 0);
     }
+    present->draw_index = 0;
+    present->mailbox = 1;
+    present->present_index = 2;
+    create_thread(present_thread_proc, present);
 }
 
-// ===========================================
-
-// Thread stuff
-// ===========================================
-typedef struct {
-    u32 index;
-    wq_t *work_queue;
-} thread_info_t;
+// Hands the buffer the main thread drew into to the present thread and takes
+// the next one from the mailbox. Returns 1 if the frame it replaced in the
+// mailbox was never presented.
+static b8 present_thread_publish(present_thread_t *present)
+{
+    i32 old = present_swap_mailbox(&present->mailbox, (i32)present->draw_index | PRESENT_MAILBOX_NEW);
+    present->draw_index = (u32)(old & ~PRESENT_MAILBOX_NEW);
+    atomic_increment(&present->published);
+    wake_by_address(&present->published, 1);
+    return (old & PRESENT_MAILBOX_NEW) != 0;
+}
 
-int thread_fn(void *data)
+// Waits for the present thread to release the renderer.
+static void present_thread_stop(present_thread_t *present)
 {
-    thread_info_t *thread_info = (thread_info_t *)data;
-    wq_t *work_queue = thread_info->work_queue;
-
-    wq_entry_t entry;
-    for (;;) {
-        if (wqDequeue(work_queue, &entry)) {
-            entry.work_fn(entry.data);
-            atomic_decrement(&work_queue->remaining_work_count);
-        }
-        else
-        {
-            SDL_SemWait(work_queue->semaphore);
-        }
+    present->quit = 1;
+    atomic_increment(&present->published);
+    wake_by_address(&present->published, 1);
+    while (!present->done) {
+        wait_on_address(&present->done, 0);
     }
-    return 1;
 }
-// TODO Read the core count to set the thread count.
-#define WORKER_THREAD_COUNT 8
 // ===========================================
 
 
@@ -502,23 +779,72 @@ int main(int argc, char *argv[])
         // TODO(Wes): SDL_Init didn't work!
     }
 
-    SDL_sem *semaphore = SDL_CreateSemaphore(0);
-    wq_t render_work_queue;
-    wqCreate(&render_work_queue, semaphore);
-    thread_info_t thread_infos[WORKER_THREAD_COUNT];
-
-    SDL_Thread* threads[WORKER_THREAD_COUNT];
-    for (u32 i = 0; i < WORKER_THREAD_COUNT; i++) {
-        thread_info_t *thread_info = thread_infos + i;
-        thread_info->index = i;
-        thread_info->work_queue = &render_work_queue;
-        threads[i] = SDL_CreateThread(thread_fn, "gg_worker", (void *)thread_info);
+    static dynres_t dynres = {0};
+    static upscaler_t upscaler = {0};
+    dynres.scale = 1.0f;
+    present_mode_t present_mode = present_mode_lock;
+    const char *stats_path = 0;
+    f32 budget_ms = 0.0f;
+    const char *spike_dir = 0;
+    i32 max_spikes = -1; // -1 keeps DBG_MAX_SPIKES.
+    const char *config_path = WQ_CONFIG_PATH;
+    b8 pipelined = 0;
+    b8 threaded_present = 0;
+    for (i32 i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "-config=", 8) == 0) {
+            config_path = argv[i] + 8;
+        }
     }
+    wq_config_t wq_config;
+    wqDefaultConfig(&wq_config);
+    wqLoadConfig(&wq_config, config_path);
+    for (i32 i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-dynres") == 0) {
+            dynres.enabled = 1;
+        } else if (strcmp(argv[i], "-present=lock") == 0) {
+            present_mode = present_mode_lock;
+        } else if (strcmp(argv[i], "-present=copy") == 0) {
+            present_mode = present_mode_copy;
+        } else if (strcmp(argv[i], "-present=thread") == 0) {
+#ifdef __APPLE__
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "-present=thread is not supported on macOS, ignoring it");
+#else
+            threaded_present = 1;
+#endif
+        } else if (strncmp(argv[i], "-stats=", 7) == 0) {
+            stats_path = argv[i] + 7;
+        } else if (strncmp(argv[i], "-budget=", 8) == 0) {
+            budget_ms = strtof(argv[i] + 8, 0);
+        } else if (strncmp(argv[i], "-spike-dir=", 11) == 0) {
+            spike_dir = argv[i] + 11;
+        } else if (strncmp(argv[i], "-max-spikes=", 12) == 0) {
+            max_spikes = (i32)strtol(argv[i] + 12, 0, 10);
+        } else if (strncmp(argv[i], "-workers=", 9) == 0) {
+            wq_config.worker_count = (i32)strtol(argv[i] + 9, 0, 10);
+        } else if (strcmp(argv[i], "-pin") == 0) {
+            wq_config.pin_threads = 1;
+        } else if (strcmp(argv[i], "-pipelined") == 0) {
+            pipelined = 1;
+        }
+    }
+
+    cpu_topology_t topology;
+    get_cpu_topology(&topology);
+    static wq_t render_work_queue;
+    wqCreate(&render_work_queue);
+    static thread_info_t thread_infos[WQ_MAX_THREADS];
+    u32 worker_count = wqStartPool(&render_work_queue, thread_infos, &wq_config, &topology);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Cores %u physical, %u logical, %u workers%s",
+                topology.physical_count, topology.logical_count, worker_count,
+                wq_config.pin_threads ? ", pinned" : "");
 
     game_work_queues_t game_work_queues;
     game_work_queues.render_work_queue = &render_work_queue;
     game_work_queues.add_work = wqEnqueue;
     game_work_queues.finish_work = wqFinishWork;
+    game_work_queues.add_jobs = wqAddJobs;
+    game_work_queues.wait_counter = wqWaitCounter;
+    game_work_queues.parallel_for = wqParallelFor;
 
     i32 window_width = 1920;
     i32 window_height = 1080;
@@ -539,17 +865,27 @@ int main(int argc, char *argv[])
     u32 render_flags = SDL_RENDERER_ACCELERATED;
 #endif
 
-    u32 frame_buffer_width = 1920;
-    u32 frame_buffer_height = 1080;
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, render_flags);
-    SDL_RenderSetLogicalSize(renderer, frame_buffer_width, frame_buffer_height);
-
+    u32 frame_buffer_width = GG_MAX_FRAME_WIDTH;
+    u32 frame_buffer_height = GG_MAX_FRAME_HEIGHT;
     // Ensure our frame buffer is on a 16 byte boundary so we can use it with SSE intructions.
     u32 frame_buffer_size = frame_buffer_width * frame_buffer_height * GG_BYTES_PP;
-    u8 *pixels = (u8 *)malloc(frame_buffer_size);
-    assert(((uintptr_t)pixels & 15) == 0);
-    SDL_Texture *texture = SDL_CreateTexture(
-        renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, frame_buffer_width, frame_buffer_height);
+    // NOTE(Wes): Lower resolution frames are rendered here and then scaled up
+    // into the presented frame.
+    u8 *scaled_pixels = (u8 *)malloc(frame_buffer_size);
+    assert(((uintptr_t)scaled_pixels & 15) == 0);
+    SDL_Renderer *renderer = 0;
+    presenter_t presenter = {0};
+    static present_thread_t present_thread = {0};
+    u32 present_dropped = 0;
+    if (threaded_present) {
+        present_thread_start(&present_thread, window, render_flags, frame_buffer_width, frame_buffer_height);
+    } else {
+        renderer = SDL_CreateRenderer(window, -1, render_flags);
+        SDL_RenderSetLogicalSize(renderer, frame_buffer_width, frame_buffer_height);
+        SDL_Texture *texture = SDL_CreateTexture(
+            renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, frame_buffer_width, frame_buffer_height);
+        presenter_init(&presenter, texture, frame_buffer_width, frame_buffer_height, present_mode);
+    }
 
     SDL_AudioSpec audio_spec_want = {0};
     audio_spec_want.freq = 48000;
@@ -568,6 +904,19 @@ int main(int argc, char *argv[])
     }*/
 
     game_memory_t game_memory = allocate_game_memory((void *)Terabytes(2));
+    game_memory.pipelined = pipelined;
+#ifdef GG_INTERNAL
+    game_memory.profile = dbg_alloc_profile();
+    dbg_global_profile = game_memory.profile;
+    game_memory.profile->budget_ms = budget_ms;
+    game_memory.profile->spike_dir = spike_dir;
+    if (max_spikes >= 0) {
+        game_memory.profile->max_spikes = (u32)max_spikes;
+    }
+    if (stats_path && !dbg_open_stats(game_memory.profile, stats_path)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to open %s for writing", stats_path);
+    }
+#endif
 
     game_lib_paths_t game_lib_paths = get_game_lib_paths();
     game_t game = {0};
@@ -626,6 +975,7 @@ int main(int argc, char *argv[])
     callbacks.load_file = &load_file;
     callbacks.unload_file = &unload_file;
     callbacks.log = &gg_log;
+    callbacks.write_file = &write_file;
 
     u64 last_time = SDL_GetPerformanceCounter();
     u64 perf_freq = SDL_GetPerformanceFrequency();
@@ -638,6 +988,7 @@ int main(int argc, char *argv[])
     b8 quitting = 0;
     // SDL_PauseAudioDevice(audio_device, 0);
     while (!quitting) {
+        BEGIN_BLOCK(input);
         while (SDL_PollEvent(&event)) {
             switch (event.type) {
             case SDL_QUIT:
@@ -664,6 +1015,7 @@ int main(int argc, char *argv[])
                         SDL_LogInfo(
                             SDL_LOG_CATEGORY_APPLICATION, "Recorded %d input events", game_record.input_record_index);
                         recording = 0;
+                        save_input_recording(GG_INPUT_RECORDING_PATH, &game_record);
                     }
                     else {
                         copy_game_memory(&game_record.memory, &game_memory);
@@ -687,6 +1039,29 @@ int main(int argc, char *argv[])
                 if (event.key.keysym.sym == SDLK_ESCAPE) {
                     quitting = 1;
                 }
+                if (event.key.keysym.sym == SDLK_F2 && !threaded_present) {
+                    presenter.mode = (present_mode_t)((presenter.mode + 1) % present_mode_count);
+                    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                                "Present mode %s",
+                                present_mode_names[presenter.mode]);
+                }
+#ifdef GG_INTERNAL
+                if (event.key.keysym.sym == SDLK_F3) {
+                    game_memory.render_capture_path = GG_RENDER_CAPTURE_PATH;
+                }
+                if (event.key.keysym.sym == SDLK_F4 &&
+                    dbg_begin_trace(game_memory.profile, DBG_TRACE_FRAME_COUNT, DBG_TRACE_PATH)) {
+                    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Tracing %d frames", DBG_TRACE_FRAME_COUNT);
+                }
+#endif
+                if (event.key.keysym.sym == SDLK_F1) {
+                    dynres.enabled = !dynres.enabled;
+                    dynres.scale = 1.0f;
+                    dynres.frames_since_change = 0;
+                    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                                "Dynamic resolution %s",
+                                dynres.enabled ? "enabled" : "disabled");
+                }
 
                 // NOTE(Wes): Pass other keys to the game.
                 if (kb_controller_index != -1) {
@@ -696,6 +1071,7 @@ int main(int argc, char *argv[])
                 }
             }
         }
+        END_BLOCK(input);
 
         // TODO(Wes): Debug builds only.
         time_t last_modified = get_last_modified(game_lib_paths.game_lib);
@@ -705,6 +1081,7 @@ int main(int argc, char *argv[])
             SDL_UnloadObject(game.lib);
             copy_file(game_lib_paths.game_lib, game_lib_paths.temp_game_lib);
             load_game(&game, game_lib_paths.temp_game_lib);
+            wqResetGrains(&render_work_queue);
             game.last_modified = get_last_modified(game_lib_paths.game_lib);
         }
 
@@ -722,19 +1099,66 @@ int main(int argc, char *argv[])
             *new_input = game_record.input_events[playback_index];
         }
 
-        // NOTE(Wes): The frame buffer pixels point directly to the SDL texture.
-        //SDL_LockTexture(texture, 0, (void **)&frame_buffer.data, (i32 *)&frame_buffer.pitch);
-        frame_buffer.data = pixels;
-        frame_buffer.pitch = frame_buffer_width * GG_BYTES_PP;
+        u64 work_start = SDL_GetPerformanceCounter();
+
+        // NOTE(Wes): In lock mode the frame is drawn directly into the SDL
+        // texture, either by the game or by the upscale.
+        u8 *present_data = 0;
+        u32 present_pitch = 0;
+        if (threaded_present) {
+            present_data = present_thread.buffers[present_thread.draw_index];
+            present_pitch = frame_buffer_width * GG_BYTES_PP;
+        } else {
+            presenter_begin_frame(&presenter, &present_data, &present_pitch);
+        }
+        b8 scaled = dynres.enabled && dynres.scale < 1.0f;
+        if (scaled) {
+            // NOTE(Wes): Keep the width a multiple of 4 as the rasterizer works on 4 pixels at a time.
+            frame_buffer.w = (u32)(frame_buffer_width * dynres.scale) & ~3u;
+            frame_buffer.h = (u32)(frame_buffer_height * dynres.scale);
+            frame_buffer.data = scaled_pixels;
+            frame_buffer.pitch = frame_buffer.w * GG_BYTES_PP;
+        } else {
+            frame_buffer.w = frame_buffer_width;
+            frame_buffer.h = frame_buffer_height;
+            frame_buffer.data = present_data;
+            frame_buffer.pitch = present_pitch;
+        }
 
         game.update_and_render_fn(&game_memory, &frame_buffer, &audio, new_input,
             &output, &callbacks, &game_work_queues);
-        //SDL_UnlockTexture(texture);
-        SDL_UpdateTexture(texture, 0, pixels, frame_buffer.pitch);
-
-        SDL_RenderClear(renderer);
-        SDL_RenderCopy(renderer, texture, 0, 0);
-        SDL_RenderPresent(renderer);
+        if (scaled) {
+            BEGIN_BLOCK(upscale_frame_buffer);
+            upscale_frame_buffer(&upscaler,
+                                 &frame_buffer,
+                                 present_data,
+                                 frame_buffer_width,
+                                 frame_buffer_height,
+                                 present_pitch,
+                                 &render_work_queue);
+            END_BLOCK(upscale_frame_buffer);
+        }
+        BEGIN_BLOCK(present);
+        if (threaded_present) {
+            present_dropped += present_thread_publish(&present_thread);
+        } else {
+            presenter_end_frame(&presenter);
+
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, presenter.texture, 0, 0);
+            SDL_RenderPresent(renderer);
+        }
+        END_BLOCK(present);
+
+        if (dynres.enabled) {
+            f32 work_ms = (SDL_GetPerformanceCounter() - work_start) * 1000.0f / SDL_GetPerformanceFrequency();
+            if (dynres_record_frame(&dynres, work_ms, 1000.0f / GG_TARGET_FPS)) {
+                SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                            "Dynamic resolution %ux%u",
+                            (u32)(frame_buffer_width * dynres.scale) & ~3u,
+                            (u32)(frame_buffer_height * dynres.scale));
+            }
+        }
 
         // SDL_QueueAudio(audio_device, (void *)audio.samples,
         // audio.sample_count *
@@ -767,15 +1191,31 @@ int main(int argc, char *argv[])
             SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "-------------------");
             SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Frame time %.02f ms", frame_sec * 1000);
             SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "FPS %.01f", 120 / frame_accumulator);
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Scratch high water %u of %u KB",
+                        wqScratchHighWater(&render_work_queue) / 1024,
+                        WQ_SCRATCH_SIZE / 1024);
+            if (threaded_present) {
+                SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Present thread dropped %u frames", present_dropped);
+                present_dropped = 0;
+            } else {
+                presenter_report(&presenter);
+            }
             frame_accumulator = 0.0f;
             // SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Queued
             // audio bytes %d",
             // queued_audio_size);
             must_print = true;
         }
-        handle_debug_counters(&game_memory, must_print);
+        handle_debug_profile(&game_memory, must_print);
     }
 
+#ifdef GG_INTERNAL
+    dbg_close_stats(game_memory.profile);
+#endif
+    if (threaded_present) {
+        present_thread_stop(&present_thread);
+    }
     SDL_Quit();
     return 0;
 }
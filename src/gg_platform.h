@@ -69,33 +69,59 @@ typedef uint64_t u64;
 typedef float f32;
 typedef double f64;
 
-enum {
-    dbg_counter_game_update_and_render,
-    dbg_counter_render_draw_queue,
-    dbg_counter_render_image,
-    dbg_counter_process_pixel,
-    dbg_counter_count
-};
+// NOTE(Wes): Defined ahead of the debug header, which keeps a buffer per thread.
+#define WQ_MAX_THREADS 32 // Workers per queue, the thread outside the pool makes one more.
 
-#ifdef GG_INTERNAL
+#include "gg_debug.h"
+
+// Note(Wes): Memory
 typedef struct {
-    u64 cycles;
-    u32 hits;
-} dbg_counter_t;
+    u64 size;
+    u32 index;
+    u32 high_water; // Largest index reached, kept across temporary memory.
+    u8 *base;
+} memory_arena_t;
 
-#define START_COUNTER(id) u64 start_counter_##id = rdtsc();
-#define END_COUNTER(id) dbg_global_memory->counters[dbg_counter_##id].cycles += rdtsc() - start_counter_##id; \
-                      ++dbg_global_memory->counters[dbg_counter_##id].hits;
-#define END_COUNTER_N(id, count) dbg_global_memory->counters[dbg_counter_##id].cycles += rdtsc() - start_counter_##id; \
-                                 dbg_global_memory->counters[dbg_counter_##id].hits += (count);
+static inline void init_arena(memory_arena_t *arena, u64 size, u8 *base)
+{
+    arena->size = size;
+    arena->base = base;
+    arena->index = 0;
+    arena->high_water = 0;
+}
 
-#else
+#define push_struct(arena, type) (type *) push_size(arena, sizeof(type))
+#define push_array(arena, count, type) (type *) push_size(arena, (count) * sizeof(type))
+static inline void *push_size(memory_arena_t *arena, u32 size)
+{
+    assert((arena->index + size) <= arena->size);
+    void *result = arena->base + arena->index;
+    arena->index += size;
+    if (arena->index > arena->high_water) {
+        arena->high_water = arena->index;
+    }
 
-#define START_COUNTER(id)
-#define END_COUNTER(id)
-#define END_COUNTER_N(id, count)
+    return result;
+}
 
-#endif
+// NOTE(Wes): Temporary memory lets a caller use the end of an arena as
+// scratch space and give it back once it is done.
+typedef struct {
+    memory_arena_t *arena;
+    u32 index;
+} temp_memory_t;
+
+static inline temp_memory_t begin_temp_memory(memory_arena_t *arena)
+{
+    temp_memory_t result = {arena, arena->index};
+    return result;
+}
+
+static inline void end_temp_memory(temp_memory_t temp)
+{
+    assert(temp.arena->index >= temp.index);
+    temp.arena->index = temp.index;
+}
 
 typedef struct {
     u8 *transient_store;
@@ -106,16 +132,29 @@ typedef struct {
 
     b8 is_initialized;
 
-#ifdef GG_INTERNAL
-    dbg_counter_t counters[dbg_counter_count];
-#endif
-} game_memory_t;
+    // NOTE(Wes): Set by the platform to have each call draw the frame built by
+    // the call before it while simulating the next. The frame buffer then
+    // holds the previous frame when the call returns, a frame of latency in
+    // exchange for simulation and rasterization overlapping.
+    b8 pipelined;
 
 #ifdef GG_INTERNAL
-extern game_memory_t *dbg_global_memory;
+    // NOTE(Wes): Owned by the platform, which merges it once per frame.
+    dbg_profile_t *profile;
+
+    // NOTE(Wes): Set by the platform to have the game capture the render
+    // queue of the next frame to this path. The game clears it once written.
+    // With render_capture_previous the frame before it is captured instead.
+    const char *render_capture_path;
+    b8 render_capture_previous;
 #endif
+} game_memory_t;
 
 #define GG_BYTES_PP 4 // Bytes per pixel
+// NOTE(Wes): Hosts never hand the game a larger frame buffer, so buffers that
+// follow the frame size are allocated once at this size.
+#define GG_MAX_FRAME_WIDTH 1920
+#define GG_MAX_FRAME_HEIGHT 1080
 typedef struct {
     u8 *data; // Always 4bpp. RR GG BB AA
     u32 w;
@@ -158,6 +197,11 @@ typedef struct {
             game_button_state_t terminator;
 #ifdef GG_EDITOR
             game_button_state_t editor_mode;
+            game_button_state_t editor_overdraw;
+            game_button_state_t editor_profiler;
+            game_button_state_t editor_profiler_prev;
+            game_button_state_t editor_profiler_next;
+            game_button_state_t editor_profiler_slowest;
 #endif
         };
     };
@@ -175,6 +219,15 @@ typedef struct {
     f32 delta_time;
 } game_input_t;
 
+// NOTE(Wes): Input recordings are saved by the SDL host and can be replayed by
+// the headless host. The header is followed by event_count game_input_t.
+#define GG_INPUT_RECORDING_MAGIC 0x52494747 // "GGIR"
+typedef struct {
+    u32 magic;
+    u32 input_size;
+    u32 event_count;
+} game_input_recording_header_t;
+
 typedef struct {
     b8 rumble;
     f32 intensity;
@@ -200,23 +253,95 @@ typedef struct {
 typedef loaded_file_t (*load_file_fn)(const char *filename);
 typedef void (*unload_file_fn)(loaded_file_t *);
 typedef void(*log_fn)(const char*, ...);
+typedef b8 (*write_file_fn)(const char *filename, void *contents, u64 size);
 
 // TODO(Wes): Pass these once during game_init or something.
 typedef struct {
     load_file_fn load_file;
     unload_file_fn unload_file;
     log_fn log;
+    write_file_fn write_file;
 } game_callbacks_t;
 
+// NOTE(Wes): Filled by the host's platform file. cpus lists one logical CPU
+// of every physical core first, then the remaining SMT siblings, so the first
+// physical_count entries never share a core.
+#define GG_MAX_CPUS 64
+typedef struct {
+    u32 logical_count;
+    u32 physical_count;
+    u32 cpus[GG_MAX_CPUS];
+} cpu_topology_t;
+
 // Worker Queue
 typedef struct wq_t wq_t;
-typedef void (*wq_fn) (void *);
-typedef b8 (*add_work_fn)(wq_t *, wq_fn, void *);
+
+// NOTE(Wes): Handed to every job. Each thread owns a scratch arena, anything
+// a job or range pushes onto it is given back once it returns so it is only
+// for temporaries, eg. bins or span tables. Jobs run while waiting inside
+// another job push after the outer job's memory and give theirs back first.
+typedef struct {
+    u32 thread_index; // Below WQ_MAX_THREADS + 1, for per thread results.
+    memory_arena_t *scratch;
+} wq_context_t;
+
+typedef void (*wq_fn) (void *data, wq_context_t *context);
+
+// NOTE(Wes): Every queue has a lane per priority. Workers always take work
+// from the highest lane that has any, so between any two jobs a worker
+// running background work switches to newly added frame work. A long task in
+// the background lane should be split into jobs that keep the gaps short.
+typedef enum {
+    wq_lane_frame,      // Needed for the current frame, eg. tile rasterization.
+    wq_lane_normal,
+    wq_lane_background, // May span frames, eg. asset decode or pathfinding.
+    wq_lane_count
+} wq_lane_t;
+
+typedef struct {
+    wq_fn work_fn;
+    void *data;
+} wq_job_t;
+
+// NOTE(Wes): Counts the unfinished jobs of a batch added with add_jobs. A
+// batch can be chained after another batch's counter so its jobs are only
+// added once that counter reaches zero, which lets a frame's stages overlap
+// without waiting on the whole queue. Counters are owned by the caller, must
+// start zeroed and must not be reused before they reach zero.
+typedef struct wq_counter_t {
+    volatile i32 count;
+    volatile i32 lock;
+    struct wq_counter_t *waiting; // Batches that start when this one finishes.
+    struct wq_counter_t *next;    // In the waiting list of the batch this one is chained after.
+    wq_job_t *jobs;               // Until the batch starts.
+    u32 job_count;
+    u32 lane;
+} wq_counter_t;
+
+typedef b8 (*add_work_fn)(wq_t *, wq_lane_t lane, wq_fn, void *);
+// Runs jobs on the calling thread until all frame and normal work is done.
+// Background work is left running, wait on its counters instead.
 typedef void (*finish_work_fn)(wq_t *);
+// Adds a batch of jobs counted by counter. With after set the jobs are added
+// once after reaches zero so the jobs array must stay valid until then.
+typedef void (*add_jobs_fn)(wq_t *, wq_lane_t lane, wq_job_t *jobs, u32 job_count, wq_counter_t *counter, wq_counter_t *after);
+// Runs jobs of the counter's lane or higher on the calling thread until
+// counter reaches zero.
+typedef void (*wait_counter_fn)(wq_t *, wq_counter_t *counter);
+
+typedef void (*wq_range_fn)(void *user, u32 begin, u32 end, wq_context_t *context);
+// Calls fn on chunks of [0, count) from every thread of the queue and returns
+// once all are done. A grain of 0 picks the chunk size from how long earlier
+// calls with the same fn took.
+typedef void (*parallel_for_fn)(wq_t *, u32 count, u32 grain, wq_range_fn fn, void *user);
+
 typedef struct {
     wq_t *render_work_queue;
     add_work_fn add_work;
     finish_work_fn finish_work;
+    add_jobs_fn add_jobs;
+    wait_counter_fn wait_counter;
+    parallel_for_fn parallel_for;
 } game_work_queues_t;
 
 
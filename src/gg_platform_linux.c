@@ -0,0 +1,243 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gg_platform.h"
+
+#define GAME_LIB_NAME "gg_game.so"
+#define GAME_TEMP_LIB_NAME "gg_game_temp.so"
+
+static time_t get_last_modified(char *path)
+{
+    struct stat attr;
+    stat(path, &attr);
+    return attr.st_mtime;
+}
+
+static game_memory_t allocate_game_memory(void *base_address)
+{
+    game_memory_t memory = { 0 };
+    memory.permanent_store_size = Megabytes(64);
+    memory.transient_store_size = Megabytes(512);
+
+    // NOTE(Wes): The base address is only a hint. Pages are committed by the
+    // kernel on first touch so reserving the whole block up front is cheap.
+    u64 total_size = memory.transient_store_size + memory.permanent_store_size;
+    void *buffer = mmap(base_address,
+                        (size_t)total_size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_ANONYMOUS | MAP_PRIVATE,
+                        -1,
+                        0);
+    if (buffer == MAP_FAILED) {
+        return memory;
+    }
+
+    memory.permanent_store = (u8 *)buffer;
+    memory.transient_store = memory.permanent_store + memory.permanent_store_size;
+
+    return memory;
+}
+
+static void copy_file(char *existing_file_path, char *new_file_path)
+{
+    i32 src = open(existing_file_path, O_RDONLY);
+    if (src < 0) {
+        return;
+    }
+    i32 dest = open(new_file_path, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    if (dest < 0) {
+        close(src);
+        return;
+    }
+
+    char buffer[64 * 1024];
+    ssize_t bytes_read;
+    while ((bytes_read = read(src, buffer, sizeof(buffer))) > 0) {
+        if (write(dest, buffer, (size_t)bytes_read) != bytes_read) {
+            break;
+        }
+    }
+
+    close(dest);
+    close(src);
+}
+
+static void atomic_increment(i32 volatile *value)
+{
+    __sync_fetch_and_add(value, 1);
+}
+
+// Returns the new value.
+static i32 atomic_decrement(i32 volatile *value)
+{
+    return __sync_sub_and_fetch(value, 1);
+}
+
+static i32 atomic_cas(i32 volatile *destination, i32 new_value, i32 comparand)
+{
+    return __sync_val_compare_and_swap(destination, comparand, new_value);
+}
+
+// Full fence, no loads or stores move across it in either direction.
+static void memory_barrier(void)
+{
+    __sync_synchronize();
+}
+
+// Hint to the core that the thread is spinning.
+static void cpu_pause(void)
+{
+    __builtin_ia32_pause();
+}
+
+// Sleeps while *address holds expected. May return early for no reason so
+// callers check the value again.
+static void wait_on_address(i32 volatile *address, i32 expected)
+{
+    syscall(SYS_futex, (i32 *)address, FUTEX_WAIT_PRIVATE, expected, 0, 0, 0);
+}
+
+// Wakes up to count threads sleeping on address.
+static void wake_by_address(i32 volatile *address, i32 count)
+{
+    syscall(SYS_futex, (i32 *)address, FUTEX_WAKE_PRIVATE, count, 0, 0, 0);
+}
+
+typedef sem_t platform_semaphore_t;
+
+static void semaphore_init(platform_semaphore_t *semaphore, u32 initial_count)
+{
+    sem_init(semaphore, 0, initial_count);
+}
+
+static void semaphore_post(platform_semaphore_t *semaphore)
+{
+    sem_post(semaphore);
+}
+
+static void semaphore_wait(platform_semaphore_t *semaphore)
+{
+    while (sem_wait(semaphore) != 0 && errno == EINTR) {
+    }
+}
+
+#define THREAD_PROC(name) void *name(void *data)
+typedef THREAD_PROC(thread_proc_t);
+
+static void create_thread(thread_proc_t *proc, void *data)
+{
+    pthread_t thread;
+    pthread_create(&thread, 0, proc, data);
+    pthread_detach(thread);
+}
+
+// Monotonic wall clock in nanoseconds.
+static u64 get_wall_clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000ull + (u64)now.tv_nsec;
+}
+
+// CPU time used by every thread of the process in nanoseconds.
+static u64 get_process_cpu_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return (u64)now.tv_sec * 1000000000ull + (u64)now.tv_nsec;
+}
+
+static b8 read_sysfs_u32(const char *path, u32 *value)
+{
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    char text[32];
+    ssize_t size = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    if (size <= 0) {
+        return 0;
+    }
+    text[size] = 0;
+    *value = (u32)strtoul(text, 0, 10);
+    return 1;
+}
+
+// NOTE(Wes): Only the CPUs the process may run on are counted, so taskset
+// and container limits size the pool too. SMT siblings share a core and
+// package id in sysfs, without sysfs every CPU is taken to be its own core.
+static void get_cpu_topology(cpu_topology_t *topology)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        for (u32 cpu = 0; cpu < GG_MAX_CPUS && cpu < (u32)sysconf(_SC_NPROCESSORS_ONLN); ++cpu) {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    u32 core_keys[GG_MAX_CPUS];
+    u32 siblings[GG_MAX_CPUS];
+    u32 sibling_count = 0;
+    topology->logical_count = 0;
+    topology->physical_count = 0;
+    for (u32 cpu = 0; cpu < GG_MAX_CPUS; ++cpu) {
+        if (!CPU_ISSET(cpu, &set)) {
+            continue;
+        }
+        char path[96];
+        u32 core_id = cpu;
+        u32 package_id = 0;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/core_id", cpu);
+        if (read_sysfs_u32(path, &core_id)) {
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", cpu);
+            read_sysfs_u32(path, &package_id);
+        }
+        u32 key = (package_id << 16) | (core_id & 0xFFFF);
+
+        b8 seen = 0;
+        for (u32 i = 0; i < topology->physical_count; ++i) {
+            if (core_keys[i] == key) {
+                seen = 1;
+                break;
+            }
+        }
+        if (seen) {
+            siblings[sibling_count++] = cpu;
+        } else {
+            core_keys[topology->physical_count] = key;
+            topology->cpus[topology->physical_count++] = cpu;
+        }
+        ++topology->logical_count;
+    }
+    for (u32 i = 0; i < sibling_count; ++i) {
+        topology->cpus[topology->physical_count + i] = siblings[i];
+    }
+
+    if (!topology->logical_count) {
+        topology->logical_count = topology->physical_count = 1;
+        topology->cpus[0] = 0;
+    }
+}
+
+// Keeps the calling thread on one logical CPU. Returns 0 if it could not.
+static b8 pin_thread_to_cpu(u32 cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
@@ -1,10 +1,16 @@
 #include <copyfile.h>
+#include <dispatch/dispatch.h>
+#include <pthread.h>
 #include <sys/mman.h>
+#include <sys/sysctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <time.h>
 
+#define GAME_LIB_NAME "gg_game.dylib"
+#define GAME_TEMP_LIB_NAME "gg_game_temp.dylib"
+
 static time_t get_last_modified(char *path)
 {
     struct stat attr;
@@ -32,4 +38,112 @@ static game_memory_t allocate_game_memory(void *base_address)
 static void copy_file(char *existing_file_path, char *new_file_path)
 {
     copyfile(existing_file_path, new_file_path, 0, COPYFILE_ALL);
-}
\ No newline at end of file
+}
+static void atomic_increment(i32 volatile *value)
+{
+    __sync_fetch_and_add(value, 1);
+}
+
+// Returns the new value.
+static i32 atomic_decrement(i32 volatile *value)
+{
+    return __sync_sub_and_fetch(value, 1);
+}
+
+static i32 atomic_cas(i32 volatile *destination, i32 new_value, i32 comparand)
+{
+    return __sync_val_compare_and_swap(destination, comparand, new_value);
+}
+
+// Full fence, no loads or stores move across it in either direction.
+static void memory_barrier(void)
+{
+    __sync_synchronize();
+}
+
+// Hint to the core that the thread is spinning.
+static void cpu_pause(void)
+{
+    __builtin_ia32_pause();
+}
+
+// NOTE(Wes): The futex of Darwin. Private but stable, it is what libc++
+// uses to implement atomic waits.
+#define OSX_UL_COMPARE_AND_WAIT 1
+#define OSX_ULF_WAKE_ALL 0x100
+extern int __ulock_wait(u32 operation, void *address, u64 value, u32 timeout_us);
+extern int __ulock_wake(u32 operation, void *address, u64 wake_value);
+
+// Sleeps while *address holds expected. May return early for no reason so
+// callers check the value again.
+static void wait_on_address(i32 volatile *address, i32 expected)
+{
+    __ulock_wait(OSX_UL_COMPARE_AND_WAIT, (void *)address, (u32)expected, 0);
+}
+
+// Wakes up to count threads sleeping on address.
+static void wake_by_address(i32 volatile *address, i32 count)
+{
+    if (count >= 0x7FFFFFFF) {
+        __ulock_wake(OSX_UL_COMPARE_AND_WAIT | OSX_ULF_WAKE_ALL, (void *)address, 0);
+        return;
+    }
+    // NOTE(Wes): Fails once nothing is left sleeping.
+    for (i32 i = 0; i < count && __ulock_wake(OSX_UL_COMPARE_AND_WAIT, (void *)address, 0) == 0; ++i) {
+    }
+}
+
+typedef dispatch_semaphore_t platform_semaphore_t;
+
+static void semaphore_init(platform_semaphore_t *semaphore, u32 initial_count)
+{
+    *semaphore = dispatch_semaphore_create(initial_count);
+}
+
+static void semaphore_post(platform_semaphore_t *semaphore)
+{
+    dispatch_semaphore_signal(*semaphore);
+}
+
+static void semaphore_wait(platform_semaphore_t *semaphore)
+{
+    dispatch_semaphore_wait(*semaphore, DISPATCH_TIME_FOREVER);
+}
+
+#define THREAD_PROC(name) void *name(void *data)
+typedef THREAD_PROC(thread_proc_t);
+
+static void create_thread(thread_proc_t *proc, void *data)
+{
+    pthread_t thread;
+    pthread_create(&thread, 0, proc, data);
+    pthread_detach(thread);
+}
+
+// NOTE(Wes): macOS does not say which logical CPUs share a core so they are
+// listed in order.
+static void get_cpu_topology(cpu_topology_t *topology)
+{
+    i32 logical_count = 0;
+    i32 physical_count = 0;
+    size_t size = sizeof(logical_count);
+    if (sysctlbyname("hw.logicalcpu", &logical_count, &size, 0, 0) != 0 || logical_count < 1) {
+        logical_count = 1;
+    }
+    size = sizeof(physical_count);
+    if (sysctlbyname("hw.physicalcpu", &physical_count, &size, 0, 0) != 0 || physical_count < 1) {
+        physical_count = logical_count;
+    }
+    topology->logical_count = logical_count < GG_MAX_CPUS ? (u32)logical_count : GG_MAX_CPUS;
+    topology->physical_count = (u32)physical_count < topology->logical_count ? (u32)physical_count : topology->logical_count;
+    for (u32 cpu = 0; cpu < topology->logical_count; ++cpu) {
+        topology->cpus[cpu] = cpu;
+    }
+}
+
+// NOTE(Wes): macOS has no way to keep a thread on a CPU, the scheduler is
+// left to place it.
+static b8 pin_thread_to_cpu(u32 cpu)
+{
+    return 0;
+}
@@ -3,6 +3,9 @@
 
 #include "gg_platform.h"
 
+#define GAME_LIB_NAME "gg_game.dll"
+#define GAME_TEMP_LIB_NAME "gg_game_temp.dll"
+
 static time_t get_last_modified(char *path)
 {
     struct stat attr;
@@ -38,12 +41,123 @@ static void atomic_increment(i32 volatile *value)
     InterlockedIncrement((long volatile *)value);
 }
 
-static void atomic_decrement(i32 volatile *value)
+// Returns the new value.
+static i32 atomic_decrement(i32 volatile *value)
 {
-    InterlockedDecrement((long volatile *)value);
+    return InterlockedDecrement((long volatile *)value);
 }
 
 static i32 atomic_cas(i32 volatile *destination, i32 new_value, i32 comparand)
 {
     return InterlockedCompareExchange((long volatile *)destination, new_value, comparand);
-}
\ No newline at end of file
+}
+
+// Full fence, no loads or stores move across it in either direction.
+static void memory_barrier(void)
+{
+    MemoryBarrier();
+}
+
+// Hint to the core that the thread is spinning.
+static void cpu_pause(void)
+{
+    YieldProcessor();
+}
+
+// Sleeps while *address holds expected. May return early for no reason so
+// callers check the value again. Needs Synchronization.lib.
+static void wait_on_address(i32 volatile *address, i32 expected)
+{
+    WaitOnAddress(address, &expected, sizeof(expected), INFINITE);
+}
+
+// Wakes up to count threads sleeping on address.
+static void wake_by_address(i32 volatile *address, i32 count)
+{
+    if (count >= 0x7FFFFFFF) {
+        WakeByAddressAll((void *)address);
+        return;
+    }
+    for (i32 i = 0; i < count; ++i) {
+        WakeByAddressSingle((void *)address);
+    }
+}
+
+typedef HANDLE platform_semaphore_t;
+
+static void semaphore_init(platform_semaphore_t *semaphore, u32 initial_count)
+{
+    *semaphore = CreateSemaphoreA(0, initial_count, LONG_MAX, 0);
+}
+
+static void semaphore_post(platform_semaphore_t *semaphore)
+{
+    ReleaseSemaphore(*semaphore, 1, 0);
+}
+
+static void semaphore_wait(platform_semaphore_t *semaphore)
+{
+    WaitForSingleObject(*semaphore, INFINITE);
+}
+
+#define THREAD_PROC(name) DWORD WINAPI name(LPVOID data)
+typedef THREAD_PROC(thread_proc_t);
+
+static void create_thread(thread_proc_t *proc, void *data)
+{
+    HANDLE thread = CreateThread(0, 0, proc, data, 0, 0);
+    CloseHandle(thread);
+}
+
+// NOTE(Wes): Only the processor group of the calling thread is seen, which
+// is every CPU on machines with up to 64.
+static void get_cpu_topology(cpu_topology_t *topology)
+{
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION infos[256];
+    DWORD size = sizeof(infos);
+    u32 siblings[GG_MAX_CPUS];
+    u32 sibling_count = 0;
+    topology->logical_count = 0;
+    topology->physical_count = 0;
+    if (GetLogicalProcessorInformation(infos, &size)) {
+        u32 info_count = size / sizeof(infos[0]);
+        for (u32 i = 0; i < info_count; ++i) {
+            if (infos[i].Relationship != RelationProcessorCore) {
+                continue;
+            }
+            b8 first = 1;
+            for (u32 cpu = 0; cpu < GG_MAX_CPUS; ++cpu) {
+                if (!(infos[i].ProcessorMask & ((ULONG_PTR)1 << cpu))) {
+                    continue;
+                }
+                if (first) {
+                    topology->cpus[topology->physical_count++] = cpu;
+                    first = 0;
+                } else {
+                    siblings[sibling_count++] = cpu;
+                }
+                ++topology->logical_count;
+            }
+        }
+    }
+    for (u32 i = 0; i < sibling_count; ++i) {
+        topology->cpus[topology->physical_count + i] = siblings[i];
+    }
+
+    if (!topology->logical_count) {
+        SYSTEM_INFO system_info;
+        GetSystemInfo(&system_info);
+        topology->logical_count = system_info.dwNumberOfProcessors;
+        topology->logical_count = topology->logical_count < GG_MAX_CPUS ? topology->logical_count : GG_MAX_CPUS;
+        topology->physical_count = topology->logical_count;
+        for (u32 cpu = 0; cpu < topology->logical_count; ++cpu) {
+            topology->cpus[cpu] = cpu;
+        }
+    }
+}
+
+// Keeps the calling thread on one logical CPU. Returns 0 if it could not.
+static b8 pin_thread_to_cpu(u32 cpu)
+{
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+}
@@ -0,0 +1,307 @@
+#include "gg_profiler.h"
+#include "gg_render.h"
+
+#include <stdio.h>
+
+#if defined(GG_INTERNAL) && defined(GG_EDITOR)
+
+// NOTE(Wes): 3x5 glyphs for ' ' to '_', the top row in the high bits. Lower
+// case is drawn as upper case and anything missing as '?'.
+static const u16 profiler_font[64] = {
+    0x0000, 0x6282, 0x6282, 0x6282, 0x6282, 0x52A5, 0x6282, 0x6282, //   ! " # $ % & '
+    0x2922, 0x224A, 0x0AA8, 0x05D0, 0x0014, 0x01C0, 0x0002, 0x12A4, // ( ) * + , - . /
+    0x7B6F, 0x2C97, 0x62A7, 0x628E, 0x5BC9, 0x798E, 0x39EF, 0x7292, // 0 1 2 3 4 5 6 7
+    0x7BEF, 0x7BCE, 0x0410, 0x6282, 0x1511, 0x0E38, 0x4454, 0x6282, // 8 9 : ; < = > ?
+    0x6282, 0x2BED, 0x6BAE, 0x3923, 0x6B6E, 0x79A7, 0x79A4, 0x396B, // @ A B C D E F G
+    0x5BED, 0x7497, 0x126A, 0x5BAD, 0x4927, 0x5FED, 0x6B6D, 0x2B6A, // H I J K L M N O
+    0x6BA4, 0x2B73, 0x6BAD, 0x388E, 0x7492, 0x5B6F, 0x5B6A, 0x5BFD, // P Q R S T U V W
+    0x5AAD, 0x5A92, 0x72A7, 0x6926, 0x6282, 0x324B, 0x6282, 0x0007, // X Y Z [ \ ] ^ _
+};
+
+#define PROFILER_GLYPH_SCALE 2
+#define PROFILER_ADVANCE (4 * PROFILER_GLYPH_SCALE)
+#define PROFILER_LINE_HEIGHT (6 * PROFILER_GLYPH_SCALE)
+#define PROFILER_MARGIN 8
+#define PROFILER_PANEL_WIDTH 560
+#define PROFILER_GRAPH_HEIGHT 80
+#define PROFILER_BAR_WIDTH 4
+#define PROFILER_MAX_ROWS 28
+#define PROFILER_HEIGHT                                                                                  \
+    (2 * PROFILER_MARGIN + 4 * PROFILER_LINE_HEIGHT + PROFILER_GRAPH_HEIGHT + PROFILER_MARGIN +          \
+     (PROFILER_MAX_ROWS + 1) * PROFILER_LINE_HEIGHT + PROFILER_MARGIN)
+
+// Premultiplied, frame buffer order.
+#define PROFILER_COLOR_PANEL 0xC0000000
+#define PROFILER_COLOR_TEXT 0xFFFFFFFF
+#define PROFILER_COLOR_DIM 0xFF909090
+#define PROFILER_COLOR_GOOD 0xFF30C040
+#define PROFILER_COLOR_SLOW 0xFFE0C020
+#define PROFILER_COLOR_BAD 0xFFE03030
+
+static void profiler_fill(image_t *image, i32 x_min, i32 y_min, i32 x_max, i32 y_max, u32 color)
+{
+    x_min = gg_max(x_min, 0);
+    y_min = gg_max(y_min, 0);
+    x_max = gg_min(x_max, (i32)image->w);
+    y_max = gg_min(y_max, (i32)image->h);
+    for (i32 y = y_min; y < y_max; ++y) {
+        u32 *row = image->data + y * image->w;
+        for (i32 x = x_min; x < x_max; ++x) {
+            row[x] = color;
+        }
+    }
+}
+
+static void profiler_text(image_t *image, i32 x, i32 y, const char *text, u32 color)
+{
+    for (const char *at = text; *at; ++at, x += PROFILER_ADVANCE) {
+        char c = *at;
+        if (c >= 'a' && c <= 'z') {
+            c -= 'a' - 'A';
+        }
+        u16 glyph = (c >= ' ' && c <= '_') ? profiler_font[c - ' '] : profiler_font['?' - ' '];
+        for (i32 bit = 0; bit < 15; ++bit) {
+            if (glyph & (1 << (14 - bit))) {
+                i32 gx = x + (bit % 3) * PROFILER_GLYPH_SCALE;
+                i32 gy = y + (bit / 3) * PROFILER_GLYPH_SCALE;
+                profiler_fill(image, gx, gy, gx + PROFILER_GLYPH_SCALE, gy + PROFILER_GLYPH_SCALE, color);
+            }
+        }
+    }
+}
+
+// Returns how many of the history's frames are still stored.
+static u32 profiler_window_size(dbg_profile_t *profile)
+{
+    return gg_min(profile->history_count, DBG_FRAME_HISTORY);
+}
+
+static dbg_frame_t *profiler_frame(dbg_profile_t *profile, u32 index)
+{
+    return &profile->history[index % DBG_FRAME_HISTORY];
+}
+
+void profiler_update(profiler_overlay_t *overlay, dbg_profile_t *profile, game_input_t *input)
+{
+    // NOTE(Wes): Buttons only act on the press, not every frame they are held.
+    b8 down[profiler_button_count] = {0};
+    for (u32 i = 0; i < GG_MAX_CONTROLLERS; ++i) {
+        game_controller_input_t *controller = &input->controllers[i];
+        down[profiler_button_toggle] |= controller->editor_profiler.ended_down;
+        down[profiler_button_prev] |= controller->editor_profiler_prev.ended_down;
+        down[profiler_button_next] |= controller->editor_profiler_next.ended_down;
+        down[profiler_button_slowest] |= controller->editor_profiler_slowest.ended_down;
+    }
+    b8 pressed[profiler_button_count];
+    for (u32 i = 0; i < profiler_button_count; ++i) {
+        pressed[i] = down[i] && !overlay->was_down[i];
+        overlay->was_down[i] = down[i];
+    }
+
+    if (pressed[profiler_button_toggle]) {
+        overlay->enabled = !overlay->enabled;
+        overlay->selected_frame = -1;
+        if (profile) {
+            profile->history_paused = 0;
+        }
+    }
+
+    u32 window_size = profile ? profiler_window_size(profile) : 0;
+    if (!overlay->enabled || !window_size) {
+        return;
+    }
+
+    i32 newest = (i32)profile->history_count - 1;
+    i32 oldest = (i32)(profile->history_count - window_size);
+    if (pressed[profiler_button_slowest]) {
+        u64 slowest_ns = 0;
+        for (i32 i = oldest; i <= newest; ++i) {
+            if (profiler_frame(profile, i)->ns >= slowest_ns) {
+                slowest_ns = profiler_frame(profile, i)->ns;
+                overlay->selected_frame = i;
+            }
+        }
+    }
+    if (pressed[profiler_button_prev]) {
+        if (overlay->selected_frame < 0) {
+            overlay->selected_frame = newest;
+        } else if (overlay->selected_frame > oldest) {
+            --overlay->selected_frame;
+        }
+    }
+    if (pressed[profiler_button_next] && overlay->selected_frame >= 0) {
+        if (++overlay->selected_frame > newest) {
+            overlay->selected_frame = -1;
+        }
+    }
+
+    profile->history_paused = overlay->selected_frame >= 0;
+}
+
+typedef struct {
+    u64 cycles;
+    u32 calls;
+    u32 hits;
+} profiler_node_stats_t;
+
+static void profiler_draw_tree(image_t *image,
+                               dbg_profile_t *profile,
+                               profiler_node_stats_t *stats,
+                               f64 ms_per_cycle,
+                               u16 parent,
+                               u32 depth,
+                               i32 x,
+                               i32 *y,
+                               u32 *row_count)
+{
+    for (u32 i = 0; i < profile->node_count && *row_count < PROFILER_MAX_ROWS; ++i) {
+        dbg_node_t *node = &profile->nodes[i];
+        if (node->parent != parent || !stats[i].calls) {
+            continue;
+        }
+
+        char line[128];
+        i32 indent = depth < 8 ? (i32)depth : 8;
+        snprintf(line,
+                 sizeof(line),
+                 "%*s%-*.*s %7.2f %8.2f %6u %9u",
+                 indent,
+                 "",
+                 24 - indent,
+                 24 - indent,
+                 profile->blocks[node->block].name,
+                 stats[i].cycles * ms_per_cycle,
+                 stats[i].cycles / 1e6,
+                 stats[i].calls,
+                 stats[i].hits);
+        profiler_text(image, x, *y, line, PROFILER_COLOR_TEXT);
+        *y += PROFILER_LINE_HEIGHT;
+        ++*row_count;
+
+        profiler_draw_tree(image, profile, stats, ms_per_cycle, (u16)i, depth + 1, x, y, row_count);
+    }
+}
+
+void profiler_alloc_overlay(profiler_overlay_t *overlay, memory_arena_t *image_arena)
+{
+    overlay->image.data = push_array(image_arena, GG_MAX_FRAME_WIDTH * PROFILER_HEIGHT, u32);
+}
+
+void profiler_push_overlay(profiler_overlay_t *overlay,
+                           dbg_profile_t *profile,
+                           render_queue_t *queue,
+                           u32 frame_width,
+                           u32 frame_height)
+{
+    if (!overlay->enabled || !profile) {
+        return;
+    }
+
+    assert(frame_width <= GG_MAX_FRAME_WIDTH);
+    u32 height = gg_min(PROFILER_HEIGHT, frame_height);
+    image_t *image = &overlay->image;
+    image->w = frame_width;
+    image->h = height;
+    memset(image->data, 0, frame_width * height * sizeof(u32));
+
+    i32 x = 2 * PROFILER_MARGIN;
+    i32 y = 2 * PROFILER_MARGIN;
+    profiler_fill(image, PROFILER_MARGIN, PROFILER_MARGIN, PROFILER_MARGIN + PROFILER_PANEL_WIDTH, height, PROFILER_COLOR_PANEL);
+
+    u32 window_size = profiler_window_size(profile);
+    if (!window_size) {
+        profiler_text(image, x, y, "PROFILER: NO FRAMES YET", PROFILER_COLOR_TEXT);
+        render_push_layer(queue, image, 0, 0, 0);
+        return;
+    }
+    u32 oldest = profile->history_count - window_size;
+    i32 selected = overlay->selected_frame;
+
+    // Percentiles over the history.
+    f64 sorted_ms[DBG_FRAME_HISTORY];
+    u64 total_ns = 0;
+    u64 total_cycles = 0;
+    for (u32 i = 0; i < window_size; ++i) {
+        dbg_frame_t *frame = profiler_frame(profile, oldest + i);
+        f64 ms = frame->ns / 1e6;
+        u32 j = i;
+        for (; j > 0 && sorted_ms[j - 1] > ms; --j) {
+            sorted_ms[j] = sorted_ms[j - 1];
+        }
+        sorted_ms[j] = ms;
+        total_ns += frame->ns;
+        total_cycles += frame->cycles;
+    }
+
+    char line[128];
+    if (selected >= 0) {
+        dbg_frame_t *frame = profiler_frame(profile, selected);
+        snprintf(line, sizeof(line), "PROFILER  FRAME %d  %.2f MS  PAUSED", selected, frame->ns / 1e6);
+    } else {
+        snprintf(line, sizeof(line), "PROFILER  AVERAGE OF %u FRAMES", window_size);
+    }
+    profiler_text(image, x, y, line, PROFILER_COLOR_TEXT);
+    y += PROFILER_LINE_HEIGHT;
+    snprintf(line,
+             sizeof(line),
+             "MS P50 %.2f P90 %.2f P99 %.2f MAX %.2f  FPS %.1f",
+             sorted_ms[(window_size - 1) * 50 / 100],
+             sorted_ms[(window_size - 1) * 90 / 100],
+             sorted_ms[(window_size - 1) * 99 / 100],
+             sorted_ms[window_size - 1],
+             total_ns ? window_size * 1e9 / total_ns : 0.0);
+    profiler_text(image, x, y, line, PROFILER_COLOR_TEXT);
+    y += PROFILER_LINE_HEIGHT;
+    profiler_text(image, x, y, ", . STEP FRAMES  / SLOWEST  I CLOSE", PROFILER_COLOR_DIM);
+    y += 2 * PROFILER_LINE_HEIGHT;
+
+    // NOTE(Wes): The graph spans twice the frame budget, with a line at the
+    // budget. Frames over it are yellow, over twice it red.
+    f64 budget_ms = 1000.0 / GG_TARGET_FPS;
+    i32 graph_bottom = y + PROFILER_GRAPH_HEIGHT;
+    for (u32 i = 0; i < window_size; ++i) {
+        u32 index = oldest + i;
+        f64 ms = profiler_frame(profile, index)->ns / 1e6;
+        f64 bar_scale = ms < 2.0 * budget_ms ? ms / (2.0 * budget_ms) : 1.0;
+        i32 bar_height = (i32)(bar_scale * PROFILER_GRAPH_HEIGHT);
+        u32 color = ms > 2.0 * budget_ms ? PROFILER_COLOR_BAD : (ms > budget_ms ? PROFILER_COLOR_SLOW : PROFILER_COLOR_GOOD);
+        if ((i32)index == selected) {
+            color = PROFILER_COLOR_TEXT;
+        }
+        i32 bar_x = x + (i32)i * PROFILER_BAR_WIDTH;
+        profiler_fill(image, bar_x, graph_bottom - bar_height, bar_x + PROFILER_BAR_WIDTH - 1, graph_bottom, color);
+    }
+    i32 budget_y = graph_bottom - PROFILER_GRAPH_HEIGHT / 2;
+    profiler_fill(image, x, budget_y, x + DBG_FRAME_HISTORY * PROFILER_BAR_WIDTH, budget_y + 1, PROFILER_COLOR_DIM);
+    y = graph_bottom + PROFILER_MARGIN;
+
+    // NOTE(Wes): Either the inspected frame or the average of the history.
+    profiler_node_stats_t stats[DBG_MAX_NODES] = {0};
+    f64 ms_per_cycle = total_cycles ? (total_ns / 1e6) / total_cycles : 0.0;
+    u32 first = selected >= 0 ? (u32)selected : oldest;
+    u32 count = selected >= 0 ? 1 : window_size;
+    for (u32 i = 0; i < count; ++i) {
+        dbg_frame_t *frame = profiler_frame(profile, first + i);
+        for (u32 node = 0; node < profile->node_count; ++node) {
+            stats[node].cycles += frame->node_cycles[node];
+            stats[node].calls += frame->node_calls[node];
+            stats[node].hits += frame->node_hits[node];
+        }
+    }
+    for (u32 node = 0; node < profile->node_count; ++node) {
+        // NOTE(Wes): Rounded up so blocks that ran at all stay in the tree.
+        stats[node].cycles /= count;
+        stats[node].calls = (stats[node].calls + count - 1) / count;
+        stats[node].hits /= count;
+    }
+
+    snprintf(line, sizeof(line), "%-24s %7s %8s %6s %9s", "BLOCK", "MS", "MCYCLES", "CALLS", "HITS");
+    profiler_text(image, x, y, line, PROFILER_COLOR_DIM);
+    y += PROFILER_LINE_HEIGHT;
+    u32 row_count = 0;
+    profiler_draw_tree(image, profile, stats, ms_per_cycle, DBG_NO_PARENT, 0, x, &y, &row_count);
+
+    render_push_layer(queue, image, 0, 0, 0);
+}
+
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "gg_types.h"
+
+// Handles the overlay's buttons. The toggle shows and hides the overlay, prev
+// and next step through the frame history and slowest jumps to the slowest
+// frame in it. Inspecting a frame pauses the profile's history until next
+// steps past the newest frame or the overlay is hidden.
+void profiler_update(profiler_overlay_t *overlay, dbg_profile_t *profile, game_input_t *input);
+
+// Pushes the overlay's image, big enough for the largest frame.
+void profiler_alloc_overlay(profiler_overlay_t *overlay, memory_arena_t *image_arena);
+
+// Draws the frame time graph, percentiles and block tree of either the
+// inspected frame or the average of the history into the overlay's image and
+// pushes it as a layer over the top of the frame.
+void profiler_push_overlay(profiler_overlay_t *overlay,
+                           dbg_profile_t *profile,
+                           render_queue_t *queue,
+                           u32 frame_width,
+                           u32 frame_height);
@@ -5,10 +5,14 @@
 
 #include "xmmintrin.h"
 
+#include <string.h>
+
 typedef enum {
     render_type_clear,
     render_type_image,
-    render_type_rect
+    render_type_rect,
+    render_type_layer,
+    render_type_count
 } render_type_t;
 
 typedef struct {
@@ -27,7 +31,7 @@ typedef struct {
     v2 size;
     v4 tint;
     f32 rotation; // Radians
-    image_t *image;
+    sprite_t sprite;
     image_t *normals;
     light_t *lights;
     u32 num_lights;
@@ -39,6 +43,14 @@ typedef struct {
     f32 border_size;
 } render_cmd_rect_t;
 
+typedef struct {
+    render_cmd_header_t header;
+    image_t *image; // Frame buffer pixel order.
+    i32 x;
+    i32 y;
+    b8 opaque;
+} render_cmd_layer_t;
+
 static inline v4 read_frame_buffer_color(u32 buffer)
 {
     return COLOR(((buffer >> 24) & 0xFF) / 255.0f,
@@ -95,10 +107,16 @@ static inline v4 linear_blend(v4 color, v4 dest)
     return v4_add(v4_mul(dest, inv_alpha), v4_mul(color, a));
 }
 
-static inline v4 linear_blend_tint(v4 color, v4 tint, v4 dest)
+// NOTE(Wes): Image texels are premultiplied so they are not scaled by their
+// alpha again when blending.
+static inline v4 premultiplied_blend_tint(v4 color, v4 tint, v4 dest)
 {
     color = v4_hadamard(color, tint);
-    return linear_blend(color, dest);
+    v4 result = v4_add(v4_mul(dest, 1.0f - color.a), color);
+    result.r = kmin(result.r, 1.0f);
+    result.g = kmin(result.g, 1.0f);
+    result.b = kmin(result.b, 1.0f);
+    return result;
 }
 
 // NOTE(Wes): Handle blending of texel from textures directly.
@@ -129,7 +147,23 @@ static inline void linear_blend_texel(u32 texel, u32 *dest)
     *dest = temp;
 }
 
-static void render_clear(render_cmd_clear_t *cmd, game_frame_buffer_t *frame_buffer, aabb2i_t clip_rect)
+// NOTE(Wes): Overdraw counters are one u32 per pixel, rows packed without
+// the frame buffer's pitch. Kernels are passed 0 unless the overdraw view is
+// enabled.
+static inline u32 *render_overdraw_pixel(u32 *overdraw, game_frame_buffer_t *frame_buffer, i32 x, i32 y)
+{
+    return overdraw + y * frame_buffer->w + x;
+}
+
+static void render_count_span(u32 *overdraw, game_frame_buffer_t *frame_buffer, i32 x_min, i32 x_max, i32 y)
+{
+    u32 *count = render_overdraw_pixel(overdraw, frame_buffer, x_min, y);
+    for (i32 x = x_min; x < x_max; ++x) {
+        ++*count++;
+    }
+}
+
+static void render_clear(render_cmd_clear_t *cmd, game_frame_buffer_t *frame_buffer, aabb2i_t clip_rect, u32 *overdraw)
 {
     for (i32 y = clip_rect.y_min; y < clip_rect.y_max; ++y) {
         u32 *pixels = (u32 *)(frame_buffer->data + y * frame_buffer->pitch);
@@ -137,6 +171,110 @@ static void render_clear(render_cmd_clear_t *cmd, game_frame_buffer_t *frame_buf
             pixels[x] = (u8)(cmd->color.a * 255.0f + 0.5f) << 24 | (u8)(cmd->color.r * 255.0f + 0.5f) << 16 |
                         (u8)(cmd->color.g * 255.0f + 0.5f) << 8 | (u8)(cmd->color.b * 255.0f + 0.5f) << 0;
         }
+        if (overdraw) {
+            render_count_span(overdraw, frame_buffer, clip_rect.x_min, clip_rect.x_max, y);
+        }
+    }
+}
+
+// NOTE(Wes): Premultiplied "over" of a row of frame buffer ordered pixels:
+// dest = src + dest * (1 - src_alpha). Computed in 16 bit lanes using
+// (x + 128 + ((x + 128) >> 8)) >> 8 as an exact divide by 255.
+static void render_blend_row(u32 *dest, u32 *src, i32 count)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i bias = _mm_set1_epi16(128);
+    __m128i two_fifty_five = _mm_set1_epi16(255);
+
+    i32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((__m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((__m128i *)(dest + i));
+
+        // Broadcast 255 - alpha of each pixel to all four of its 16 bit channels.
+        __m128i a = _mm_srli_epi32(s, 24);
+        a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+        __m128i inv_a = _mm_sub_epi16(two_fifty_five, a);
+        __m128i inv_a_lo = _mm_unpacklo_epi32(inv_a, inv_a);
+        __m128i inv_a_hi = _mm_unpackhi_epi32(inv_a, inv_a);
+
+        __m128i d_lo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inv_a_lo);
+        __m128i d_hi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inv_a_hi);
+        d_lo = _mm_add_epi16(d_lo, bias);
+        d_hi = _mm_add_epi16(d_hi, bias);
+        d_lo = _mm_srli_epi16(_mm_add_epi16(d_lo, _mm_srli_epi16(d_lo, 8)), 8);
+        d_hi = _mm_srli_epi16(_mm_add_epi16(d_hi, _mm_srli_epi16(d_hi, 8)), 8);
+
+        __m128i out = _mm_adds_epu8(s, _mm_packus_epi16(d_lo, d_hi));
+        _mm_storeu_si128((__m128i *)(dest + i), out);
+    }
+
+    for (; i < count; ++i) {
+        u32 s = src[i];
+        u32 d = dest[i];
+        u32 inv_a = 255 - (s >> 24);
+        u32 result = 0;
+        for (u32 shift = 0; shift < 32; shift += 8) {
+            u32 x = ((d >> shift) & 0xFF) * inv_a + 128;
+            x = (x + (x >> 8)) >> 8;
+            u32 c = ((s >> shift) & 0xFF) + x;
+            result |= (c > 255 ? 255 : c) << shift;
+        }
+        dest[i] = result;
+    }
+}
+
+// One channel at a time with a plain rounded division, to check
+// render_blend_row against.
+static void render_blend_row_reference(u32 *dest, u32 *src, i32 count)
+{
+    for (i32 i = 0; i < count; ++i) {
+        u32 inv_a = 255 - (src[i] >> 24);
+        u32 result = 0;
+        for (u32 shift = 0; shift < 32; shift += 8) {
+            u32 c = ((src[i] >> shift) & 0xFF) + (((dest[i] >> shift) & 0xFF) * inv_a + 127) / 255;
+            result |= (c > 255 ? 255 : c) << shift;
+        }
+        dest[i] = result;
+    }
+}
+
+static void render_layer(render_cmd_layer_t *cmd, game_frame_buffer_t *frame_buffer, aabb2i_t clip_rect, u32 *overdraw)
+{
+    image_t *image = cmd->image;
+    aabb2i_t fill_rect = AABB2I(clip_rect.x_min, cmd->y, clip_rect.x_max, cmd->y + (i32)image->h);
+    fill_rect = aabb2i_intersect(fill_rect, clip_rect);
+    if (!aabb2i_has_area(fill_rect)) {
+        return;
+    }
+
+    // NOTE(Wes): The layer repeats horizontally so each row is copied in spans
+    // that wrap back to the start of the source row.
+    i32 w = (i32)image->w;
+    i32 src_x_start = (fill_rect.x_min - cmd->x) % w;
+    if (src_x_start < 0) {
+        src_x_start += w;
+    }
+
+    for (i32 y = fill_rect.y_min; y < fill_rect.y_max; ++y) {
+        u32 *src_row = image->data + (y - cmd->y) * w;
+        u32 *dest = (u32 *)(frame_buffer->data + y * frame_buffer->pitch) + fill_rect.x_min;
+        i32 remaining = fill_rect.x_max - fill_rect.x_min;
+        i32 src_x = src_x_start;
+        while (remaining > 0) {
+            i32 span = gg_min(w - src_x, remaining);
+            if (cmd->opaque) {
+                memcpy(dest, src_row + src_x, span * sizeof(u32));
+            } else {
+                render_blend_row(dest, src_row + src_x, span);
+            }
+            dest += span;
+            remaining -= span;
+            src_x = 0;
+        }
+        if (overdraw) {
+            render_count_span(overdraw, frame_buffer, fill_rect.x_min, fill_rect.x_max, y);
+        }
     }
 }
 
@@ -150,9 +288,13 @@ typedef struct {
 } pixel_t;
 #endif
 
-static void render_image(render_cmd_image_t *cmd, camera_t *cam, game_frame_buffer_t *frame_buffer, aabb2i_t clip_rect)
+static void render_image(render_cmd_image_t *cmd,
+                         camera_t *cam,
+                         game_frame_buffer_t *frame_buffer,
+                         aabb2i_t clip_rect,
+                         u32 *overdraw)
 {
-    START_COUNTER(render_image);
+    BEGIN_BLOCK(render_image);
     basis_t basis = cmd->header.basis;
 
     v2 origin = v2_mul(basis.origin, cam->units_to_pixels);
@@ -199,12 +341,12 @@ static void render_image(render_cmd_image_t *cmd, camera_t *cam, game_frame_buff
     fill_rect = aabb2i_intersect(fill_rect, clip_rect);
 
     if (!aabb2i_has_area(fill_rect)) {
-        END_COUNTER(render_image);
+        END_BLOCK(render_image);
         return;
     }
 #else
     if (!aabb2i_has_area(fill_rect)) {
-        END_COUNTER(render_image);
+        END_BLOCK(render_image);
         return;
     }
 
@@ -248,10 +390,12 @@ static void render_image(render_cmd_image_t *cmd, camera_t *cam, game_frame_buff
     __m128 n_y_axis_x4 = _mm_set1_ps(n_y_axis.x);
     __m128 n_y_axis_y4 = _mm_set1_ps(n_y_axis.y);
 
-    image_t *texture = cmd->image;
-    u32 *texture_data = texture->data;
-    u32 texture_width = texture->w;
-    u32 texture_height = texture->h;
+    sprite_t *sprite = &cmd->sprite;
+    u32 texture_pitch = sprite->image->w;
+    u32 *texture_data = sprite->image->data + sprite->y * texture_pitch + sprite->x;
+    u32 texture_width = sprite->w;
+    u32 texture_height = sprite->h;
+    __m128i texture_pitch4 = _mm_set1_epi32(texture_pitch);
     __m128i texture_width4 = _mm_set1_epi32(texture_width);
     __m128i texture_height4 = _mm_set1_epi32(texture_height);
     __m128 texture_width4f = _mm_cvtepi32_ps(texture_width4);
@@ -260,8 +404,17 @@ static void render_image(render_cmd_image_t *cmd, camera_t *cam, game_frame_buff
 
     __m128 zero4 = _mm_setzero_ps();
     __m128 one4 = _mm_set1_ps(1.0f);
-    __m128i zero4i = _mm_setzero_si128();
-    __m128i one4i = _mm_set1_epi32(1);
+
+    assert(texture_width >= 2 && texture_height >= 2);
+    __m128 texture_width4fm1 = _mm_sub_ps(texture_width4f, one4);
+    __m128 texture_height4fm1 = _mm_sub_ps(texture_height4f, one4);
+    __m128i texture_width4m2 = _mm_set1_epi32(texture_width - 2);
+    __m128i texture_height4m2 = _mm_set1_epi32(texture_height - 2);
+
+    __m128 tint_r4 = _mm_set1_ps(cmd->tint.r);
+    __m128 tint_g4 = _mm_set1_ps(cmd->tint.g);
+    __m128 tint_b4 = _mm_set1_ps(cmd->tint.b);
+    __m128 tint_a4 = _mm_set1_ps(cmd->tint.a);
 
     __m128i texel_mask = _mm_set1_epi32(0x000000FF);
     __m128 inv_255 = _mm_set1_ps(1.0f / 255.0f);
@@ -273,7 +426,7 @@ static void render_image(render_cmd_image_t *cmd, camera_t *cam, game_frame_buff
     __m128i fourth_mask = _mm_setr_epi32(0, 0, 0, 0xFFFFFFFF);
 
     u8 *fb_data = frame_buffer->data;
-    START_COUNTER(process_pixel);
+    BEGIN_BLOCK(process_pixel);
     for (i32 y = fill_rect.y_min; y < fill_rect.y_max; y++) {
         __m128 p_orig_y4 = _mm_set1_ps(y - origin.y);
         __m128i clip_mask = start_clip_mask;
@@ -307,26 +460,23 @@ static void render_image(render_cmd_image_t *cmd, camera_t *cam, game_frame_buff
             u4 = _mm_max_ps(_mm_min_ps(u4, one4), zero4);
             v4 = _mm_max_ps(_mm_min_ps(v4, one4), zero4);
 
-            // Calculate the actual texel position in the texture
-            // TODO(Wes): Formalize texture boundaries
-            __m128 texture_width4fm1 = _mm_sub_ps(texture_width4f, one4);
-            __m128 texture_height4fm1 = _mm_sub_ps(texture_height4f, one4);
+            // Calculate the actual texel position in the texture. The
+            // top left texel of the 2x2 block is kept one texel in from the
+            // right and bottom edges so the block never reads outside the
+            // sprite, the blend factor becomes 1 there instead.
             __m128 texel_x4 = _mm_mul_ps(u4, texture_width4fm1);
             __m128 texel_y4 = _mm_mul_ps(v4, texture_height4fm1);
+            __m128i texture_x4 = _mm_min_epi32(_mm_cvttps_epi32(texel_x4), texture_width4m2);
+            __m128i texture_y4 = _mm_min_epi32(_mm_cvttps_epi32(texel_y4), texture_height4m2);
 
             // Calculate the blend factor for surrounding pixels
-            __m128i texture_x4 = _mm_cvttps_epi32(texel_x4);
-            __m128i texture_y4 = _mm_cvttps_epi32(texel_y4);
             __m128 subpixel_x4 = _mm_sub_ps(texel_x4, _mm_cvtepi32_ps(texture_x4));
             __m128 subpixel_y4 = _mm_sub_ps(texel_y4, _mm_cvtepi32_ps(texture_y4));
             __m128 inv_subpixel_x4 = _mm_sub_ps(one4, subpixel_x4);
             __m128 inv_subpixel_y4 = _mm_sub_ps(one4, subpixel_y4);
 
-            texture_x4 = _mm_max_epi32(_mm_min_epi32(texture_x4, _mm_sub_epi32(texture_width4, one4i)), zero4i);
-            texture_y4 = _mm_max_epi32(_mm_min_epi32(texture_y4, _mm_sub_epi32(texture_height4, one4i)), zero4i);
-
             // TODO(Wes): This is SSE4. We need to find a way to do this mul in SSE2.
-            __m128i texture_index = _mm_add_epi32(texture_x4, _mm_mullo_epi32(texture_width4, texture_y4));
+            __m128i texture_index = _mm_add_epi32(texture_x4, _mm_mullo_epi32(texture_pitch4, texture_y4));
 
             u32 texture_index0 = m128i_access(texture_index, 0);
             u32 texture_index1 = m128i_access(texture_index, 1);
@@ -340,14 +490,14 @@ static void render_image(render_cmd_image_t *cmd, camera_t *cam, game_frame_buff
             __m128i sample_a = _mm_setr_epi32(*base_addr1, *base_addr2, *base_addr3, *base_addr4);
             __m128i sample_b =
                 _mm_setr_epi32(*(base_addr1 + 1), *(base_addr2 + 1), *(base_addr3 + 1), *(base_addr4 + 1));
-            __m128i sample_c = _mm_setr_epi32(*(base_addr1 + texture_width),
-                                              *(base_addr2 + texture_width),
-                                              *(base_addr3 + texture_width),
-                                              *(base_addr4 + texture_width));
-            __m128i sample_d = _mm_setr_epi32(*(base_addr1 + texture_width + 1),
-                                              *(base_addr2 + texture_width + 1),
-                                              *(base_addr3 + texture_width + 1),
-                                              *(base_addr4 + texture_width + 1));
+            __m128i sample_c = _mm_setr_epi32(*(base_addr1 + texture_pitch),
+                                              *(base_addr2 + texture_pitch),
+                                              *(base_addr3 + texture_pitch),
+                                              *(base_addr4 + texture_pitch));
+            __m128i sample_d = _mm_setr_epi32(*(base_addr1 + texture_pitch + 1),
+                                              *(base_addr2 + texture_pitch + 1),
+                                              *(base_addr3 + texture_pitch + 1),
+                                              *(base_addr4 + texture_pitch + 1));
 
             // Pack the 4 samples into 4 texels (rrrr, gggg, bbbb, aaaa)
             __m128i texel_a_a4i = _mm_and_si128(texel_mask, sample_a);
@@ -391,6 +541,21 @@ static void render_image(render_cmd_image_t *cmd, camera_t *cam, game_frame_buff
             __m128 texel_d_g4 = _mm_mul_ps(_mm_cvtepi32_ps(texel_d_g4i), inv_255);
             __m128 texel_d_b4 = _mm_mul_ps(_mm_cvtepi32_ps(texel_d_b4i), inv_255);
 
+            // NOTE(Wes): Texels are stored in (approximate) srgb space so
+            // square them to filter and blend in linear space.
+            texel_a_r4 = _mm_mul_ps(texel_a_r4, texel_a_r4);
+            texel_a_g4 = _mm_mul_ps(texel_a_g4, texel_a_g4);
+            texel_a_b4 = _mm_mul_ps(texel_a_b4, texel_a_b4);
+            texel_b_r4 = _mm_mul_ps(texel_b_r4, texel_b_r4);
+            texel_b_g4 = _mm_mul_ps(texel_b_g4, texel_b_g4);
+            texel_b_b4 = _mm_mul_ps(texel_b_b4, texel_b_b4);
+            texel_c_r4 = _mm_mul_ps(texel_c_r4, texel_c_r4);
+            texel_c_g4 = _mm_mul_ps(texel_c_g4, texel_c_g4);
+            texel_c_b4 = _mm_mul_ps(texel_c_b4, texel_c_b4);
+            texel_d_r4 = _mm_mul_ps(texel_d_r4, texel_d_r4);
+            texel_d_g4 = _mm_mul_ps(texel_d_g4, texel_d_g4);
+            texel_d_b4 = _mm_mul_ps(texel_d_b4, texel_d_b4);
+
             // Optimized linear blend
             __m128 c0 = _mm_mul_ps(subpixel_x4, subpixel_y4);
             __m128 c1 = _mm_mul_ps(inv_subpixel_x4, subpixel_y4);
@@ -404,6 +569,10 @@ static void render_image(render_cmd_image_t *cmd, camera_t *cam, game_frame_buff
                                            _mm_add_ps(_mm_mul_ps(texel_b_g4, c2), _mm_mul_ps(texel_a_g4, c3)));
             __m128 blended_b4 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(texel_d_b4, c0), _mm_mul_ps(texel_c_b4, c1)),
                                            _mm_add_ps(_mm_mul_ps(texel_b_b4, c2), _mm_mul_ps(texel_a_b4, c3)));
+            blended_a4 = _mm_mul_ps(blended_a4, tint_a4);
+            blended_r4 = _mm_mul_ps(blended_r4, tint_r4);
+            blended_g4 = _mm_mul_ps(blended_g4, tint_g4);
+            blended_b4 = _mm_mul_ps(blended_b4, tint_b4);
 
             __m128i *fb_pixel = (__m128i *)&fb_data[(x * GG_BYTES_PP) + y * frame_buffer->pitch];
             __m128i fb_pixel_packed = _mm_load_si128(fb_pixel);
@@ -420,11 +589,20 @@ static void render_image(render_cmd_image_t *cmd, camera_t *cam, game_frame_buff
             __m128 fb_pixel_r4 = _mm_mul_ps(_mm_cvtepi32_ps(fb_pixel_r4i), inv_255);
             __m128 fb_pixel_a4 = _mm_mul_ps(_mm_cvtepi32_ps(fb_pixel_a4i), inv_255);
 
+            fb_pixel_r4 = _mm_mul_ps(fb_pixel_r4, fb_pixel_r4);
+            fb_pixel_g4 = _mm_mul_ps(fb_pixel_g4, fb_pixel_g4);
+            fb_pixel_b4 = _mm_mul_ps(fb_pixel_b4, fb_pixel_b4);
+
+            // NOTE(Wes): Texels are premultiplied so this is a plain "over".
             __m128 inv_alpha4 = _mm_sub_ps(one4, blended_a4);
-            fb_pixel_r4 = _mm_add_ps(_mm_mul_ps(fb_pixel_r4, inv_alpha4), _mm_mul_ps(blended_r4, blended_a4));
-            fb_pixel_g4 = _mm_add_ps(_mm_mul_ps(fb_pixel_g4, inv_alpha4), _mm_mul_ps(blended_g4, blended_a4));
-            fb_pixel_b4 = _mm_add_ps(_mm_mul_ps(fb_pixel_b4, inv_alpha4), _mm_mul_ps(blended_b4, blended_a4));
-            fb_pixel_a4 = _mm_add_ps(_mm_mul_ps(fb_pixel_a4, inv_alpha4), _mm_mul_ps(blended_a4, blended_a4));
+            fb_pixel_r4 = _mm_add_ps(_mm_mul_ps(fb_pixel_r4, inv_alpha4), blended_r4);
+            fb_pixel_g4 = _mm_add_ps(_mm_mul_ps(fb_pixel_g4, inv_alpha4), blended_g4);
+            fb_pixel_b4 = _mm_add_ps(_mm_mul_ps(fb_pixel_b4, inv_alpha4), blended_b4);
+            fb_pixel_a4 = _mm_add_ps(_mm_mul_ps(fb_pixel_a4, inv_alpha4), blended_a4);
+
+            fb_pixel_r4 = _mm_sqrt_ps(_mm_min_ps(fb_pixel_r4, one4));
+            fb_pixel_g4 = _mm_sqrt_ps(_mm_min_ps(fb_pixel_g4, one4));
+            fb_pixel_b4 = _mm_sqrt_ps(_mm_min_ps(fb_pixel_b4, one4));
 
             fb_pixel_a4i = _mm_cvtps_epi32(_mm_mul_ps(fb_pixel_a4, two_fifty_five4));
             fb_pixel_b4i = _mm_cvtps_epi32(_mm_mul_ps(fb_pixel_b4, two_fifty_five4));
@@ -484,18 +662,25 @@ static void render_image(render_cmd_image_t *cmd, camera_t *cam, game_frame_buff
 #endif
 
             _mm_store_si128(fb_pixel, masked_out);
+
+            if (overdraw) {
+                // NOTE(Wes): Written lanes of the mask are all ones, ie. -1.
+                __m128i *counts = (__m128i *)render_overdraw_pixel(overdraw, frame_buffer, x, y);
+                _mm_storeu_si128(counts, _mm_sub_epi32(_mm_loadu_si128(counts), write_mask));
+            }
         }
     }
-    END_COUNTER_N(process_pixel, aabb2i_clamped_area(fill_rect));
-    END_COUNTER(render_image);
+    END_BLOCK_N(process_pixel, aabb2i_clamped_area(fill_rect));
+    END_BLOCK(render_image);
 }
 
 static void render_image_naive(render_cmd_image_t *cmd,
                                camera_t *cam,
                                game_frame_buffer_t *frame_buffer,
-                               aabb2i_t clip_rect)
+                               aabb2i_t clip_rect,
+                               u32 *overdraw)
 {
-    START_COUNTER(render_image);
+    BEGIN_BLOCK(render_image);
     basis_t basis = cmd->header.basis;
 
     v2 origin = v2_mul(basis.origin, cam->units_to_pixels);
@@ -542,12 +727,14 @@ static void render_image_naive(render_cmd_image_t *cmd,
     v2 n_x_axis = v2_mul(x_axis, inv_x_len_sq);
     v2 n_y_axis = v2_mul(y_axis, inv_y_len_sq);
 
-    image_t *texture = cmd->image;
+    sprite_t *sprite = &cmd->sprite;
+    u32 texture_pitch = sprite->image->w;
+    u32 *texture_data = sprite->image->data + sprite->y * texture_pitch + sprite->x;
     image_t *normals = cmd->normals;
     v4 tint = cmd->tint;
 
     u8 *fb_data = frame_buffer->data;
-    START_COUNTER(process_pixel);
+    BEGIN_BLOCK(process_pixel);
     for (i32 y = fill_rect.y_min; y < fill_rect.y_max; y++) {
         for (i32 x = fill_rect.x_min; x < fill_rect.x_max; x++) {
             // NOTE(Wes): Take the dot product of the point and the axis
@@ -558,29 +745,32 @@ static void render_image_naive(render_cmd_image_t *cmd,
             f32 u = v2_dot(p_orig, n_x_axis);
             f32 v = v2_dot(p_orig, n_y_axis);
             if (u >= 0.0f && u <= 1.0f && v >= 0.0f && v <= 1.0f) {
-                // TODO(Wes): Actually clamp the texels for subpixel rendering
-                // rather than just shortening the texture.
-                f32 texel_x = u * (texture->w - 2.0f);
-                f32 texel_y = v * (texture->h - 2.0f);
+                // NOTE(Wes): Keep the 2x2 block inside the sprite. On the
+                // right and bottom edges the blend factor becomes 1 instead.
+                f32 texel_x = u * (sprite->w - 1.0f);
+                f32 texel_y = v * (sprite->h - 1.0f);
 
                 u32 texture_x = (u32)texel_x;
                 u32 texture_y = (u32)texel_y;
+                if (texture_x > sprite->w - 2) {
+                    texture_x = sprite->w - 2;
+                }
+                if (texture_y > sprite->h - 2) {
+                    texture_y = sprite->h - 2;
+                }
 
                 // NOTE(Wes): Get the rounded off value of the texel.
                 f32 fraction_x = texel_x - texture_x;
                 f32 fraction_y = texel_y - texture_y;
 
-                texture_x = kclamp(texture_x, 0, texture->w - 1);
-                texture_y = kclamp(texture_y, 0, texture->h - 1);
-
-                u32 *texel = &texture->data[texture_y * texture->w + texture_x];
+                u32 *texel = &texture_data[texture_y * texture_pitch + texture_x];
 
                 // NOTE(Wes): Blend the closest 4 texels for better looking
                 // pixels. Bilinear blending.
                 v4 texel_a = read_image_color(*texel);
                 v4 texel_b = read_image_color(*(texel + 1));
-                v4 texel_c = read_image_color(*(texel + texture->w));
-                v4 texel_d = read_image_color(*(texel + texture->w + 1));
+                v4 texel_c = read_image_color(*(texel + texture_pitch));
+                v4 texel_d = read_image_color(*(texel + texture_pitch + 1));
 
                 // NOTE(Wes): Perform gamma correction on pixels
                 // before blending them to ensure all math is done
@@ -606,7 +796,7 @@ static void render_image_naive(render_cmd_image_t *cmd,
                 //            which entities the light is affecting.
                 v3 normal = V3(0.5f, 0.5f, 1.0f);
                 if (normals) {
-                    u32 *normal255 = &normals->data[texture_y * texture->w + texture_x];
+                    u32 *normal255 = &normals->data[texture_y * sprite->w + texture_x];
                     normal = read_image_color(*normal255).rgb;
                 }
 
@@ -641,20 +831,27 @@ static void render_image_naive(render_cmd_image_t *cmd,
                 v4 dest_color = read_frame_buffer_color(*fb_pixel);
 
                 dest_color = srgb_to_linear(dest_color);
-                dest_color = linear_blend_tint(blended_color, tint, dest_color);
+                dest_color = premultiplied_blend_tint(blended_color, tint, dest_color);
                 dest_color = linear_to_srgb(dest_color);
                 dest_color.rgb = v3_hadamard(dest_color.rgb, light_intensity);
 
                 *fb_pixel = color_frame_buffer_u32(dest_color);
+                if (overdraw) {
+                    ++*render_overdraw_pixel(overdraw, frame_buffer, x, y);
+                }
             }
         }
     }
 
-    END_COUNTER_N(process_pixel, aabb2i_clamped_area(fill_rect));
-    END_COUNTER(render_image);
+    END_BLOCK_N(process_pixel, aabb2i_clamped_area(fill_rect));
+    END_BLOCK(render_image);
 }
 
-static void render_rect(render_cmd_rect_t *cmd, camera_t *cam, game_frame_buffer_t *frame_buffer, aabb2i_t clip_rect)
+static void render_rect(render_cmd_rect_t *cmd,
+                        camera_t *cam,
+                        game_frame_buffer_t *frame_buffer,
+                        aabb2i_t clip_rect,
+                        u32 *overdraw)
 {
     basis_t basis = cmd->header.basis;
 
@@ -737,6 +934,9 @@ static void render_rect(render_cmd_rect_t *cmd, camera_t *cam, game_frame_buffer
                         dest_color = linear_blend(color, dest_color);
                         dest_color = linear_to_srgb(dest_color);
                         *fb_pixel = color_frame_buffer_u32(dest_color);
+                        if (overdraw) {
+                            ++*render_overdraw_pixel(overdraw, frame_buffer, x, y);
+                        }
                     }
                 }
             }
@@ -757,12 +957,93 @@ static void render_rect(render_cmd_rect_t *cmd, camera_t *cam, game_frame_buffer
                     dest_color = linear_blend(color, dest_color);
                     dest_color = linear_to_srgb(dest_color);
                     *fb_pixel = color_frame_buffer_u32(dest_color);
+                    if (overdraw) {
+                        ++*render_overdraw_pixel(overdraw, frame_buffer, x, y);
+                    }
                 }
             }
         }
     }
 }
 
+void render_resample_image(image_t *src, image_t *dest)
+{
+    assert(src->w && src->h);
+    f32 scale_x = (f32)src->w / (f32)dest->w;
+    f32 scale_y = (f32)src->h / (f32)dest->h;
+    i32 max_x = (i32)src->w - 1;
+    i32 max_y = (i32)src->h - 1;
+
+    for (u32 y = 0; y < dest->h; ++y) {
+        f32 texel_y = kclampf(((f32)y + 0.5f) * scale_y - 0.5f, 0.0f, (f32)max_y);
+        i32 y0 = (i32)texel_y;
+        i32 y1 = gg_min(y0 + 1, max_y);
+        u32 fy = (u32)((texel_y - y0) * 256.0f);
+        u32 *row0 = src->data + y0 * src->w;
+        u32 *row1 = src->data + y1 * src->w;
+        u32 *out = dest->data + y * dest->w;
+
+        for (u32 x = 0; x < dest->w; ++x) {
+            f32 texel_x = kclampf(((f32)x + 0.5f) * scale_x - 0.5f, 0.0f, (f32)max_x);
+            i32 x0 = (i32)texel_x;
+            i32 x1 = gg_min(x0 + 1, max_x);
+            u32 fx = (u32)((texel_x - x0) * 256.0f);
+
+            u32 a = row0[x0];
+            u32 b = row0[x1];
+            u32 c = row1[x0];
+            u32 d = row1[x1];
+
+            // NOTE(Wes): Texels are A R G B from the low byte up, the frame
+            // buffer wants B G R A from the low byte up.
+            u32 result = 0;
+            for (u32 shift = 0; shift < 32; shift += 8) {
+                u32 top = ((a >> shift) & 0xFF) * (256 - fx) + ((b >> shift) & 0xFF) * fx;
+                u32 bottom = ((c >> shift) & 0xFF) * (256 - fx) + ((d >> shift) & 0xFF) * fx;
+                u32 value = (top * (256 - fy) + bottom * fy + (1 << 15)) >> 16;
+                result |= value << (24 - shift);
+            }
+            out[x] = result;
+        }
+    }
+}
+
+// In floats with exact weights, to check render_resample_image against.
+static void render_resample_image_reference(image_t *src, image_t *dest)
+{
+    f32 scale_x = (f32)src->w / (f32)dest->w;
+    f32 scale_y = (f32)src->h / (f32)dest->h;
+    i32 max_x = (i32)src->w - 1;
+    i32 max_y = (i32)src->h - 1;
+
+    for (u32 y = 0; y < dest->h; ++y) {
+        f32 texel_y = kclampf(((f32)y + 0.5f) * scale_y - 0.5f, 0.0f, (f32)max_y);
+        i32 y0 = (i32)texel_y;
+        i32 y1 = gg_min(y0 + 1, max_y);
+        f32 fy = texel_y - (f32)y0;
+
+        for (u32 x = 0; x < dest->w; ++x) {
+            f32 texel_x = kclampf(((f32)x + 0.5f) * scale_x - 0.5f, 0.0f, (f32)max_x);
+            i32 x0 = (i32)texel_x;
+            i32 x1 = gg_min(x0 + 1, max_x);
+            f32 fx = texel_x - (f32)x0;
+
+            u32 texels[4] = {src->data[y0 * src->w + x0],
+                             src->data[y0 * src->w + x1],
+                             src->data[y1 * src->w + x0],
+                             src->data[y1 * src->w + x1]};
+            u32 result = 0;
+            for (u32 shift = 0; shift < 32; shift += 8) {
+                f32 top = ((texels[0] >> shift) & 0xFF) * (1.0f - fx) + ((texels[1] >> shift) & 0xFF) * fx;
+                f32 bottom = ((texels[2] >> shift) & 0xFF) * (1.0f - fx) + ((texels[3] >> shift) & 0xFF) * fx;
+                u32 value = (u32)(top * (1.0f - fy) + bottom * fy + 0.5f);
+                result |= value << (24 - shift);
+            }
+            dest->data[y * dest->w + x] = result;
+        }
+    }
+}
+
 void *render_push_cmd(render_queue_t *queue, u32 size)
 {
     if (queue->index + size >= queue->size) {
@@ -782,6 +1063,25 @@ void render_push_clear(render_queue_t *queue, v4 color)
     cmd->color = color;
 }
 
+void render_push_sprite(render_queue_t *queue,
+                        basis_t *basis,
+                        v4 tint,
+                        sprite_t *sprite,
+                        image_t *normals,
+                        light_t *lights,
+                        int num_lights)
+{
+    assert(sprite->image);
+    render_cmd_image_t *cmd = (render_cmd_image_t *)render_push_cmd(queue, sizeof(render_cmd_image_t));
+    cmd->header.type = render_type_image;
+    cmd->header.basis = *basis;
+    cmd->tint = tint;
+    cmd->sprite = *sprite;
+    cmd->normals = normals;
+    cmd->lights = lights;
+    cmd->num_lights = num_lights;
+}
+
 void render_push_image(render_queue_t *queue,
                        basis_t *basis,
                        v4 tint,
@@ -790,14 +1090,18 @@ void render_push_image(render_queue_t *queue,
                        light_t *lights,
                        int num_lights)
 {
-    render_cmd_image_t *cmd = (render_cmd_image_t *)render_push_cmd(queue, sizeof(render_cmd_image_t));
-    cmd->header.type = render_type_image;
-    cmd->header.basis = *basis;
-    cmd->tint = tint;
+    sprite_t sprite = {image, 0, 0, image->w, image->h};
+    render_push_sprite(queue, basis, tint, &sprite, normals, lights, num_lights);
+}
+
+void render_push_layer(render_queue_t *queue, image_t *image, i32 x, i32 y, b8 opaque)
+{
+    render_cmd_layer_t *cmd = (render_cmd_layer_t *)render_push_cmd(queue, sizeof(render_cmd_layer_t));
+    cmd->header.type = render_type_layer;
     cmd->image = image;
-    cmd->normals = normals;
-    cmd->lights = lights;
-    cmd->num_lights = num_lights;
+    cmd->x = x;
+    cmd->y = y;
+    cmd->opaque = opaque;
 }
 
 void render_push_rect(render_queue_t *queue, basis_t *basis, v4 color)
@@ -825,87 +1129,648 @@ render_queue_t *render_alloc_queue(memory_arena_t *arena, u32 max_render_queue_s
     queue->index = 0;
     queue->base = push_size(arena, max_render_queue_size);
     queue->camera = cam;
+    queue->tile_x_count = GG_RENDER_TILE_X_COUNT;
+    queue->tile_y_count = GG_RENDER_TILE_Y_COUNT;
+    queue->image_kernel = render_image_kernel_simd;
+    queue->overdraw = 0;
+    return queue;
+}
+
+static u32 render_cmd_size(render_type_t type)
+{
+    switch (type) {
+    case render_type_clear:
+        return sizeof(render_cmd_clear_t);
+    case render_type_image:
+        return sizeof(render_cmd_image_t);
+    case render_type_rect:
+        return sizeof(render_cmd_rect_t);
+    case render_type_layer:
+        return sizeof(render_cmd_layer_t);
+    default:
+        return 0;
+    }
+}
+
+// NOTE(Wes): Render captures. The commands are written as they sit in the
+// queue with every image pointer replaced by its index in the capture's image
+// list + 1 and every light pointer by its index in the capture's light array
+// + 1, zero stays null. Sprites only keep the texels of their own rect so a
+// capture holds what the frame draws rather than whole atlas pages. Assets
+// built by resampling a source, ie. parallax layer caches, are stored as the
+// source and resampled again on load. As the commands are stored raw a
+// capture can only be replayed by a build with the same command layout.
+#define GG_RENDER_CAPTURE_MAGIC 0x51524747 // "GGRQ"
+#define GG_RENDER_CAPTURE_VERSION 2
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 cmd_sizes[render_type_count];
+    u32 frame_width;
+    u32 frame_height;
+    camera_t camera;
+    u32 tile_x_count;
+    u32 tile_y_count;
+    u32 command_size;
+    u32 light_count;
+    u32 image_count;
+} render_capture_header_t;
+
+// Followed by w * h texels.
+typedef struct {
+    u32 asset_id;
+    u32 x; // Rect of the asset the texels were taken from.
+    u32 y;
+    u32 w;
+    u32 h;
+    u32 resample_w; // Non zero when the texels are the asset's source, to be
+    u32 resample_h; // resampled to this size on load.
+} render_capture_image_t;
+
+static i32 render_capture_find_asset(image_t *image, render_capture_asset_t *assets, u32 asset_count)
+{
+    for (u32 i = 0; i < asset_count; ++i) {
+        if (assets[i].image == image) {
+            return (i32)i;
+        }
+    }
+    return -1;
+}
+
+// Replaces the image with the id of the rect of it that is used, adding the
+// rect to the capture's image list the first time it is seen.
+static b8 render_capture_encode_rect(image_t **image,
+                                     u32 x,
+                                     u32 y,
+                                     u32 w,
+                                     u32 h,
+                                     render_capture_asset_t *assets,
+                                     u32 asset_count,
+                                     render_capture_image_t *images,
+                                     u32 *image_count)
+{
+    if (!*image) {
+        return 1;
+    }
+    i32 asset_id = render_capture_find_asset(*image, assets, asset_count);
+    if (asset_id < 0) {
+        return 0;
+    }
+
+    u32 index = 0;
+    while (index < *image_count) {
+        render_capture_image_t *found = &images[index];
+        if (found->asset_id == (u32)asset_id && found->x == x && found->y == y && found->w == w && found->h == h) {
+            break;
+        }
+        ++index;
+    }
+    if (index == *image_count) {
+        render_capture_image_t *added = &images[(*image_count)++];
+        added->asset_id = (u32)asset_id;
+        added->x = x;
+        added->y = y;
+        added->w = w;
+        added->h = h;
+    }
+    *image = (image_t *)(uintptr_t)(index + 1);
+    return 1;
+}
+
+static b8 render_capture_encode_image(image_t **image,
+                                      render_capture_asset_t *assets,
+                                      u32 asset_count,
+                                      render_capture_image_t *images,
+                                      u32 *image_count)
+{
+    if (!*image) {
+        return 1;
+    }
+    return render_capture_encode_rect(image, 0, 0, (*image)->w, (*image)->h, assets, asset_count, images, image_count);
+}
+
+u8 *render_capture_queue(render_queue_t *queue,
+                         u32 frame_width,
+                         u32 frame_height,
+                         render_capture_asset_t *assets,
+                         u32 asset_count,
+                         memory_arena_t *arena,
+                         u32 *capture_size)
+{
+    // NOTE(Wes): Every image reference could be a different rect. The list is
+    // pushed before the capture so it is not part of it.
+    u32 max_image_count = 0;
+    for (u32 address = 0; address < queue->index;) {
+        render_cmd_header_t *cmd_header = (render_cmd_header_t *)(queue->base + address);
+        if (cmd_header->type == render_type_image) {
+            max_image_count += 2;
+        } else if (cmd_header->type == render_type_layer) {
+            max_image_count += 1;
+        }
+        address += render_cmd_size(cmd_header->type);
+    }
+    render_capture_image_t *images = push_array(arena, max_image_count, render_capture_image_t);
+    u32 image_count = 0;
+
+    // NOTE(Wes): Commands are copied first so the pointers can be rewritten in
+    // place. Lights are nearly always shared by runs of commands so only a
+    // change of pointer starts a new light.
+    render_capture_header_t *header = push_struct(arena, render_capture_header_t);
+    u8 *commands = push_size(arena, queue->index);
+    memcpy(commands, queue->base, queue->index);
+
+    u32 light_count = 0;
+    for (u32 address = 0; address < queue->index;) {
+        render_cmd_header_t *cmd_header = (render_cmd_header_t *)(commands + address);
+        if (cmd_header->type == render_type_image) {
+            render_cmd_image_t *cmd = (render_cmd_image_t *)cmd_header;
+            if (cmd->lights) {
+                light_count += cmd->num_lights;
+            }
+        }
+        address += render_cmd_size(cmd_header->type);
+    }
+    light_t *lights = push_array(arena, light_count, light_t);
+
+    light_count = 0;
+    light_t *last_lights = 0;
+    u32 last_light_index = 0;
+    for (u32 address = 0; address < queue->index;) {
+        render_cmd_header_t *cmd_header = (render_cmd_header_t *)(commands + address);
+        b8 encoded = 1;
+        if (cmd_header->type == render_type_image) {
+            render_cmd_image_t *cmd = (render_cmd_image_t *)cmd_header;
+            sprite_t *sprite = &cmd->sprite;
+            // NOTE(Wes): Normal maps are indexed by sprite coordinates so
+            // they are kept whole.
+            encoded = render_capture_encode_rect(&sprite->image,
+                                                 sprite->x,
+                                                 sprite->y,
+                                                 sprite->w,
+                                                 sprite->h,
+                                                 assets,
+                                                 asset_count,
+                                                 images,
+                                                 &image_count) &&
+                      render_capture_encode_image(&cmd->normals, assets, asset_count, images, &image_count);
+            sprite->x = 0;
+            sprite->y = 0;
+            if (cmd->lights) {
+                if (cmd->lights != last_lights) {
+                    last_lights = cmd->lights;
+                    last_light_index = light_count;
+                    memcpy(lights + light_count, cmd->lights, cmd->num_lights * sizeof(light_t));
+                    light_count += cmd->num_lights;
+                }
+                cmd->lights = (light_t *)(uintptr_t)(last_light_index + 1);
+            }
+        } else if (cmd_header->type == render_type_layer) {
+            render_cmd_layer_t *cmd = (render_cmd_layer_t *)cmd_header;
+            encoded = render_capture_encode_image(&cmd->image, assets, asset_count, images, &image_count);
+        }
+        if (!encoded) {
+            return 0;
+        }
+        address += render_cmd_size(cmd_header->type);
+    }
+    // NOTE(Wes): Give back the lights that turned out to be shared.
+    arena->index = (u32)((u8 *)(lights + light_count) - arena->base);
+
+    for (u32 i = 0; i < image_count; ++i) {
+        render_capture_image_t *capture_image = push_struct(arena, render_capture_image_t);
+        *capture_image = images[i];
+        render_capture_asset_t *asset = &assets[capture_image->asset_id];
+        image_t *source = asset->image;
+        capture_image->resample_w = 0;
+        capture_image->resample_h = 0;
+        if (asset->source && capture_image->w == asset->image->w && capture_image->h == asset->image->h) {
+            source = asset->source;
+            capture_image->resample_w = capture_image->w;
+            capture_image->resample_h = capture_image->h;
+            capture_image->w = source->w;
+            capture_image->h = source->h;
+        }
+
+        u32 *texels = push_array(arena, capture_image->w * capture_image->h, u32);
+        for (u32 y = 0; y < capture_image->h; ++y) {
+            memcpy(texels + y * capture_image->w,
+                   source->data + (capture_image->y + y) * source->w + capture_image->x,
+                   capture_image->w * sizeof(u32));
+        }
+    }
+
+    header->magic = GG_RENDER_CAPTURE_MAGIC;
+    header->version = GG_RENDER_CAPTURE_VERSION;
+    for (u32 i = 0; i < render_type_count; ++i) {
+        header->cmd_sizes[i] = render_cmd_size((render_type_t)i);
+    }
+    header->frame_width = frame_width;
+    header->frame_height = frame_height;
+    header->camera = *queue->camera;
+    header->tile_x_count = queue->tile_x_count;
+    header->tile_y_count = queue->tile_y_count;
+    header->command_size = queue->index;
+    header->light_count = light_count;
+    header->image_count = image_count;
+
+    *capture_size = (u32)(arena->base + arena->index - (u8 *)header);
+    return (u8 *)header;
+}
+
+b8 render_copy_queue(render_queue_t *dest, render_queue_t *source, light_t *lights, u32 max_lights)
+{
+    assert(dest->size >= source->index);
+    memcpy(dest->base, source->base, source->index);
+    dest->index = source->index;
+    *dest->camera = *source->camera;
+    dest->tile_x_count = source->tile_x_count;
+    dest->tile_y_count = source->tile_y_count;
+
+    u32 light_count = 0;
+    light_t *last_lights = 0;
+    light_t *last_copy = 0;
+    for (u32 address = 0; address < dest->index;) {
+        render_cmd_header_t *cmd_header = (render_cmd_header_t *)(dest->base + address);
+        if (cmd_header->type == render_type_image) {
+            render_cmd_image_t *cmd = (render_cmd_image_t *)cmd_header;
+            if (cmd->lights) {
+                if (cmd->lights != last_lights) {
+                    if (light_count + cmd->num_lights > max_lights) {
+                        dest->index = 0;
+                        return 0;
+                    }
+                    last_lights = cmd->lights;
+                    last_copy = lights + light_count;
+                    memcpy(last_copy, cmd->lights, cmd->num_lights * sizeof(light_t));
+                    light_count += cmd->num_lights;
+                }
+                cmd->lights = last_copy;
+            }
+        }
+        address += render_cmd_size(cmd_header->type);
+    }
+    return 1;
+}
+
+static b8 render_capture_decode_image(image_t **image, image_t *images, u32 image_count)
+{
+    uintptr_t id = (uintptr_t)*image;
+    if (!id) {
+        return 1;
+    }
+    if (id > image_count) {
+        return 0;
+    }
+    *image = &images[id - 1];
+    return 1;
+}
+
+// NOTE(Wes): Walks the capture's sections, checking they fit. Returns the
+// start of the image list or 0.
+static u8 *render_capture_images_start(u8 *capture, u64 capture_size, u64 *resample_bytes)
+{
+    render_capture_header_t *header = (render_capture_header_t *)capture;
+    if (capture_size < sizeof(*header) || header->magic != GG_RENDER_CAPTURE_MAGIC ||
+        header->version != GG_RENDER_CAPTURE_VERSION) {
+        return 0;
+    }
+    for (u32 i = 0; i < render_type_count; ++i) {
+        if (header->cmd_sizes[i] != render_cmd_size((render_type_t)i)) {
+            return 0;
+        }
+    }
+
+    u8 *end = capture + capture_size;
+    u8 *commands = (u8 *)(header + 1);
+    light_t *lights = (light_t *)(commands + header->command_size);
+    u8 *images_start = (u8 *)(lights + header->light_count);
+    if (images_start > end) {
+        return 0;
+    }
+
+    *resample_bytes = 0;
+    u8 *at = images_start;
+    for (u32 i = 0; i < header->image_count; ++i) {
+        render_capture_image_t *capture_image = (render_capture_image_t *)at;
+        if (at + sizeof(*capture_image) > end) {
+            return 0;
+        }
+        at += sizeof(*capture_image) + (u64)capture_image->w * capture_image->h * sizeof(u32);
+        if (at > end) {
+            return 0;
+        }
+        *resample_bytes += (u64)capture_image->resample_w * capture_image->resample_h * sizeof(u32);
+    }
+    return images_start;
+}
+
+u64 render_capture_load_size(u8 *capture, u64 capture_size)
+{
+    u64 resample_bytes = 0;
+    if (!render_capture_images_start(capture, capture_size, &resample_bytes)) {
+        return 0;
+    }
+    render_capture_header_t *header = (render_capture_header_t *)capture;
+    return sizeof(render_queue_t) + header->command_size +
+           header->image_count * sizeof(image_t) + resample_bytes;
+}
+
+render_queue_t *render_load_capture(u8 *capture,
+                                    u64 capture_size,
+                                    memory_arena_t *arena,
+                                    camera_t *camera,
+                                    u32 *frame_width,
+                                    u32 *frame_height)
+{
+    u64 resample_bytes = 0;
+    u8 *images_start = render_capture_images_start(capture, capture_size, &resample_bytes);
+    if (!images_start) {
+        return 0;
+    }
+    render_capture_header_t *header = (render_capture_header_t *)capture;
+    u8 *commands = (u8 *)(header + 1);
+    light_t *lights = (light_t *)(commands + header->command_size);
+
+    // NOTE(Wes): Texels are used in place unless they are a source that has to
+    // be resampled again.
+    u32 image_count = header->image_count;
+    image_t *images = push_array(arena, image_count, image_t);
+    u8 *at = images_start;
+    for (u32 i = 0; i < image_count; ++i) {
+        render_capture_image_t *capture_image = (render_capture_image_t *)at;
+        image_t *image = &images[i];
+        image->w = capture_image->w;
+        image->h = capture_image->h;
+        image->data = (u32 *)(capture_image + 1);
+        if (capture_image->resample_w && capture_image->resample_h) {
+            image_t source = *image;
+            image->w = capture_image->resample_w;
+            image->h = capture_image->resample_h;
+            image->data = push_array(arena, image->w * image->h, u32);
+            render_resample_image(&source, image);
+        }
+        at += sizeof(*capture_image) + capture_image->w * capture_image->h * sizeof(u32);
+    }
+
+    *camera = header->camera;
+    render_queue_t *queue = render_alloc_queue(arena, header->command_size, camera);
+    memcpy(queue->base, commands, header->command_size);
+    queue->index = header->command_size;
+    queue->tile_x_count = header->tile_x_count;
+    queue->tile_y_count = header->tile_y_count;
+
+    for (u32 address = 0; address < queue->index;) {
+        render_cmd_header_t *cmd_header = (render_cmd_header_t *)(queue->base + address);
+        u32 cmd_size = cmd_header->type < render_type_count ? render_cmd_size(cmd_header->type) : 0;
+        if (!cmd_size || address + cmd_size > queue->index) {
+            return 0;
+        }
+
+        b8 decoded = 1;
+        if (cmd_header->type == render_type_image) {
+            render_cmd_image_t *cmd = (render_cmd_image_t *)cmd_header;
+            decoded = render_capture_decode_image(&cmd->sprite.image, images, image_count) &&
+                      render_capture_decode_image(&cmd->normals, images, image_count) &&
+                      cmd->sprite.image;
+            uintptr_t light_id = (uintptr_t)cmd->lights;
+            if (light_id) {
+                decoded = decoded && light_id - 1 + cmd->num_lights <= header->light_count;
+                cmd->lights = lights + (light_id - 1);
+            }
+        } else if (cmd_header->type == render_type_layer) {
+            render_cmd_layer_t *cmd = (render_cmd_layer_t *)cmd_header;
+            decoded = render_capture_decode_image(&cmd->image, images, image_count) && cmd->image;
+        }
+        if (!decoded) {
+            return 0;
+        }
+        address += cmd_size;
+    }
+
+    *frame_width = header->frame_width;
+    *frame_height = header->frame_height;
     return queue;
 }
 
 typedef struct {
     render_queue_t *queue;
     game_frame_buffer_t *frame_buffer;
-    aabb2i_t clip_rect;
 } render_work_t;
 
 void render_draw_tile(render_queue_t *queue,
                       game_frame_buffer_t *frame_buffer,
                       aabb2i_t clip_rect)
 {
-    START_COUNTER(render_draw_queue);
+    BEGIN_BLOCK(render_draw_tile);
     for (u32 address = 0; address < queue->index;) {
         render_cmd_header_t *header = (render_cmd_header_t *)(queue->base + address);
         switch (header->type) {
         case render_type_clear:
-            render_clear((render_cmd_clear_t *)header, frame_buffer, clip_rect);
+            render_clear((render_cmd_clear_t *)header, frame_buffer, clip_rect, queue->overdraw);
             address += sizeof(render_cmd_clear_t);
             break;
         case render_type_image:
-            render_image((render_cmd_image_t *)header, queue->camera, frame_buffer, clip_rect);
-            // render_image_naive((render_cmd_image_t *)header, queue->camera, frame_buffer, clip_rect);
+            if (queue->image_kernel == render_image_kernel_reference) {
+                render_image_naive((render_cmd_image_t *)header, queue->camera, frame_buffer, clip_rect, queue->overdraw);
+            } else {
+                render_image((render_cmd_image_t *)header, queue->camera, frame_buffer, clip_rect, queue->overdraw);
+            }
             address += sizeof(render_cmd_image_t);
             break;
         case render_type_rect:
-            render_rect((render_cmd_rect_t *)header, queue->camera, frame_buffer, clip_rect);
+            render_rect((render_cmd_rect_t *)header, queue->camera, frame_buffer, clip_rect, queue->overdraw);
             address += sizeof(render_cmd_rect_t);
             break;
+        case render_type_layer:
+            render_layer((render_cmd_layer_t *)header, frame_buffer, clip_rect, queue->overdraw);
+            address += sizeof(render_cmd_layer_t);
+            break;
+        default:
+            assert(!"Unknown render command");
+            address = queue->index;
+            break;
         }
     }
 
-    END_COUNTER(render_draw_queue);
+    END_BLOCK(render_draw_tile);
+}
+
+// Returns the pixels covered by a tile of the queue's grid.
+static aabb2i_t render_tile_rect(render_queue_t *queue, game_frame_buffer_t *frame_buffer, u32 x, u32 y)
+{
+    u32 fb_width = frame_buffer->w;
+    u32 fb_height = frame_buffer->h;
+
+    u32 tile_height = fb_height / queue->tile_y_count;
+    u32 tile_width = fb_width / queue->tile_x_count;
+
+    // Round tile_width to the nearest multiple of 4 because we always render 4 pixel at a time.
+    tile_width = ((tile_width + 3) / 4) * 4;
+
+    aabb2i_t clip_rect;
+    clip_rect.y_min = y * tile_height;
+    clip_rect.x_min = x * tile_width;
+    clip_rect.y_max = clip_rect.y_min + tile_height;
+    clip_rect.x_max = clip_rect.x_min + tile_width;
+
+    // NOTE(Wes): The last row and column take up whatever the division left over.
+    if (clip_rect.x_max > (i32)fb_width || x == queue->tile_x_count - 1) {
+        clip_rect.x_max = fb_width;
+    }
+    if (y == queue->tile_y_count - 1) {
+        clip_rect.y_max = fb_height;
+    }
+    return clip_rect;
 }
 
-void render_worker(void *data)
+// Draws tiles begin to end, numbered row by row.
+static void render_draw_tiles(void *user, u32 begin, u32 end, wq_context_t *context)
 {
-    render_work_t *work = (render_work_t *)data;
-    render_draw_tile(work->queue, work->frame_buffer, work->clip_rect);
+    render_work_t *work = (render_work_t *)user;
+    render_queue_t *queue = work->queue;
+    for (u32 tile_index = begin; tile_index < end; ++tile_index) {
+        aabb2i_t clip_rect = render_tile_rect(queue, work->frame_buffer,
+                                              tile_index % queue->tile_x_count,
+                                              tile_index / queue->tile_x_count);
+        u64 start = rdtsc();
+        render_draw_tile(queue, work->frame_buffer, clip_rect);
+        queue->tile_cycles[tile_index] = rdtsc() - start;
+    }
 }
 
-void render_draw_queue(render_queue_t *queue, game_frame_buffer_t *frame_buffer, game_work_queues_t *work_queues)
+// Returns the number of tiles to draw.
+static u32 render_prepare_draw(render_queue_t *queue, game_frame_buffer_t *frame_buffer)
 {
     assert(((uintptr_t)frame_buffer->data & 15) == 0);
-    #define tile_y_count 4
-    #define tile_x_count 4
+    u32 tile_count = queue->tile_x_count * queue->tile_y_count;
+    assert(tile_count <= GG_RENDER_MAX_TILES);
 
-    u32 fb_width = frame_buffer->w;
-    u32 fb_height = frame_buffer->h;
+    if (queue->overdraw) {
+        memset(queue->overdraw, 0, frame_buffer->w * frame_buffer->h * sizeof(u32));
+    }
+    return tile_count;
+}
+
+void render_draw_queue(render_queue_t *queue, game_frame_buffer_t *frame_buffer, game_work_queues_t *work_queues)
+{
+    BEGIN_BLOCK(render_draw_queue);
+    u32 tile_count = render_prepare_draw(queue, frame_buffer);
 
-    u32 tile_height = fb_height / tile_y_count;
-    u32 tile_width = fb_width / tile_x_count;
+    // NOTE(Wes): A tile per chunk, the tile grid already sets how the frame
+    // is split up. Only waits on the tiles, not on anything else in the queue.
+    render_work_t work = {queue, frame_buffer};
+    work_queues->parallel_for(work_queues->render_work_queue, tile_count, 1, render_draw_tiles, &work);
+    queue->index = 0;
+    END_BLOCK(render_draw_queue);
+}
 
-    // Round tile_width to the nearest multiple of 4 because we always render 4 pixel at a time.
-    tile_width = ((tile_width + 3) / 4) * 4;
+static void render_draw_tile_job(void *data, wq_context_t *context)
+{
+    render_tile_job_t *tile = (render_tile_job_t *)data;
+    render_work_t work = {tile->draw->queue, tile->draw->frame_buffer};
+    render_draw_tiles(&work, tile->tile_index, tile->tile_index + 1, context);
+}
 
-    render_work_t work_infos[tile_y_count * tile_x_count];
-    u32 work_index = 0;
-    for (u32 y = 0; y < tile_y_count; ++y) {
-        for (u32 x = 0; x < tile_x_count; ++x) {
-            aabb2i_t clip_rect;
-            clip_rect.y_min = y * tile_height;
-            clip_rect.x_min = x * tile_width;
-            clip_rect.y_max = clip_rect.y_min + tile_height;
-            clip_rect.x_max = clip_rect.x_min + tile_width;
-
-            if (clip_rect.x_max > (i32)fb_width) {
-                clip_rect.x_max = fb_width;
-            }
+void render_begin_draw_queue(render_queue_t *queue,
+                             game_frame_buffer_t *frame_buffer,
+                             game_work_queues_t *work_queues,
+                             render_draw_t *draw)
+{
+    BEGIN_BLOCK(render_begin_draw_queue);
+    assert(draw->counter.count == 0);
+    u32 tile_count = render_prepare_draw(queue, frame_buffer);
+
+    draw->queue = queue;
+    draw->frame_buffer = frame_buffer;
+    for (u32 tile_index = 0; tile_index < tile_count; ++tile_index) {
+        draw->tiles[tile_index].draw = draw;
+        draw->tiles[tile_index].tile_index = tile_index;
+        draw->jobs[tile_index].work_fn = render_draw_tile_job;
+        draw->jobs[tile_index].data = &draw->tiles[tile_index];
+    }
+    work_queues->add_jobs(work_queues->render_work_queue, wq_lane_frame, draw->jobs, tile_count, &draw->counter, 0);
+    END_BLOCK(render_begin_draw_queue);
+}
+
+void render_end_draw_queue(render_draw_t *draw, game_work_queues_t *work_queues)
+{
+    BEGIN_BLOCK(render_end_draw_queue);
+    work_queues->wait_counter(work_queues->render_work_queue, &draw->counter);
+    draw->queue = 0;
+    draw->frame_buffer = 0;
+    END_BLOCK(render_end_draw_queue);
+}
 
-            render_work_t *data = work_infos + work_index++;
-            data->queue = queue;
-            data->frame_buffer = frame_buffer;
-            data->clip_rect = clip_rect;
+// NOTE(Wes): Heat colors for 0, 1, 2 ... writes to a pixel. Anything past the
+// end of the ramp uses the last color.
+static const u32 render_overdraw_ramp[] = {
+    0x00000000, // Never written.
+    0x00102080, // Blue.
+    0x0020A040, // Green.
+    0x00E0E020, // Yellow.
+    0x00F08020, // Orange.
+    0x00F02020, // Red.
+    0x00FF80FF, // Pink.
+    0x00FFFFFF, // White.
+};
+
+void render_draw_overdraw(render_queue_t *queue, game_frame_buffer_t *frame_buffer)
+{
+    if (!queue->overdraw) {
+        return;
+    }
 
-            //render_worker(queue, frame_buffer, clip_rect);
-            work_queues->add_work(work_queues->render_work_queue, render_worker, data);
+    // NOTE(Wes): A quarter of the frame's brightness is kept under the heat
+    // colors so the scene can still be recognized.
+    for (u32 y = 0; y < frame_buffer->h; ++y) {
+        u32 *pixels = (u32 *)(frame_buffer->data + y * frame_buffer->pitch);
+        u32 *counts = render_overdraw_pixel(queue->overdraw, frame_buffer, 0, y);
+        for (u32 x = 0; x < frame_buffer->w; ++x) {
+            u32 pixel = pixels[x];
+            u32 luma = (((pixel >> 16) & 0xFF) * 2 + ((pixel >> 8) & 0xFF) * 5 + (pixel & 0xFF)) >> 5;
+            u32 heat = render_overdraw_ramp[gg_min(counts[x], ARRAY_LEN(render_overdraw_ramp) - 1)];
+            u32 r = gg_min(((heat >> 16) & 0xFF) * 3 / 4 + luma, 255);
+            u32 g = gg_min(((heat >> 8) & 0xFF) * 3 / 4 + luma, 255);
+            u32 b = gg_min((heat & 0xFF) * 3 / 4 + luma, 255);
+            pixels[x] = 0xFF000000 | r << 16 | g << 8 | b;
         }
     }
 
-    work_queues->finish_work(work_queues->render_work_queue);
-    queue->index = 0;
+    // NOTE(Wes): Outline each tile and draw a bar along its top edge whose
+    // length is the tile's share of the slowest tile's cycles, going from
+    // green to red as it approaches the slowest.
+    u32 tile_count = queue->tile_x_count * queue->tile_y_count;
+    u64 max_cycles = 1;
+    for (u32 i = 0; i < tile_count; ++i) {
+        max_cycles = queue->tile_cycles[i] > max_cycles ? queue->tile_cycles[i] : max_cycles;
+    }
+
+    for (u32 tile_y = 0; tile_y < queue->tile_y_count; ++tile_y) {
+        for (u32 tile_x = 0; tile_x < queue->tile_x_count; ++tile_x) {
+            aabb2i_t rect = render_tile_rect(queue, frame_buffer, tile_x, tile_y);
+            u64 cycles = queue->tile_cycles[tile_y * queue->tile_x_count + tile_x];
+            u32 share = (u32)(cycles * 255 / max_cycles);
+            u32 bar_color = 0xFF000000 | share << 16 | (255 - share) << 8;
+            i32 bar_end = rect.x_min + (i32)((rect.x_max - rect.x_min) * cycles / max_cycles);
+            i32 bar_height = gg_min(6, rect.y_max - rect.y_min);
+
+            for (i32 y = rect.y_min; y < rect.y_max; ++y) {
+                u32 *pixels = (u32 *)(frame_buffer->data + y * frame_buffer->pitch);
+                if (y == rect.y_min || y == rect.y_max - 1) {
+                    for (i32 x = rect.x_min; x < rect.x_max; ++x) {
+                        pixels[x] = 0xFFFFFFFF;
+                    }
+                    continue;
+                }
+                pixels[rect.x_min] = 0xFFFFFFFF;
+                pixels[rect.x_max - 1] = 0xFFFFFFFF;
+                if (y - rect.y_min <= bar_height) {
+                    for (i32 x = rect.x_min + 1; x < bar_end - 1; ++x) {
+                        pixels[x] = bar_color;
+                    }
+                }
+            }
+        }
+    }
 }
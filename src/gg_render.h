@@ -27,6 +27,25 @@ void render_push_image(render_queue_t *queue,
                        light_t *lights,
                        int num_lights);
 
+// Renders the sub-rect of an image described by the sprite, eg. one packed
+// into an atlas page.
+void render_push_sprite(render_queue_t *queue,
+                        basis_t *basis,
+                        v4 tint,
+                        sprite_t *sprite,
+                        image_t *normals,
+                        light_t *lights,
+                        int num_lights);
+
+// Draws a frame buffer ordered image at an integer pixel offset without any
+// filtering, repeating it horizontally. Opaque images are plain row copies,
+// otherwise the premultiplied texels are blended over the frame buffer.
+void render_push_layer(render_queue_t *queue, image_t *image, i32 x, i32 y, b8 opaque);
+
+// Bilinearly resamples src into dest, which must already have its size and
+// pixels set, converting the texels into frame buffer order.
+void render_resample_image(image_t *src, image_t *dest);
+
 // Renders the a rect at the start (top, left) of the specified size and color.
 void render_push_rect(render_queue_t *queue, basis_t *basis, v4 color);
 
@@ -37,5 +56,54 @@ void render_push_hollow_rect(render_queue_t *queue, basis_t *basis, v4 color, f3
 // Allocates a render queue.
 render_queue_t *render_alloc_queue(memory_arena_t *arena, u32 max_render_queue_size, camera_t *cam);
 
+// Serializes the queued commands, camera and frame buffer size into the arena
+// so the frame can be replayed offline. Only the rect of each image a command
+// draws is written, once per distinct rect. Returns 0 if a command uses an
+// image that is not in assets. Must be called before the queue is drawn.
+u8 *render_capture_queue(render_queue_t *queue,
+                         u32 frame_width,
+                         u32 frame_height,
+                         render_capture_asset_t *assets,
+                         u32 asset_count,
+                         memory_arena_t *arena,
+                         u32 *capture_size);
+
+// Copies the queued commands and camera into dest, which must be as large as
+// source. The lights the commands point at are copied into lights so the copy
+// can still be captured after the frame's lights are gone. Returns 0 if there
+// are more than max_lights lights.
+b8 render_copy_queue(render_queue_t *dest, render_queue_t *source, light_t *lights, u32 max_lights);
+
+// Returns how much arena render_load_capture needs for the capture, or 0 if
+// the capture is invalid.
+u64 render_capture_load_size(u8 *capture, u64 capture_size);
+
+// Rebuilds a render queue from a capture made by render_capture_queue. Images
+// and lights point into the capture so it must outlive the queue. Returns 0
+// if the capture is invalid or from a build with a different command layout.
+render_queue_t *render_load_capture(u8 *capture,
+                                    u64 capture_size,
+                                    memory_arena_t *arena,
+                                    camera_t *camera,
+                                    u32 *frame_width,
+                                    u32 *frame_height);
+
 // Performs drawing on all render commands in the queue.
 void render_draw_queue(render_queue_t *queue, game_frame_buffer_t *frame_buffer, game_work_queues_t *work_queues);
+
+// Starts drawing the queue on the work queue's threads and returns without
+// waiting. Until render_end_draw_queue returns the queue, everything its
+// commands point at, the frame buffer and draw must be left alone. Unlike
+// render_draw_queue the commands are kept so the queue can be drawn again.
+void render_begin_draw_queue(render_queue_t *queue,
+                             game_frame_buffer_t *frame_buffer,
+                             game_work_queues_t *work_queues,
+                             render_draw_t *draw);
+
+// Helps draw the queue started with draw and returns once it is drawn.
+void render_end_draw_queue(render_draw_t *draw, game_work_queues_t *work_queues);
+
+// Replaces the drawn frame with a heatmap of the queue's overdraw counters and
+// outlines each tile with a bar showing its share of the slowest tile's
+// cycles. Does nothing unless the queue was drawn with overdraw counters.
+void render_draw_overdraw(render_queue_t *queue, game_frame_buffer_t *frame_buffer);
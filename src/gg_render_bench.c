@@ -0,0 +1,1409 @@
+// NOTE(Wes): Renderer benchmark. Builds render queues from synthetic scenes
+// and times render_draw_queue over a sweep of thread counts and tile grids.
+// Results are written as JSON so runs can be compared by scripts. With -verify
+// it instead checks every image kernel against the reference kernel. With
+// -replay a render capture saved by the game is drawn instead of the scenes.
+// With -entities it times spawn and despawn churn and integration on the
+// entity pool.
+
+#include "gg_platform.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define Kilobytes(Value) ((Value)*1024LL)
+#define Megabytes(Value) (Kilobytes(Value) * 1024LL)
+#define Gigabytes(Value) (Megabytes(Value) * 1024LL)
+#define Terabytes(Value) (Gigabytes(Value) * 1024LL)
+
+#include "gg_platform_linux.c"
+#include "gg_work_queue.c"
+#include "gg_atlas.c"
+#include "gg_render.c"
+#include "gg_entity.c"
+#include "gg_upscale.c"
+
+#ifdef GG_INTERNAL
+// NOTE(Wes): Left null so the kernels are timed without recording blocks.
+dbg_profile_t *dbg_global_profile;
+#endif
+
+// NOTE(Wes): Synthetic scenes are described in world units. The view is always
+// BENCH_VIEW_WIDTH units wide whatever the frame buffer size.
+#define BENCH_VIEW_WIDTH 128.0f
+#define BENCH_TEXTURE_COUNT 4
+#define BENCH_MAX_SWEEP 16
+#define BENCH_MAX_SCENES 16
+
+typedef struct {
+    const char *name;
+    u32 sprite_count;
+    f32 rotated_fraction;     // Fraction of sprites drawn with a random rotation.
+    f32 min_size;             // Sprite size range in world units.
+    f32 max_size;
+    f32 translucent_fraction; // Fraction of sprites with a tint alpha below one.
+    f32 rect_fraction;        // Fraction of commands that are solid rects rather than images.
+} bench_scene_t;
+
+static bench_scene_t bench_scene_presets[] = {
+    {"opaque_small", 4000, 0.0f, 1.0f, 3.0f, 0.0f, 0.0f},
+    {"rotated", 2000, 1.0f, 2.0f, 6.0f, 0.0f, 0.0f},
+    {"large_alpha", 200, 0.25f, 10.0f, 30.0f, 1.0f, 0.0f},
+    {"rects", 2000, 0.25f, 1.0f, 8.0f, 0.5f, 1.0f},
+    {"mixed", 1500, 0.25f, 1.0f, 12.0f, 0.3f, 0.2f},
+};
+
+typedef struct {
+    u32 frame_count;
+    u32 warmup_count;
+    u32 width;
+    u32 height;
+    u32 seed;
+    const char *out_path;
+    const char *replay_path; // Render capture to time instead of the synthetic scenes.
+
+    b8 verify;
+    u32 tolerance;        // Largest per channel difference from the reference that still passes.
+    const char *diff_dir; // Where images of failing verify scenes are written.
+
+    u32 thread_counts[BENCH_MAX_SWEEP];
+    u32 thread_count_count;
+    b8 scaling;     // Thread counts from 1 to every logical CPU instead.
+    b8 pin_threads; // Keep every thread on its own CPU, see wqStartPool.
+    u32 tile_counts[BENCH_MAX_SWEEP][2];
+    u32 tile_count_count;
+
+    bench_scene_t scenes[BENCH_MAX_SCENES];
+    u32 scene_count;
+
+    // NOTE(Wes): Job counts per frame to time the work queue with instead of
+    // drawing, see bench_jobs.
+    u32 job_counts[BENCH_MAX_SWEEP];
+    u32 job_count_count;
+    u32 job_iterations;   // Work per job.
+    u32 background_count; // Background jobs kept running while timing jobs.
+
+    u32 entity_count;       // Live entities to churn instead of drawing, see bench_entities.
+    u32 entity_churn_count; // Despawn and spawn pairs timed on the pool.
+} bench_options_t;
+
+typedef struct {
+    f64 ms_mean;
+    f64 ms_min;
+    f64 ms_max;
+    f64 cycles_per_pixel;      // Summed tile cycles, ie. total work regardless of threads.
+    f64 wall_cycles_per_pixel; // Elapsed cycles on the calling thread.
+    f64 tile_min;
+    f64 tile_mean;
+    f64 tile_max;
+    f64 tile_stddev;
+    f64 tile_imbalance; // Mean over frames of the slowest tile divided by the mean tile.
+} bench_result_t;
+
+static u32 bench_random(u32 *state)
+{
+    // xorshift32
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static f32 bench_random_unit(u32 *state)
+{
+    return (bench_random(state) >> 8) / 16777216.0f;
+}
+
+// Makes a premultiplied gradient texture with transparent rounded corners so
+// every scene exercises both the opaque and blended paths.
+static void bench_make_texture(image_t *image, u32 size, u32 seed)
+{
+    image->w = size;
+    image->h = size;
+    image->data = (u32 *)malloc(size * size * sizeof(u32));
+
+    f32 radius = size * 0.25f;
+    for (u32 y = 0; y < size; ++y) {
+        for (u32 x = 0; x < size; ++x) {
+            f32 dx = kmax(kmax(radius - x, (f32)x - (size - 1 - radius)), 0.0f);
+            f32 dy = kmax(kmax(radius - y, (f32)y - (size - 1 - radius)), 0.0f);
+            f32 coverage = kclampf(radius - sqrtf(dx * dx + dy * dy), 0.0f, 1.0f);
+
+            u32 a = (u32)(coverage * 255.0f + 0.5f);
+            u32 r = ((x * 255 / size) + seed * 60) & 0xFF;
+            u32 g = ((y * 255 / size) + seed * 30) & 0xFF;
+            u32 b = ((x ^ y) * 4 + seed * 90) & 0xFF;
+            r = r * a / 255;
+            g = g * a / 255;
+            b = b * a / 255;
+            image->data[y * size + x] = a | (r << 8) | (g << 16) | (b << 24);
+        }
+    }
+}
+
+static void bench_build_scene(render_queue_t *queue, bench_scene_t *scene, u32 sprite_count, sprite_t *sprites, u32 seed)
+{
+    u32 random = seed ? seed : 1;
+
+    queue->index = 0;
+    render_push_clear(queue, COLOR(0.1f, 0.2f, 0.3f, 1.0f));
+    for (u32 i = 0; i < sprite_count; ++i) {
+        f32 size = scene->min_size + (scene->max_size - scene->min_size) * bench_random_unit(&random);
+        f32 aspect = 0.5f + bench_random_unit(&random);
+        v2 x_axis = V2(size, 0.0f);
+        v2 y_axis = V2(0.0f, size * aspect);
+        if (bench_random_unit(&random) < scene->rotated_fraction) {
+            f32 angle = bench_random_unit(&random) * 6.2831853f;
+            x_axis = V2(cosf(angle) * size, sinf(angle) * size);
+            y_axis = V2(-sinf(angle) * size * aspect, cosf(angle) * size * aspect);
+        }
+
+        // NOTE(Wes): Let sprites hang off every edge so clipping is exercised too.
+        basis_t basis;
+        basis.origin = V2(bench_random_unit(&random) * (BENCH_VIEW_WIDTH + size) - size,
+                          bench_random_unit(&random) * (BENCH_VIEW_WIDTH * 9.0f / 16.0f + size) - size);
+        basis.x_axis = x_axis;
+        basis.y_axis = y_axis;
+
+        f32 alpha = 1.0f;
+        if (bench_random_unit(&random) < scene->translucent_fraction) {
+            alpha = 0.2f + 0.6f * bench_random_unit(&random);
+        }
+
+        if (bench_random_unit(&random) < scene->rect_fraction) {
+            v4 color = COLOR(bench_random_unit(&random), bench_random_unit(&random), bench_random_unit(&random), alpha);
+            render_push_rect(queue, &basis, color);
+        } else {
+            sprite_t *sprite = &sprites[bench_random(&random) % BENCH_TEXTURE_COUNT];
+            render_push_sprite(queue, &basis, V4(alpha, alpha, alpha, alpha), sprite, 0, 0, 0);
+        }
+    }
+}
+
+static void bench_run(bench_options_t *options,
+                      render_queue_t *queue,
+                      game_frame_buffer_t *frame_buffer,
+                      game_work_queues_t *work_queues,
+                      bench_result_t *result)
+{
+    u32 queue_size = queue->index;
+    u32 tile_count = queue->tile_x_count * queue->tile_y_count;
+    f64 pixel_count = (f64)frame_buffer->w * frame_buffer->h;
+
+    u64 total_ns = 0;
+    u64 min_ns = (u64)-1;
+    u64 max_ns = 0;
+    u64 total_wall_cycles = 0;
+    u64 total_tile_cycles = 0;
+    f64 tile_sum = 0.0;
+    f64 tile_sum_sq = 0.0;
+    f64 imbalance_sum = 0.0;
+    u64 tile_min = (u64)-1;
+    u64 tile_max = 0;
+
+    for (u32 frame = 0; frame < options->warmup_count + options->frame_count; ++frame) {
+        queue->index = queue_size;
+        u64 start_ns = get_wall_clock();
+        u64 start_cycles = rdtsc();
+        render_draw_queue(queue, frame_buffer, work_queues);
+        u64 wall_cycles = rdtsc() - start_cycles;
+        u64 elapsed_ns = get_wall_clock() - start_ns;
+        if (frame < options->warmup_count) {
+            continue;
+        }
+
+        total_ns += elapsed_ns;
+        min_ns = elapsed_ns < min_ns ? elapsed_ns : min_ns;
+        max_ns = elapsed_ns > max_ns ? elapsed_ns : max_ns;
+        total_wall_cycles += wall_cycles;
+
+        u64 frame_tile_sum = 0;
+        u64 frame_tile_max = 0;
+        for (u32 i = 0; i < tile_count; ++i) {
+            u64 cycles = queue->tile_cycles[i];
+            frame_tile_sum += cycles;
+            frame_tile_max = cycles > frame_tile_max ? cycles : frame_tile_max;
+            tile_min = cycles < tile_min ? cycles : tile_min;
+            tile_max = cycles > tile_max ? cycles : tile_max;
+            tile_sum += (f64)cycles;
+            tile_sum_sq += (f64)cycles * (f64)cycles;
+        }
+        total_tile_cycles += frame_tile_sum;
+        if (frame_tile_sum) {
+            imbalance_sum += (f64)frame_tile_max * tile_count / (f64)frame_tile_sum;
+        }
+    }
+    queue->index = queue_size;
+
+    f64 frames = (f64)options->frame_count;
+    f64 tile_samples = frames * tile_count;
+    result->ms_mean = total_ns / 1e6 / frames;
+    result->ms_min = min_ns / 1e6;
+    result->ms_max = max_ns / 1e6;
+    result->cycles_per_pixel = total_tile_cycles / frames / pixel_count;
+    result->wall_cycles_per_pixel = total_wall_cycles / frames / pixel_count;
+    result->tile_min = (f64)tile_min;
+    result->tile_max = (f64)tile_max;
+    result->tile_mean = tile_sum / tile_samples;
+    f64 variance = tile_sum_sq / tile_samples - result->tile_mean * result->tile_mean;
+    result->tile_stddev = variance > 0.0 ? sqrt(variance) : 0.0;
+    result->tile_imbalance = imbalance_sum / frames;
+}
+
+static const char *bench_kernel_names[render_image_kernel_count] = {"simd", "reference"};
+
+// Writes the frame buffer as a binary PPM.
+static b8 bench_write_ppm(const char *path, game_frame_buffer_t *frame_buffer)
+{
+    FILE *handle = fopen(path, "wb");
+    if (!handle) {
+        return 0;
+    }
+
+    fprintf(handle, "P6\n%u %u\n255\n", frame_buffer->w, frame_buffer->h);
+    for (u32 y = 0; y < frame_buffer->h; ++y) {
+        u32 *row = (u32 *)(frame_buffer->data + y * frame_buffer->pitch);
+        for (u32 x = 0; x < frame_buffer->w; ++x) {
+            u8 rgb[3] = {(u8)(row[x] >> 16), (u8)(row[x] >> 8), (u8)row[x]};
+            fwrite(rgb, 1, 3, handle);
+        }
+    }
+    fclose(handle);
+
+    return 1;
+}
+
+static void bench_render_kernel(render_queue_t *queue,
+                                render_image_kernel_t kernel,
+                                game_frame_buffer_t *frame_buffer,
+                                game_work_queues_t *work_queues)
+{
+    u32 queue_size = queue->index;
+    queue->image_kernel = kernel;
+    render_draw_queue(queue, frame_buffer, work_queues);
+    queue->index = queue_size;
+    queue->image_kernel = render_image_kernel_simd;
+}
+
+// Compares two frame buffers channel by channel. The diff frame buffer gets
+// white where a pixel is over the tolerance and a dimmed copy of the
+// reference elsewhere so the failures can be located.
+static u32 bench_compare(game_frame_buffer_t *reference,
+                         game_frame_buffer_t *frame_buffer,
+                         game_frame_buffer_t *diff,
+                         u32 tolerance,
+                         u32 *max_diff)
+{
+    u32 failed_count = 0;
+    *max_diff = 0;
+    for (u32 y = 0; y < reference->h; ++y) {
+        u32 *expected_row = (u32 *)(reference->data + y * reference->pitch);
+        u32 *actual_row = (u32 *)(frame_buffer->data + y * frame_buffer->pitch);
+        u32 *diff_row = (u32 *)(diff->data + y * diff->pitch);
+        for (u32 x = 0; x < reference->w; ++x) {
+            u32 pixel_diff = 0;
+            for (u32 shift = 0; shift < 32; shift += 8) {
+                i32 expected = (expected_row[x] >> shift) & 0xFF;
+                i32 actual = (actual_row[x] >> shift) & 0xFF;
+                u32 channel_diff = (u32)(expected > actual ? expected - actual : actual - expected);
+                pixel_diff = channel_diff > pixel_diff ? channel_diff : pixel_diff;
+            }
+
+            *max_diff = pixel_diff > *max_diff ? pixel_diff : *max_diff;
+            if (pixel_diff > tolerance) {
+                ++failed_count;
+                diff_row[x] = 0xFFFFFFFF;
+            } else {
+                diff_row[x] = (expected_row[x] >> 2) & 0x3F3F3F3F;
+            }
+        }
+    }
+    return failed_count;
+}
+
+static game_frame_buffer_t bench_alloc_frame_buffer(u32 width, u32 height)
+{
+    game_frame_buffer_t frame_buffer = {0};
+    frame_buffer.w = width;
+    frame_buffer.h = height;
+    frame_buffer.pitch = width * GG_BYTES_PP;
+    // NOTE(Wes): aligned_alloc wants a multiple of the alignment.
+    frame_buffer.data = (u8 *)aligned_alloc(16, (frame_buffer.pitch * frame_buffer.h + 15) & ~15u);
+    return frame_buffer;
+}
+
+// Renders the queue with each image kernel and compares it against the
+// reference kernel. Returns the number of kernels that failed.
+static u32 bench_verify_queue(bench_options_t *options,
+                              render_queue_t *queue,
+                              const char *name,
+                              const char *layout,
+                              game_frame_buffer_t *reference,
+                              game_frame_buffer_t *frame_buffer,
+                              game_frame_buffer_t *diff,
+                              game_work_queues_t *work_queues)
+{
+    u32 failed_count = 0;
+    bench_render_kernel(queue, render_image_kernel_reference, reference, work_queues);
+    for (u32 kernel = 0; kernel < render_image_kernel_count; ++kernel) {
+        if (kernel == render_image_kernel_reference) {
+            continue;
+        }
+
+        bench_render_kernel(queue, (render_image_kernel_t)kernel, frame_buffer, work_queues);
+        u32 max_diff;
+        u32 failed_pixels = bench_compare(reference, frame_buffer, diff, options->tolerance, &max_diff);
+        printf("%-14s %-8s %-9s max diff %3u, %u pixels over tolerance %s\n",
+               name,
+               layout,
+               bench_kernel_names[kernel],
+               max_diff,
+               failed_pixels,
+               failed_pixels ? "FAIL" : "ok");
+        if (!failed_pixels) {
+            continue;
+        }
+
+        ++failed_count;
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s_%s_reference.ppm", options->diff_dir, name, layout);
+        bench_write_ppm(path, reference);
+        snprintf(path, sizeof(path), "%s/%s_%s_%s.ppm", options->diff_dir, name, layout, bench_kernel_names[kernel]);
+        bench_write_ppm(path, frame_buffer);
+        snprintf(path, sizeof(path), "%s/%s_%s_%s_diff.ppm", options->diff_dir, name, layout, bench_kernel_names[kernel]);
+        bench_write_ppm(path, diff);
+    }
+    return failed_count;
+}
+
+// Compares a kernel's output against its reference and reports it like the
+// image kernels. Returns 1 if it failed.
+static u32 bench_check_kernel(bench_options_t *options,
+                              const char *name,
+                              const char *layout,
+                              const char *kernel_name,
+                              game_frame_buffer_t *reference,
+                              game_frame_buffer_t *frame_buffer,
+                              u32 tolerance)
+{
+    game_frame_buffer_t diff = bench_alloc_frame_buffer(reference->w, reference->h);
+    u32 max_diff;
+    u32 failed_pixels = bench_compare(reference, frame_buffer, &diff, tolerance, &max_diff);
+    printf("%-14s %-8s %-9s max diff %3u, %u pixels over tolerance %s\n",
+           name,
+           layout,
+           kernel_name,
+           max_diff,
+           failed_pixels,
+           failed_pixels ? "FAIL" : "ok");
+    if (failed_pixels) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s_%s_reference.ppm", options->diff_dir, name, layout);
+        bench_write_ppm(path, reference);
+        snprintf(path, sizeof(path), "%s/%s_%s_%s.ppm", options->diff_dir, name, layout, kernel_name);
+        bench_write_ppm(path, frame_buffer);
+        snprintf(path, sizeof(path), "%s/%s_%s_%s_diff.ppm", options->diff_dir, name, layout, kernel_name);
+        bench_write_ppm(path, &diff);
+    }
+    free(diff.data);
+    return failed_pixels ? 1 : 0;
+}
+
+// Random premultiplied pixels, alpha in the top byte.
+static void bench_fill_random(u32 *pixels, u32 count, u32 *random)
+{
+    for (u32 i = 0; i < count; ++i) {
+        u32 value = bench_random(random);
+        u32 alpha = value >> 24;
+        u32 pixel = alpha << 24;
+        for (u32 shift = 0; shift < 24; shift += 8) {
+            pixel |= (((value >> shift) & 0xFF) * alpha / 255) << shift;
+        }
+        pixels[i] = pixel;
+    }
+}
+
+// NOTE(Wes): The SIMD row kernels outside the image kernel: the layer blend,
+// the parallax resample and the dynres upscale. Sizes are picked so widths
+// are not multiples of 4 and every scalar tail runs. Returns the number of
+// failing kernel and size pairs.
+static u32 bench_verify_row_kernels(bench_options_t *options, game_work_queues_t *work_queues)
+{
+    u32 failed_count = 0;
+    u32 random = options->seed ? options->seed : 1;
+
+    // NOTE(Wes): Row y blends y pixels from column y % 4 so every count and
+    // alignment up to a few vectors is covered. The blend is exact.
+    {
+        u32 w = 72;
+        u32 h = 68;
+        game_frame_buffer_t src = bench_alloc_frame_buffer(w, h);
+        game_frame_buffer_t reference = bench_alloc_frame_buffer(w, h);
+        game_frame_buffer_t frame_buffer = bench_alloc_frame_buffer(w, h);
+        bench_fill_random((u32 *)src.data, w * h, &random);
+        bench_fill_random((u32 *)reference.data, w * h, &random);
+        memcpy(frame_buffer.data, reference.data, w * h * GG_BYTES_PP);
+        for (u32 y = 0; y < h; ++y) {
+            u32 offset = y * w + y % 4;
+            render_blend_row((u32 *)frame_buffer.data + offset, (u32 *)src.data + offset, (i32)y);
+            render_blend_row_reference((u32 *)reference.data + offset, (u32 *)src.data + offset, (i32)y);
+        }
+        failed_count += bench_check_kernel(options, "blend_row", "0-67", "simd", &reference, &frame_buffer, 0);
+        free(src.data);
+        free(reference.data);
+        free(frame_buffer.data);
+    }
+
+    static const u32 resample_sizes[][4] = {{13, 7, 30, 17}, {800, 243, 1917, 583}, {64, 64, 37, 41}};
+    for (u32 i = 0; i < ARRAY_LEN(resample_sizes); ++i) {
+        const u32 *size = resample_sizes[i];
+        image_t src = {(u32 *)malloc(size[0] * size[1] * sizeof(u32)), size[0], size[1]};
+        bench_fill_random(src.data, src.w * src.h, &random);
+        game_frame_buffer_t reference = bench_alloc_frame_buffer(size[2], size[3]);
+        game_frame_buffer_t frame_buffer = bench_alloc_frame_buffer(size[2], size[3]);
+        image_t reference_image = {(u32 *)reference.data, size[2], size[3]};
+        image_t image = {(u32 *)frame_buffer.data, size[2], size[3]};
+        render_resample_image_reference(&src, &reference_image);
+        render_resample_image(&src, &image);
+
+        char layout[32];
+        snprintf(layout, sizeof(layout), "%ux%u", size[2], size[3]);
+        failed_count += bench_check_kernel(options, "resample", layout, "fixed", &reference, &frame_buffer, options->tolerance);
+        free(src.data);
+        free(reference.data);
+        free(frame_buffer.data);
+    }
+
+    static upscaler_t upscaler;
+    static const u32 upscale_sizes[][4] = {{6, 4, 13, 9}, {958, 539, 1917, 1079}, {302, 170, 605, 341}};
+    for (u32 i = 0; i < ARRAY_LEN(upscale_sizes); ++i) {
+        const u32 *size = upscale_sizes[i];
+        game_frame_buffer_t src = bench_alloc_frame_buffer(size[0], size[1]);
+        bench_fill_random((u32 *)src.data, src.w * src.h, &random);
+        game_frame_buffer_t reference = bench_alloc_frame_buffer(size[2], size[3]);
+        game_frame_buffer_t frame_buffer = bench_alloc_frame_buffer(size[2], size[3]);
+        upscale_frame_buffer_reference(&src, reference.data, reference.w, reference.h, reference.pitch);
+        memset(&upscaler, 0, sizeof(upscaler));
+        upscale_frame_buffer(&upscaler,
+                             &src,
+                             frame_buffer.data,
+                             frame_buffer.w,
+                             frame_buffer.h,
+                             frame_buffer.pitch,
+                             work_queues->render_work_queue);
+
+        char layout[32];
+        snprintf(layout, sizeof(layout), "%ux%u", size[2], size[3]);
+        failed_count += bench_check_kernel(options, "upscale", layout, "simd", &reference, &frame_buffer, options->tolerance);
+        free(src.data);
+        free(reference.data);
+        free(frame_buffer.data);
+    }
+    return failed_count;
+}
+
+// NOTE(Wes): Verifies every scene, or only the queue when replaying a
+// capture. Scenes are drawn with standalone textures and again with the
+// textures packed into an atlas so sub-rect addressing is covered. Returns
+// the number of failing scene and kernel pairs.
+static u32 bench_verify(bench_options_t *options,
+                        render_queue_t *queue,
+                        sprite_t *texture_sprites,
+                        sprite_t *atlas_sprites,
+                        game_work_queues_t *work_queues)
+{
+    game_frame_buffer_t reference = bench_alloc_frame_buffer(options->width, options->height);
+    game_frame_buffer_t frame_buffer = bench_alloc_frame_buffer(options->width, options->height);
+    game_frame_buffer_t diff = bench_alloc_frame_buffer(options->width, options->height);
+
+    u32 failed_count = 0;
+    if (options->replay_path) {
+        failed_count += bench_verify_queue(options, queue, "replay", "capture", &reference, &frame_buffer, &diff, work_queues);
+    }
+    for (u32 scene_index = 0; !options->replay_path && scene_index < options->scene_count; ++scene_index) {
+        bench_scene_t *scene = &options->scenes[scene_index];
+        u32 sprite_count = scene->sprite_count / 10 ? scene->sprite_count / 10 : 1;
+
+        for (u32 packed = 0; packed < 2; ++packed) {
+            const char *layout = packed ? "atlas" : "textures";
+            bench_build_scene(queue, scene, sprite_count, packed ? atlas_sprites : texture_sprites, options->seed);
+            failed_count += bench_verify_queue(options, queue, scene->name, layout, &reference, &frame_buffer, &diff, work_queues);
+        }
+    }
+
+    free(reference.data);
+    free(frame_buffer.data);
+    free(diff.data);
+    return failed_count + bench_verify_row_kernels(options, work_queues);
+}
+
+// Times the queue over every thread count and tile grid, writing a JSON
+// object per run. scene_fields describes what is being drawn.
+static void bench_sweep(FILE *out,
+                        bench_options_t *options,
+                        render_queue_t *queue,
+                        game_frame_buffer_t *frame_buffer,
+                        game_work_queues_t *work_queues,
+                        const char *scene_fields,
+                        b8 *first_run)
+{
+    // NOTE(Wes): Speedup is relative to the first thread count with the same
+    // tiles, with -scaling that is a single thread.
+    f64 base_ms[BENCH_MAX_SWEEP];
+    for (u32 thread_index = 0; thread_index < options->thread_count_count; ++thread_index) {
+        for (u32 tile_index = 0; tile_index < options->tile_count_count; ++tile_index) {
+            queue->tile_x_count = options->tile_counts[tile_index][0];
+            queue->tile_y_count = options->tile_counts[tile_index][1];
+
+            bench_result_t result;
+            bench_run(options, queue, frame_buffer, &work_queues[thread_index], &result);
+            if (thread_index == 0) {
+                base_ms[tile_index] = result.ms_mean;
+            }
+
+            fprintf(out, "%s\n    {%s", *first_run ? "" : ",", scene_fields);
+            fprintf(out, "\"threads\": %u, \"tiles\": [%u, %u], ",
+                    options->thread_counts[thread_index], queue->tile_x_count, queue->tile_y_count);
+            fprintf(out, "\"ms_per_frame\": {\"mean\": %.4f, \"min\": %.4f, \"max\": %.4f}, ",
+                    result.ms_mean, result.ms_min, result.ms_max);
+            fprintf(out, "\"frames_per_second\": %.2f, \"speedup\": %.3f, ",
+                    1000.0 / result.ms_mean, base_ms[tile_index] / result.ms_mean);
+            fprintf(out, "\"cycles_per_pixel\": %.3f, \"wall_cycles_per_pixel\": %.3f, ",
+                    result.cycles_per_pixel, result.wall_cycles_per_pixel);
+            fprintf(out, "\"tile_cycles\": {\"min\": %.0f, \"mean\": %.0f, \"max\": %.0f, \"stddev\": %.0f}, ",
+                    result.tile_min, result.tile_mean, result.tile_max, result.tile_stddev);
+            fprintf(out, "\"tile_imbalance\": %.3f}", result.tile_imbalance);
+            fflush(out);
+            *first_run = 0;
+        }
+    }
+}
+
+// NOTE(Wes): The single shared ring the work queue used before each worker
+// had its own deque, kept as the baseline for the job timings. Every thread
+// CASes the same start index.
+typedef struct {
+    volatile i32 start;
+    wq_entry_t entries[WQ_SIZE];
+    volatile i32 end;
+    volatile i32 remaining_work_count;
+    platform_semaphore_t semaphore;
+} bench_ring_t;
+
+typedef struct {
+    bench_ring_t *ring;
+    u32 miss_count; // Dequeues that lost the CAS on start.
+    u8 pad[WQ_CACHE_LINE - sizeof(bench_ring_t *) - sizeof(u32)];
+} bench_ring_worker_t;
+
+// NOTE(Wes): The ring has no scratch arenas, its jobs get a context without one.
+static wq_context_t bench_ring_context;
+
+static b8 bench_ring_enqueue(bench_ring_t *ring, wq_fn work_fn, void *data)
+{
+    i32 end = ring->end;
+    i32 next_end = (end + 1) % WQ_SIZE;
+    if (ring->start == next_end) {
+        return 0;
+    }
+    ring->entries[end].work_fn = work_fn;
+    ring->entries[end].data = data;
+    atomic_increment(&ring->remaining_work_count);
+    ring->end = next_end;
+    semaphore_post(&ring->semaphore);
+    return 1;
+}
+
+static b8 bench_ring_dequeue(bench_ring_t *ring, wq_entry_t *entry, u32 *miss_count)
+{
+    while (ring->start != ring->end) {
+        i32 start = ring->start;
+        i32 next_start = (start + 1) % WQ_SIZE;
+        if (atomic_cas(&ring->start, next_start, start) == start) {
+            *entry = ring->entries[start];
+            return 1;
+        }
+        ++*miss_count;
+    }
+    return 0;
+}
+
+static THREAD_PROC(bench_ring_thread_proc)
+{
+    bench_ring_worker_t *worker = (bench_ring_worker_t *)data;
+    bench_ring_t *ring = worker->ring;
+    wq_entry_t entry;
+    for (;;) {
+        if (bench_ring_dequeue(ring, &entry, &worker->miss_count)) {
+            entry.work_fn(entry.data, &bench_ring_context);
+            atomic_decrement(&ring->remaining_work_count);
+        } else {
+            semaphore_wait(&ring->semaphore);
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    u32 iterations;
+    u32 result;
+    u8 pad[WQ_CACHE_LINE - 2 * sizeof(u32)];
+} bench_job_t;
+
+static void bench_job(void *data, wq_context_t *context)
+{
+    bench_job_t *job = (bench_job_t *)data;
+    u32 x = job->result | 1;
+    for (u32 i = 0; i < job->iterations; ++i) {
+        x = x * 1664525u + 1013904223u;
+    }
+    job->result = x;
+}
+
+static int bench_compare_u64(const void *a, const void *b)
+{
+    u64 x = *(const u64 *)a;
+    u64 y = *(const u64 *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Only counts the frame lane the timed jobs are added to.
+static u64 bench_deque_stat(wq_t *wq, b8 misses)
+{
+    u64 total = 0;
+    for (u32 i = 0; i < wq->deque_count; ++i) {
+        wq_deque_t *deque = &wq->deques[wq_lane_frame][i];
+        total += misses ? deque->steal_miss_count : deque->steal_count;
+    }
+    return total;
+}
+
+// NOTE(Wes): Background jobs add themselves back until told to stop, so the
+// same number is always queued or running next to the timed frames.
+typedef struct {
+    wq_t *wq;
+    u32 iterations;
+    u32 result;
+    volatile i32 *stop;
+    volatile i32 *running_count;
+    volatile i32 *done_count;
+} bench_background_job_t;
+
+static void bench_background_job(void *data, wq_context_t *context)
+{
+    bench_background_job_t *job = (bench_background_job_t *)data;
+    u32 x = job->result | 1;
+    for (u32 i = 0; i < job->iterations; ++i) {
+        x = x * 1664525u + 1013904223u;
+    }
+    job->result = x;
+    atomic_increment(job->done_count);
+    if (*job->stop || !wqEnqueue(job->wq, wq_lane_background, bench_background_job, job)) {
+        atomic_decrement(job->running_count);
+    }
+}
+
+// NOTE(Wes): Frames of the idle phase are this far apart so workers run out
+// of work and go to sleep between frames, like they do in a frame capped game.
+#define BENCH_IDLE_SPACING_US 1000
+#define BENCH_BACKGROUND_JOB_SCALE 50 // Background jobs do this many times the work of a frame job.
+
+// Times frames of job_count jobs, added from this thread then finished, on
+// both the work queue and the old shared ring with the same thread counts.
+// Frames run back to back under load, then spaced out while idle. With
+// background_count set the work queue also runs that many long background
+// jobs throughout, the ring has no lanes and runs without. Writes the frame
+// latency percentiles, the CPU time of every thread per frame and how often
+// threads collided.
+static void bench_jobs(FILE *out, bench_options_t *options, wq_t *work_queues)
+{
+    u32 frame_total = options->warmup_count + options->frame_count;
+    u64 *frame_ns = (u64 *)malloc(options->frame_count * sizeof(u64));
+    b8 first_run = 1;
+
+    for (u32 thread_index = 0; thread_index < options->thread_count_count; ++thread_index) {
+        u32 thread_count = options->thread_counts[thread_index];
+        bench_ring_t *ring = (bench_ring_t *)calloc(1, sizeof(bench_ring_t));
+        semaphore_init(&ring->semaphore, 0);
+        bench_ring_worker_t *ring_workers = (bench_ring_worker_t *)calloc(thread_count, sizeof(bench_ring_worker_t));
+        for (u32 i = 0; i + 1 < thread_count; ++i) {
+            ring_workers[i].ring = ring;
+            create_thread(bench_ring_thread_proc, &ring_workers[i]);
+        }
+        bench_ring_worker_t *ring_caller = &ring_workers[thread_count - 1];
+        wq_t *wq = &work_queues[thread_index];
+
+        for (u32 count_index = 0; count_index < options->job_count_count; ++count_index) {
+            u32 job_count = options->job_counts[count_index];
+            bench_job_t *jobs = (bench_job_t *)calloc(job_count, sizeof(bench_job_t));
+            for (u32 i = 0; i < job_count; ++i) {
+                jobs[i].iterations = options->job_iterations;
+            }
+
+            for (u32 phase = 0; phase < 2; ++phase)
+            for (u32 use_ring = 0; use_ring < 2; ++use_ring) {
+                u32 spacing_us = phase ? BENCH_IDLE_SPACING_US : 0;
+                u64 misses = 0;
+                u64 steals = 0;
+                u64 cpu_start_ns = 0;
+
+                volatile i32 background_stop = 0;
+                volatile i32 background_running = 0;
+                volatile i32 background_done = 0;
+                u32 background_count = use_ring ? 0 : options->background_count;
+                bench_background_job_t *background_jobs =
+                    (bench_background_job_t *)calloc(background_count + 1, sizeof(bench_background_job_t));
+                for (u32 i = 0; i < background_count; ++i) {
+                    bench_background_job_t *job = &background_jobs[i];
+                    job->wq = wq;
+                    job->iterations = options->job_iterations * BENCH_BACKGROUND_JOB_SCALE;
+                    job->stop = &background_stop;
+                    job->running_count = &background_running;
+                    job->done_count = &background_done;
+                    atomic_increment(&background_running);
+                    if (!wqEnqueue(wq, wq_lane_background, bench_background_job, job)) {
+                        atomic_decrement(&background_running);
+                    }
+                }
+                i32 background_done_start = 0;
+
+                for (u32 frame = 0; frame < frame_total; ++frame) {
+                    if (frame == options->warmup_count) {
+                        misses = use_ring ? 0 : bench_deque_stat(wq, 1);
+                        steals = use_ring ? 0 : bench_deque_stat(wq, 0);
+                        for (u32 i = 0; i < thread_count; ++i) {
+                            ring_workers[i].miss_count = 0;
+                        }
+                        cpu_start_ns = get_process_cpu_time();
+                        background_done_start = background_done;
+                    }
+                    if (spacing_us) {
+                        struct timespec spacing = {0, (long)spacing_us * 1000};
+                        nanosleep(&spacing, 0);
+                    }
+
+                    u64 start_ns = get_wall_clock();
+                    if (use_ring) {
+                        for (u32 i = 0; i < job_count; ++i) {
+                            bench_ring_enqueue(ring, bench_job, &jobs[i]);
+                        }
+                        wq_entry_t entry;
+                        while (ring->remaining_work_count > 0) {
+                            if (bench_ring_dequeue(ring, &entry, &ring_caller->miss_count)) {
+                                entry.work_fn(entry.data, &bench_ring_context);
+                                atomic_decrement(&ring->remaining_work_count);
+                            }
+                        }
+                    } else {
+                        for (u32 i = 0; i < job_count; ++i) {
+                            wqEnqueue(wq, wq_lane_frame, bench_job, &jobs[i]);
+                        }
+                        wqFinishWork(wq);
+                    }
+                    if (frame >= options->warmup_count) {
+                        frame_ns[frame - options->warmup_count] = get_wall_clock() - start_ns;
+                    }
+                }
+
+                // NOTE(Wes): Includes the spacing, where only threads that
+                // spin instead of sleeping use any.
+                u64 cpu_ns = get_process_cpu_time() - cpu_start_ns;
+                i32 background_done_count = background_done - background_done_start;
+
+                // NOTE(Wes): finish_work leaves background work running so
+                // it is drained here before the next run. Without workers
+                // nothing else runs it.
+                background_stop = 1;
+                while (background_running > 0) {
+                    wq_entry_t entry;
+                    if (wqDequeue(wq, &entry, wq_lane_background)) {
+                        wq_run_entry(wq, &entry);
+                    } else {
+                        struct timespec wait = {0, 100000};
+                        nanosleep(&wait, 0);
+                    }
+                }
+                free(background_jobs);
+                if (use_ring) {
+                    for (u32 i = 0; i < thread_count; ++i) {
+                        misses += ring_workers[i].miss_count;
+                    }
+                } else {
+                    misses = bench_deque_stat(wq, 1) - misses;
+                    steals = bench_deque_stat(wq, 0) - steals;
+                }
+
+                u64 total_ns = 0;
+                for (u32 i = 0; i < options->frame_count; ++i) {
+                    total_ns += frame_ns[i];
+                }
+                qsort(frame_ns, options->frame_count, sizeof(u64), bench_compare_u64);
+                f64 job_total = (f64)job_count * options->frame_count;
+
+                fprintf(out, "%s\n    {\"queue\": \"%s\", \"phase\": \"%s\", \"spacing_us\": %u, "
+                        "\"threads\": %u, \"jobs\": %u, \"job_iterations\": %u, \"background_jobs\": %u, ",
+                        first_run ? "" : ",", use_ring ? "ring" : "deques", phase ? "idle" : "load", spacing_us,
+                        thread_count, job_count, options->job_iterations, background_count);
+                fprintf(out, "\"us_per_frame\": {\"mean\": %.2f, \"p50\": %.2f, \"p99\": %.2f, \"max\": %.2f}, ",
+                        total_ns / 1e3 / options->frame_count,
+                        frame_ns[options->frame_count / 2] / 1e3,
+                        frame_ns[(options->frame_count * 99) / 100] / 1e3,
+                        frame_ns[options->frame_count - 1] / 1e3);
+                fprintf(out, "\"cpu_us_per_frame\": %.2f, \"background_jobs_per_frame\": %.2f, ",
+                        cpu_ns / 1e3 / options->frame_count, (f64)background_done_count / options->frame_count);
+                fprintf(out, "\"cas_misses_per_job\": %.4f, \"steals_per_job\": %.4f}",
+                        misses / job_total, use_ring ? 0.0 : steals / job_total);
+                fflush(out);
+                first_run = 0;
+            }
+            free(jobs);
+        }
+        // NOTE(Wes): The ring workers are left sleeping on their semaphore.
+    }
+    free(frame_ns);
+}
+
+// NOTE(Wes): The allocator the entity pool replaced, kept to compare against.
+// Scans from the start for a slot that does not exist.
+static u32 bench_linear_alloc(entity_t *entities, u32 capacity)
+{
+    static const entity_t zero_entity = {0};
+    for (u32 i = 1; i < capacity; ++i) {
+        entity_t *entity = &entities[i];
+        if (!entity->exists) {
+            *entity = zero_entity;
+            entity->exists = 1;
+            return i;
+        }
+    }
+    return 0;
+}
+
+// Spawns entity_count entities then despawns a random one and spawns another
+// in its place entity_churn_count times, checking the despawned handle no
+// longer resolves. The old linear scan allocator is timed on the same churn
+// with fewer rounds as each of its spawns walks half the pool. Then times
+// frame_count integration steps over the churned pool with the SIMD and the
+// scalar integrator and checks they agree. Returns the number of failed
+// checks.
+static u32 bench_entities(FILE *out, bench_options_t *options)
+{
+    u32 entity_count = options->entity_count;
+    u32 churn_count = options->entity_churn_count;
+    u32 failed_count = 0;
+
+    u32 block_count = entity_count / GG_ENTITY_BLOCK_SIZE + 1;
+    u32 arena_size = block_count * GG_ENTITY_BLOCK_BYTES;
+    memory_arena_t arena;
+    init_arena(&arena, arena_size, (u8 *)malloc(arena_size));
+    static entity_pool_t pool;
+    entity_pool_init(&pool, &arena);
+    entity_handle_t *handles = (entity_handle_t *)malloc(entity_count * sizeof(entity_handle_t));
+
+    u64 start_ns = get_wall_clock();
+    for (u32 i = 0; i < entity_count; ++i) {
+        handles[i] = entity_alloc(&pool);
+    }
+    u64 spawn_ns = get_wall_clock() - start_ns;
+    for (u32 i = 0; i < entity_count; ++i) {
+        if (!entity_get(&pool, handles[i])) {
+            ++failed_count;
+        }
+    }
+
+    u32 random_state = options->seed * 2654435761u + 1;
+    u32 stale_count = 0;
+    start_ns = get_wall_clock();
+    for (u32 i = 0; i < churn_count; ++i) {
+        u32 slot = bench_random(&random_state) % entity_count;
+        entity_handle_t old_handle = handles[slot];
+        entity_free(&pool, old_handle);
+        handles[slot] = entity_alloc(&pool);
+        stale_count += entity_get(&pool, old_handle) == 0;
+    }
+    u64 churn_ns = get_wall_clock() - start_ns;
+    failed_count += churn_count - stale_count;
+
+    // NOTE(Wes): Summed so the lookups are not thrown away.
+    f32 position_sum = 0.0f;
+    start_ns = get_wall_clock();
+    for (u32 i = 0; i < entity_count; ++i) {
+        entity_t *entity = entity_get(&pool, handles[i]);
+        if (!entity) {
+            ++failed_count;
+            continue;
+        }
+        position_sum += entity_position(&pool, entity).x;
+    }
+    u64 get_ns = get_wall_clock() - start_ns;
+    if (pool.live_count != entity_count || pool.count != entity_count + 1) {
+        ++failed_count;
+    }
+
+    // NOTE(Wes): Churn leaves the motions in a shuffled order, each must
+    // still point back at its entity.
+    for (u32 i = 0; i < pool.live_count; ++i) {
+        entity_motion_t *motion = pool.motions[i / GG_ENTITY_BLOCK_SIZE];
+        if (entity_at(&pool, motion->slot[i % GG_ENTITY_BLOCK_SIZE])->motion_index != i) {
+            ++failed_count;
+        }
+    }
+
+    u64 integrate_ns[2];
+    u32 motion_bytes = block_count * sizeof(entity_motion_t);
+    entity_motion_t *simd_motions = (entity_motion_t *)malloc(motion_bytes);
+    f32 max_difference = 0.0f;
+    for (u32 kernel = 0; kernel < 2; ++kernel) {
+        random_state = options->seed * 2654435761u + 1;
+        for (u32 i = 0; i < pool.live_count; ++i) {
+            entity_motion_t *motion = pool.motions[i / GG_ENTITY_BLOCK_SIZE];
+            u32 lane = i % GG_ENTITY_BLOCK_SIZE;
+            motion->velocity_x[lane] = bench_random_unit(&random_state) * 40.0f - 20.0f;
+            motion->velocity_y[lane] = bench_random_unit(&random_state) * 40.0f - 20.0f;
+            motion->acceleration_x[lane] = bench_random_unit(&random_state) * 200.0f - 100.0f;
+            motion->acceleration_y[lane] = bench_random_unit(&random_state) * 200.0f - 100.0f;
+            motion->velocity_factor[lane] = -7.0f * bench_random_unit(&random_state);
+        }
+
+        start_ns = get_wall_clock();
+        for (u32 frame = 0; frame < options->frame_count; ++frame) {
+            if (kernel == 0) {
+                entity_integrate(&pool, 1.0f / 60.0f);
+            } else {
+                entity_integrate_reference(&pool, 1.0f / 60.0f);
+            }
+        }
+        integrate_ns[kernel] = get_wall_clock() - start_ns;
+
+        if (kernel == 0) {
+            for (u32 i = 0; i < block_count; ++i) {
+                simd_motions[i] = *pool.motions[i];
+            }
+            continue;
+        }
+        for (u32 i = 0; i < pool.live_count; ++i) {
+            entity_motion_t *simd = &simd_motions[i / GG_ENTITY_BLOCK_SIZE];
+            entity_motion_t *reference = pool.motions[i / GG_ENTITY_BLOCK_SIZE];
+            u32 lane = i % GG_ENTITY_BLOCK_SIZE;
+            f32 differences[] = {
+                simd->velocity_x[lane] - reference->velocity_x[lane],
+                simd->velocity_y[lane] - reference->velocity_y[lane],
+                simd->move_x[lane] - reference->move_x[lane],
+                simd->move_y[lane] - reference->move_y[lane],
+            };
+            for (u32 j = 0; j < ARRAY_LEN(differences); ++j) {
+                f32 difference = fabsf(differences[j]);
+                max_difference = difference > max_difference ? difference : max_difference;
+            }
+        }
+    }
+    free(simd_motions);
+    if (max_difference > 1e-3f) {
+        ++failed_count;
+    }
+
+    u32 linear_capacity = entity_count + 1;
+    entity_t *linear_entities = (entity_t *)calloc(linear_capacity, sizeof(entity_t));
+    for (u32 i = 1; i < linear_capacity; ++i) {
+        linear_entities[i].exists = 1;
+    }
+    u32 linear_churn_count = churn_count / 100 + 1;
+    random_state = options->seed * 2654435761u + 1;
+    start_ns = get_wall_clock();
+    for (u32 i = 0; i < linear_churn_count; ++i) {
+        u32 index = bench_random(&random_state) % entity_count + 1;
+        linear_entities[index].exists = 0;
+        bench_linear_alloc(linear_entities, linear_capacity);
+    }
+    u64 linear_ns = get_wall_clock() - start_ns;
+
+    fprintf(out, "{\n  \"entities\": %u,\n  \"blocks\": %u,\n  \"entity_bytes\": %u,\n",
+            entity_count, pool.capacity / GG_ENTITY_BLOCK_SIZE, (u32)sizeof(entity_t));
+    fprintf(out, "  \"spawn_ns_per_entity\": %.2f,\n  \"get_ns_per_entity\": %.2f,\n",
+            (f64)spawn_ns / entity_count, (f64)get_ns / entity_count);
+    fprintf(out, "  \"pool\": {\"churn\": %u, \"ns_per_churn\": %.2f, \"stale_detected\": %u},\n",
+            churn_count, (f64)churn_ns / churn_count, stale_count);
+    f64 integrate_count = (f64)pool.live_count * options->frame_count;
+    fprintf(out, "  \"integrate\": {\"frames\": %u, \"simd_ns_per_entity\": %.3f, \"reference_ns_per_entity\": %.3f, "
+            "\"max_difference\": %g},\n",
+            options->frame_count, integrate_ns[0] / integrate_count, integrate_ns[1] / integrate_count, max_difference);
+    fprintf(out, "  \"linear_scan\": {\"churn\": %u, \"ns_per_churn\": %.2f},\n",
+            linear_churn_count, (f64)linear_ns / linear_churn_count);
+    fprintf(out, "  \"failed_checks\": %u,\n  \"position_sum\": %.1f\n}\n", failed_count, position_sum);
+
+    free(linear_entities);
+    free(handles);
+    free(arena.base);
+    return failed_count;
+}
+
+static u8 *bench_load_file(const char *path, u64 *size)
+{
+    FILE *handle = fopen(path, "rb");
+    if (!handle) {
+        return 0;
+    }
+
+    fseek(handle, 0, SEEK_END);
+    *size = (u64)ftell(handle);
+    fseek(handle, 0, SEEK_SET);
+    u8 *contents = (u8 *)malloc((size_t)*size);
+    if (contents && fread(contents, 1, (size_t)*size, handle) != *size) {
+        free(contents);
+        contents = 0;
+    }
+    fclose(handle);
+
+    return contents;
+}
+
+static u32 parse_list(const char *text, u32 *values, u32 max_count)
+{
+    u32 count = 0;
+    char *end = 0;
+    while (*text && count < max_count) {
+        values[count++] = (u32)strtoul(text, &end, 10);
+        if (*end != ',') {
+            break;
+        }
+        text = end + 1;
+    }
+    return count;
+}
+
+static u32 parse_tile_list(const char *text, u32 (*values)[2], u32 max_count)
+{
+    u32 count = 0;
+    char *end = 0;
+    while (*text && count < max_count) {
+        values[count][0] = (u32)strtoul(text, &end, 10);
+        values[count][1] = *end == 'x' ? (u32)strtoul(end + 1, &end, 10) : values[count][0];
+        ++count;
+        if (*end != ',') {
+            break;
+        }
+        text = end + 1;
+    }
+    return count;
+}
+
+static void print_usage(void)
+{
+    printf("usage: gg_render_bench [-frames <n>] [-warmup <n>] [-size <w> <h>] [-seed <n>]\n"
+           "                       [-threads 1,2,4,8] [-tiles 1x1,2x2,4x4,8x8] [-scene <name>]\n"
+           "                       [-sprites <n>] [-rotated <f>] [-sizes <min> <max>]\n"
+           "                       [-alpha <f>] [-rects <f>] [-out <file.json>]\n"
+           "                       [-verify] [-tolerance <n>] [-diff-dir <dir>] [-replay <capture.ggrq>]\n"
+           "                       [-jobs 16,1000] [-job-iterations <n>] [-background <n>]\n"
+           "                       [-scaling] [-pin] [-entities <n>] [-churn <n>]\n"
+           "scenes:");
+    for (u32 i = 0; i < ARRAY_LEN(bench_scene_presets); ++i) {
+        printf(" %s", bench_scene_presets[i].name);
+    }
+    printf("\n-sprites, -rotated, -sizes, -alpha and -rects describe a custom scene.\n"
+           "-verify compares every image kernel against the reference kernel instead of timing, then the\n"
+           "layer blend, resample and upscale rows against theirs.\n"
+           "-replay draws a render capture saved by the game instead of the scenes.\n"
+           "-jobs times frames of that many small jobs on the work queue and on the old shared ring.\n"
+           "-background keeps that many long background lane jobs running on the work queue while timing jobs.\n"
+           "-scaling sweeps the thread count from 1 to every logical CPU, -pin keeps each thread on one CPU.\n"
+           "-entities times spawn and despawn churn and -frames integration steps on an entity pool of that many\n"
+           "entities, -churn sets the churn rounds.\n");
+}
+
+static b8 parse_options(i32 argc, char *argv[], bench_options_t *options)
+{
+    options->frame_count = 100;
+    options->warmup_count = 5;
+    options->width = 1920;
+    options->height = 1080;
+    options->seed = 1;
+    options->tolerance = 2;
+    options->diff_dir = "build";
+    options->thread_count_count = parse_list("1,2,4,8", options->thread_counts, BENCH_MAX_SWEEP);
+    options->tile_count_count = parse_tile_list("1x1,2x2,4x4,8x8", options->tile_counts, BENCH_MAX_SWEEP);
+    options->job_iterations = 2000;
+    options->entity_churn_count = 1000000;
+
+    bench_scene_t custom = {"custom", 1000, 0.25f, 1.0f, 8.0f, 0.25f, 0.0f};
+    b8 use_custom = 0;
+    b8 size_set = 0;
+    for (i32 i = 1; i < argc; ++i) {
+        char *arg = argv[i];
+        b8 has_value = i + 1 < argc;
+        if (strcmp(arg, "-frames") == 0 && has_value) {
+            options->frame_count = (u32)strtoul(argv[++i], 0, 10);
+        } else if (strcmp(arg, "-warmup") == 0 && has_value) {
+            options->warmup_count = (u32)strtoul(argv[++i], 0, 10);
+        } else if (strcmp(arg, "-size") == 0 && i + 2 < argc) {
+            options->width = (u32)strtoul(argv[++i], 0, 10);
+            options->height = (u32)strtoul(argv[++i], 0, 10);
+            size_set = 1;
+        } else if (strcmp(arg, "-seed") == 0 && has_value) {
+            options->seed = (u32)strtoul(argv[++i], 0, 10);
+        } else if (strcmp(arg, "-threads") == 0 && has_value) {
+            options->thread_count_count = parse_list(argv[++i], options->thread_counts, BENCH_MAX_SWEEP);
+        } else if (strcmp(arg, "-tiles") == 0 && has_value) {
+            options->tile_count_count = parse_tile_list(argv[++i], options->tile_counts, BENCH_MAX_SWEEP);
+        } else if (strcmp(arg, "-out") == 0 && has_value) {
+            options->out_path = argv[++i];
+        } else if (strcmp(arg, "-replay") == 0 && has_value) {
+            options->replay_path = argv[++i];
+        } else if (strcmp(arg, "-jobs") == 0 && has_value) {
+            options->job_count_count = parse_list(argv[++i], options->job_counts, BENCH_MAX_SWEEP);
+        } else if (strcmp(arg, "-entities") == 0 && has_value) {
+            options->entity_count = (u32)strtoul(argv[++i], 0, 10);
+        } else if (strcmp(arg, "-churn") == 0 && has_value) {
+            options->entity_churn_count = (u32)strtoul(argv[++i], 0, 10);
+        } else if (strcmp(arg, "-job-iterations") == 0 && has_value) {
+            options->job_iterations = (u32)strtoul(argv[++i], 0, 10);
+        } else if (strcmp(arg, "-background") == 0 && has_value) {
+            options->background_count = (u32)strtoul(argv[++i], 0, 10);
+        } else if (strcmp(arg, "-scaling") == 0) {
+            options->scaling = 1;
+        } else if (strcmp(arg, "-pin") == 0) {
+            options->pin_threads = 1;
+        } else if (strcmp(arg, "-verify") == 0) {
+            options->verify = 1;
+        } else if (strcmp(arg, "-tolerance") == 0 && has_value) {
+            options->tolerance = (u32)strtoul(argv[++i], 0, 10);
+        } else if (strcmp(arg, "-diff-dir") == 0 && has_value) {
+            options->diff_dir = argv[++i];
+        } else if (strcmp(arg, "-scene") == 0 && has_value) {
+            char *name = argv[++i];
+            b8 found = 0;
+            for (u32 j = 0; j < ARRAY_LEN(bench_scene_presets); ++j) {
+                if (strcmp(name, bench_scene_presets[j].name) == 0 && options->scene_count < BENCH_MAX_SCENES) {
+                    options->scenes[options->scene_count++] = bench_scene_presets[j];
+                    found = 1;
+                }
+            }
+            if (!found) {
+                return 0;
+            }
+        } else if (strcmp(arg, "-sprites") == 0 && has_value) {
+            custom.sprite_count = (u32)strtoul(argv[++i], 0, 10);
+            use_custom = 1;
+        } else if (strcmp(arg, "-rotated") == 0 && has_value) {
+            custom.rotated_fraction = strtof(argv[++i], 0);
+            use_custom = 1;
+        } else if (strcmp(arg, "-sizes") == 0 && i + 2 < argc) {
+            custom.min_size = strtof(argv[++i], 0);
+            custom.max_size = strtof(argv[++i], 0);
+            use_custom = 1;
+        } else if (strcmp(arg, "-alpha") == 0 && has_value) {
+            custom.translucent_fraction = strtof(argv[++i], 0);
+            use_custom = 1;
+        } else if (strcmp(arg, "-rects") == 0 && has_value) {
+            custom.rect_fraction = strtof(argv[++i], 0);
+            use_custom = 1;
+        } else {
+            return 0;
+        }
+    }
+
+    // NOTE(Wes): Verify renders a handful of frames per scene so a smaller
+    // frame keeps it quick.
+    if (options->verify && !size_set) {
+        options->width = 640;
+        options->height = 360;
+    }
+
+    if (use_custom && options->scene_count < BENCH_MAX_SCENES) {
+        options->scenes[options->scene_count++] = custom;
+    }
+    if (!options->scene_count) {
+        for (u32 i = 0; i < ARRAY_LEN(bench_scene_presets); ++i) {
+            options->scenes[options->scene_count++] = bench_scene_presets[i];
+        }
+    }
+
+    for (u32 i = 0; i < options->thread_count_count; ++i) {
+        if (options->thread_counts[i] == 0) {
+            return 0;
+        }
+    }
+    for (u32 i = 0; i < options->job_count_count; ++i) {
+        // NOTE(Wes): Every job of a frame is added before any is finished.
+        if (options->job_counts[i] == 0 || options->job_counts[i] >= WQ_SIZE) {
+            return 0;
+        }
+    }
+    // NOTE(Wes): Slot 0 is never handed out so the index bits hold one less.
+    if (options->entity_count > GG_ENTITY_INDEX_MASK || (options->entity_count && !options->entity_churn_count)) {
+        return 0;
+    }
+    for (u32 i = 0; i < options->tile_count_count; ++i) {
+        u32 tiles = options->tile_counts[i][0] * options->tile_counts[i][1];
+        if (tiles == 0 || tiles > GG_RENDER_MAX_TILES) {
+            return 0;
+        }
+    }
+
+    // NOTE(Wes): The rasterizer works on 4 pixels at a time.
+    return options->frame_count && options->width && options->height && (options->width & 3) == 0 &&
+           options->thread_count_count && options->tile_count_count;
+}
+
+int main(int argc, char *argv[])
+{
+    static bench_options_t options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage();
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (options.out_path) {
+        out = fopen(options.out_path, "w");
+        if (!out) {
+            fprintf(stderr, "Failed to open %s\n", options.out_path);
+            return 1;
+        }
+    }
+
+    if (options.entity_count) {
+        u32 failed_count = bench_entities(out, &options);
+        if (out != stdout) {
+            fclose(out);
+        }
+        if (failed_count) {
+            fprintf(stderr, "%u entity pool checks failed\n", failed_count);
+        }
+        return failed_count ? 1 : 0;
+    }
+
+    cpu_topology_t topology;
+    get_cpu_topology(&topology);
+    if (options.scaling) {
+        options.thread_count_count = topology.logical_count < BENCH_MAX_SWEEP ? topology.logical_count : BENCH_MAX_SWEEP;
+        for (u32 i = 0; i < options.thread_count_count; ++i) {
+            options.thread_counts[i] = i + 1;
+        }
+    }
+
+    // NOTE(Wes): Each thread count gets its own queue and workers. The
+    // calling thread also works while finishing so a count of 1 has no workers.
+    static wq_t work_queues[BENCH_MAX_SWEEP];
+    game_work_queues_t game_work_queues[BENCH_MAX_SWEEP];
+    for (u32 i = 0; i < options.thread_count_count; ++i) {
+        wq_config_t wq_config;
+        wqDefaultConfig(&wq_config);
+        wq_config.worker_count = (i32)options.thread_counts[i] - 1;
+        wq_config.pin_threads = options.pin_threads;
+        wqCreate(&work_queues[i]);
+        thread_info_t *thread_infos = (thread_info_t *)calloc(WQ_MAX_THREADS, sizeof(thread_info_t));
+        wqStartPool(&work_queues[i], thread_infos, &wq_config, &topology);
+
+        game_work_queues[i].render_work_queue = &work_queues[i];
+        game_work_queues[i].add_work = wqEnqueue;
+        game_work_queues[i].finish_work = wqFinishWork;
+        game_work_queues[i].add_jobs = wqAddJobs;
+        game_work_queues[i].wait_counter = wqWaitCounter;
+        game_work_queues[i].parallel_for = wqParallelFor;
+    }
+
+    char topology_fields[128];
+    snprintf(topology_fields, sizeof(topology_fields),
+             "  \"physical_cores\": %u,\n  \"logical_cores\": %u,\n  \"pinned\": %s,\n",
+             topology.physical_count, topology.logical_count, options.pin_threads ? "true" : "false");
+
+    if (options.job_count_count) {
+        fprintf(out, "{\n%s  \"frames\": %u,\n  \"warmup\": %u,\n", topology_fields, options.frame_count, options.warmup_count);
+        fprintf(out, "  \"runs\": [");
+        bench_jobs(out, &options, work_queues);
+        fprintf(out, "\n  ]\n}\n");
+        if (out != stdout) {
+            fclose(out);
+        }
+        return 0;
+    }
+
+    image_t textures[BENCH_TEXTURE_COUNT];
+    sprite_t texture_sprites[BENCH_TEXTURE_COUNT];
+    for (u32 i = 0; i < BENCH_TEXTURE_COUNT; ++i) {
+        bench_make_texture(&textures[i], 32u << i, i);
+        sprite_t sprite = {&textures[i], 0, 0, textures[i].w, textures[i].h};
+        texture_sprites[i] = sprite;
+    }
+
+    camera_t camera = {0};
+    camera.units_to_pixels = options.width / BENCH_VIEW_WIDTH;
+
+    memory_arena_t arena;
+    render_queue_t *queue = 0;
+    if (options.replay_path) {
+        // NOTE(Wes): A replay draws the captured queue at the captured size.
+        u64 capture_size = 0;
+        u8 *capture = bench_load_file(options.replay_path, &capture_size);
+        u32 arena_size = (u32)render_capture_load_size(capture, capture_size) + Kilobytes(64);
+        init_arena(&arena, arena_size, (u8 *)malloc(arena_size));
+        if (capture) {
+            queue = render_load_capture(capture, capture_size, &arena, &camera, &options.width, &options.height);
+        }
+        if (!queue || (options.width & 3) != 0) {
+            fprintf(stderr, "%s is not a compatible render capture\n", options.replay_path);
+            return 1;
+        }
+    } else {
+        u32 max_sprites = 0;
+        for (u32 i = 0; i < options.scene_count; ++i) {
+            max_sprites = options.scenes[i].sprite_count > max_sprites ? options.scenes[i].sprite_count : max_sprites;
+        }
+        u32 queue_size = (max_sprites + 1) * sizeof(render_cmd_image_t) + Kilobytes(1);
+        init_arena(&arena, queue_size + Kilobytes(64), (u8 *)malloc(queue_size + Kilobytes(64)));
+        queue = render_alloc_queue(&arena, queue_size, &camera);
+    }
+
+    game_frame_buffer_t frame_buffer = bench_alloc_frame_buffer(options.width, options.height);
+
+    if (options.verify) {
+        memory_arena_t atlas_arena;
+        u64 atlas_size = GG_ATLAS_PAGE_SIZE * GG_ATLAS_PAGE_SIZE * sizeof(u32);
+        init_arena(&atlas_arena, atlas_size, (u8 *)malloc(atlas_size));
+        static atlas_t atlas;
+        sprite_t atlas_sprites[BENCH_TEXTURE_COUNT];
+        atlas_init(&atlas, &atlas_arena, GG_ATLAS_PAGE_SIZE);
+        if (!atlas_add_images(&atlas, textures, atlas_sprites, BENCH_TEXTURE_COUNT)) {
+            fprintf(stderr, "Failed to pack the bench textures\n");
+            return 1;
+        }
+
+        u32 failed_count = bench_verify(&options, queue, texture_sprites, atlas_sprites, &game_work_queues[0]);
+        if (failed_count) {
+            printf("%u kernel comparisons failed, images written to %s\n", failed_count, options.diff_dir);
+        }
+        return failed_count ? 1 : 0;
+    }
+
+    fprintf(out, "{\n%s  \"frame_width\": %u,\n  \"frame_height\": %u,\n", topology_fields, options.width, options.height);
+    fprintf(out, "  \"frames\": %u,\n  \"warmup\": %u,\n  \"seed\": %u,\n", options.frame_count, options.warmup_count, options.seed);
+    fprintf(out, "  \"runs\": [");
+    b8 first_run = 1;
+    char scene_fields[512];
+    if (options.replay_path) {
+        snprintf(scene_fields, sizeof(scene_fields), "\"scene\": \"replay\", \"capture\": \"%s\", \"command_bytes\": %u, ",
+                 options.replay_path, queue->index);
+        bench_sweep(out, &options, queue, &frame_buffer, game_work_queues, scene_fields, &first_run);
+    }
+    for (u32 scene_index = 0; !options.replay_path && scene_index < options.scene_count; ++scene_index) {
+        bench_scene_t *scene = &options.scenes[scene_index];
+        bench_build_scene(queue, scene, scene->sprite_count, texture_sprites, options.seed);
+
+        snprintf(scene_fields, sizeof(scene_fields),
+                 "\"scene\": \"%s\", \"sprites\": %u, \"rotated\": %.2f, \"sizes\": [%.2f, %.2f], \"alpha\": %.2f, \"rects\": %.2f, ",
+                 scene->name, scene->sprite_count, scene->rotated_fraction, scene->min_size, scene->max_size,
+                 scene->translucent_fraction, scene->rect_fraction);
+        bench_sweep(out, &options, queue, &frame_buffer, game_work_queues, scene_fields, &first_run);
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
@@ -4,31 +4,6 @@
 #include "gg_platform.h"
 #include "gg_vec.h"
 
-// Note(Wes): Memory
-typedef struct {
-    u64 size;
-    u32 index;
-    u8 *base;
-} memory_arena_t;
-
-static inline void init_arena(memory_arena_t *arena, u64 size, u8 *base)
-{
-    arena->size = size;
-    arena->base = base;
-    arena->index = 0;
-}
-
-#define push_struct(arena, type) (type *) push_size(arena, sizeof(type))
-#define push_array(arena, count, type) (type *) push_size(arena, (count) * sizeof(type))
-static inline void *push_size(memory_arena_t *arena, u32 size)
-{
-    assert((arena->index + size) <= arena->size);
-    void *result = arena->base + arena->index;
-    arena->index += size;
-
-    return result;
-}
-
 typedef struct {
     v2 pos;
     v2 size;
@@ -40,6 +15,115 @@ typedef struct {
     u32 h;
 } image_t;
 
+// NOTE(Wes): A sub-rect of an image. Sprites packed into an atlas reference
+// the atlas page they live in.
+typedef struct {
+    image_t *image;
+    u32 x;
+    u32 y;
+    u32 w;
+    u32 h;
+} sprite_t;
+
+// Note(Wes): Atlas
+#define GG_ATLAS_MAX_PAGES 4
+#define GG_ATLAS_PAGE_SIZE 1024
+
+// NOTE(Wes): Every packed image is surrounded by a border of this many texels
+// that repeats its edge texels so bilinear sampling never bleeds into a
+// neighbouring sprite.
+#define GG_ATLAS_PADDING 1
+
+// A horizontal segment of the skyline. Everything below y in [x, x + w) is
+// considered used.
+typedef struct {
+    u16 x;
+    u16 y;
+    u16 w;
+} atlas_skyline_node_t;
+
+typedef struct {
+    image_t image;
+    u32 node_count;
+    atlas_skyline_node_t nodes[GG_ATLAS_PAGE_SIZE];
+} atlas_page_t;
+
+typedef struct {
+    memory_arena_t *arena;
+    u32 page_size;
+    u32 page_count;
+    atlas_page_t pages[GG_ATLAS_MAX_PAGES];
+} atlas_t;
+
+// Note(Wes): Sprites packed into the atlas at load time.
+typedef enum {
+    sprite_id_tile,
+    sprite_id_player,
+    sprite_id_teleporter_blue,
+    sprite_id_teleporter_gray,
+    sprite_id_teleporter_green,
+    sprite_id_teleporter_red,
+    sprite_id_teleporter_yellow,
+    sprite_id_count
+} sprite_id_t;
+
+// Note(Wes): Animation
+typedef enum {
+    anim_clip_walk_with_sword,
+    anim_clip_attack_with_sword,
+    anim_clip_sword_stop,
+    anim_clip_walk_with_bow,
+    anim_clip_attack_with_bow,
+    anim_clip_bow_stop,
+    anim_clip_push,
+    anim_clip_count
+} anim_clip_id_t;
+
+// NOTE(Wes): All frames of a clip are packed side by side into a single atlas
+// strip. Clips are shared by every entity playing them.
+typedef struct {
+    sprite_t strip;
+    u32 frame_count;
+    u32 frame_stride; // Texels between the left edges of consecutive frames.
+    f32 seconds_per_frame;
+    b8 loops;
+} anim_clip_t;
+
+#define GG_ANIM_NONE 0xFFFF
+// NOTE(Wes): Only entities that animate take a state, so this caps animated
+// entities while the entity pool grows to GG_ENTITY_INDEX_MASK slots. Once
+// every state is taken anim_alloc returns 0 and new entities do not animate.
+// States are given back by despawn_entity.
+#define GG_MAX_ANIM_STATES 1024
+typedef struct {
+    u32 count; // Slot 0 is the "null" animation.
+    u32 first_free;
+    u16 clip[GG_MAX_ANIM_STATES];
+    u16 frame[GG_MAX_ANIM_STATES];
+    f32 time[GG_MAX_ANIM_STATES];
+    u16 next_free[GG_MAX_ANIM_STATES];
+} anim_states_t;
+
+// Note(Wes): Parallax
+typedef struct {
+    image_t source; // Premultiplied texels as loaded.
+    image_t cache;  // Source resampled to screen pixels, in frame buffer order.
+    u32 cache_capacity; // In pixels.
+    f32 cached_units_to_pixels;
+    f32 scroll_factor;
+    b8 opaque;
+} parallax_layer_t;
+
+#define GG_MAX_PARALLAX_LAYERS 8
+typedef struct {
+    // World size covered by a layer as tall as the tallest layer before it
+    // repeats horizontally. Shorter layers sit on the bottom edge.
+    v2 size;
+    u32 reference_height;
+    u32 layer_count;
+    parallax_layer_t layers[GG_MAX_PARALLAX_LAYERS]; // Back to front.
+} parallax_t;
+
 typedef struct {
     unsigned char tiles[18 * 32];
     v2 tile_size;
@@ -52,22 +136,36 @@ typedef enum {
     entity_type_player,
 } entity_type_t;
 
+// NOTE(Wes): Entities are referred to by handles holding the slot index in
+// the low bits and the slot's generation above them. Freeing a slot bumps its
+// generation so a handle kept past the free stops resolving rather than
+// pointing at whatever reuses the slot. The generation wraps after 4096
+// reuses of a slot. Handle 0 is never valid.
+typedef u32 entity_handle_t;
+#define GG_ENTITY_INDEX_BITS 20
+#define GG_ENTITY_INDEX_MASK ((1u << GG_ENTITY_INDEX_BITS) - 1)
+#define GG_ENTITY_GENERATION_MASK ((1u << (32 - GG_ENTITY_INDEX_BITS)) - 1)
+
 #define GG_MAX_HIT_ENTITIES 4
 typedef struct {
-    u32 hit_entities[GG_MAX_HIT_ENTITIES];
+    entity_handle_t hit_entities[GG_MAX_HIT_ENTITIES];
 } entity_player_t;
 
+// NOTE(Wes): Position, velocity, acceleration and drag are kept apart from
+// the entity in entity_motion_t, see entity_position.
 typedef struct {
-    v2 position;
     v2 size;
-    v2 velocity;
-    v2 acceleration;
 
-    f32 velocity_factor;
     f32 acceleration_factor;
     f32 rotation;
+    f32 facing; // 1 when facing right, -1 when facing left.
+
+    u32 anim;
 
     b8 exists;
+    u32 generation;   // Kept when the slot is reused, see entity_handle_t.
+    u32 next_free;    // Only while the slot is free.
+    u32 motion_index; // Only while the slot exists.
 
     entity_type_t type;
     union {
@@ -75,6 +173,38 @@ typedef struct {
     };
 } entity_t;
 
+// NOTE(Wes): Slots live in blocks pushed onto the arena as the pool grows so
+// entities never move. Freed slots are kept on a list and reused first.
+#define GG_ENTITY_BLOCK_SIZE 1024
+#define GG_MAX_ENTITY_BLOCKS ((1u << GG_ENTITY_INDEX_BITS) / GG_ENTITY_BLOCK_SIZE)
+
+// NOTE(Wes): What integration touches, one array per component so it runs
+// 4 entities at a time. The first live_count motions of the pool belong to
+// live entities in no particular order, freeing an entity moves the last
+// motion into its place.
+typedef struct {
+    f32 position_x[GG_ENTITY_BLOCK_SIZE];
+    f32 position_y[GG_ENTITY_BLOCK_SIZE];
+    f32 velocity_x[GG_ENTITY_BLOCK_SIZE];
+    f32 velocity_y[GG_ENTITY_BLOCK_SIZE];
+    f32 acceleration_x[GG_ENTITY_BLOCK_SIZE];
+    f32 acceleration_y[GG_ENTITY_BLOCK_SIZE];
+    f32 velocity_factor[GG_ENTITY_BLOCK_SIZE];
+    f32 move_x[GG_ENTITY_BLOCK_SIZE]; // Position change wanted by the last integration.
+    f32 move_y[GG_ENTITY_BLOCK_SIZE];
+    u32 slot[GG_ENTITY_BLOCK_SIZE];   // Index of the entity the motion belongs to.
+} entity_motion_t;
+
+typedef struct {
+    memory_arena_t *arena;
+    u32 count;      // Slots handed out so far. Slot 0 is the "null" entity.
+    u32 capacity;   // Slots in the blocks pushed so far.
+    u32 live_count;
+    u32 first_free; // 0 when no slot is free.
+    entity_t *blocks[GG_MAX_ENTITY_BLOCKS];
+    entity_motion_t *motions[GG_MAX_ENTITY_BLOCKS];
+} entity_pool_t;
+
 // Note(Wes): Renderer
 typedef struct {
     v2 position;
@@ -95,34 +225,118 @@ typedef struct {
     v2 y_axis;
 } basis_t;
 
+// NOTE(Wes): Image rasterizers. The reference kernel is the plain scalar
+// version that the optimized ones are verified against.
+typedef enum {
+    render_image_kernel_simd,
+    render_image_kernel_reference,
+    render_image_kernel_count
+} render_image_kernel_t;
+
+#define GG_RENDER_TILE_X_COUNT 4
+#define GG_RENDER_TILE_Y_COUNT 4
+#define GG_RENDER_MAX_TILES 256
 typedef struct {
     camera_t *camera;
 
     u32 size;
     u32 index;
     u8 *base;
+
+    // NOTE(Wes): The frame buffer is split into a grid of tiles which are
+    // drawn in parallel. The cycles spent on each tile during the last draw
+    // are kept for profiling.
+    u32 tile_x_count;
+    u32 tile_y_count;
+    u64 tile_cycles[GG_RENDER_MAX_TILES];
+
+    render_image_kernel_t image_kernel;
+
+    // NOTE(Wes): When set every pixel write during a draw increments the
+    // pixel's counter. It must hold w * h counters.
+    u32 *overdraw;
 } render_queue_t;
 
+// An image render captures may reference. When source is set the image is a
+// resample of it, so the smaller source is captured instead of the image.
+typedef struct {
+    image_t *image;
+    image_t *source;
+} render_capture_asset_t;
+
+// NOTE(Wes): A queue being drawn by the work queue's threads while the caller
+// carries on, see render_begin_draw_queue. A job per tile.
+struct render_draw_t;
+typedef struct {
+    struct render_draw_t *draw;
+    u32 tile_index;
+} render_tile_job_t;
+
+typedef struct render_draw_t {
+    render_queue_t *queue;
+    game_frame_buffer_t *frame_buffer;
+    wq_counter_t counter;
+    wq_job_t jobs[GG_RENDER_MAX_TILES];
+    render_tile_job_t tiles[GG_RENDER_MAX_TILES];
+} render_draw_t;
+
+// NOTE(Wes): A frame's commands along with the camera and light they point
+// at, so the world can move on while the frame is still being drawn.
+#define GG_RENDER_FRAMES 2
+typedef struct {
+    render_queue_t *queue;
+    camera_t camera;
+    light_t light;
+    u32 frame_width; // The frame buffer size the commands were built for.
+    u32 frame_height;
+} render_frame_t;
+
 // Note(Wes): Game
-#define GG_MAX_ENTITIES 512
 typedef struct {
-    entity_t entities[GG_MAX_ENTITIES];           // Entity 0 is the "null" entity
-    u32 controlled_entities[GG_MAX_CONTROLLERS];
+    entity_pool_t entities;
+    entity_handle_t controlled_entities[GG_MAX_CONTROLLERS];
     tilemap_t tilemap;
     camera_t camera;
     v2 gravity; // units/sec^2
 } world_t;
 
+// NOTE(Wes): In game view of the platform's profile, see gg_profiler.h.
+typedef enum {
+    profiler_button_toggle,
+    profiler_button_prev,
+    profiler_button_next,
+    profiler_button_slowest,
+    profiler_button_count
+} profiler_button_t;
+
+typedef struct {
+    b8 enabled;
+    b8 was_down[profiler_button_count];
+    i32 selected_frame; // History index of the inspected frame, -1 when live.
+    image_t image;      // Frame buffer pixel order, as wide as the frame.
+} profiler_overlay_t;
+
+#define GG_MAX_LAST_LIGHTS 64
 typedef struct {
     world_t world;
-    image_t background_image;
-    image_t tile_image;
-    image_t player_image;
+    parallax_t parallax;
     image_t player_normal;
 
+    atlas_t atlas;
+    sprite_t sprites[sprite_id_count];
+    anim_clip_t clips[anim_clip_count];
+    anim_states_t anims;
+
     memory_arena_t arena;
     memory_arena_t frame_arena;
 
+    // NOTE(Wes): With pipelined set by the platform the frame built by one
+    // call is drawn during the next while it simulates, see
+    // game_update_and_render. render_queue is the queue of the frame being built.
+    render_frame_t frames[GG_RENDER_FRAMES];
+    u32 frame_index;
+    b8 frame_pending; // The other frame is built but not drawn yet.
+    render_draw_t draw;
     render_queue_t *render_queue;
 
     f32 t_sine;
@@ -132,5 +346,22 @@ typedef struct {
 
 #ifdef GG_EDITOR
     b8 editor_enabled;
+
+    // NOTE(Wes): Overdraw view. The counters are sized for the largest frame.
+    b8 overdraw_enabled;
+    b8 overdraw_was_down;
+    u32 *overdraw;
+
+    profiler_overlay_t profiler;
+#endif
+
+#ifdef GG_INTERNAL
+    // NOTE(Wes): Copy of the previous frame's commands so a frame found to be
+    // over budget after it was drawn can still be captured.
+    render_queue_t *last_render_queue;
+    light_t last_lights[GG_MAX_LAST_LIGHTS];
+    camera_t last_camera;
+    u32 last_frame_width;
+    u32 last_frame_height;
 #endif
 } game_state_t;
@@ -1,3 +1,8 @@
 #include "gg.c"
 #include "gg_collider.c"
+#include "gg_atlas.c"
+#include "gg_anim.c"
+#include "gg_entity.c"
+#include "gg_parallax.c"
+#include "gg_profiler.c"
 #include "gg_render.c"
\ No newline at end of file
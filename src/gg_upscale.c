@@ -0,0 +1,147 @@
+// NOTE(Wes): Bilinear upscale of a frame buffer rendered at a lower
+// resolution back up to the presentation size, see dynamic resolution in the
+// SDL host. Shared with the render bench so it can be verified.
+#include <emmintrin.h>
+
+#define UPSCALE_MAX_WIDTH 4096
+
+typedef struct {
+    game_frame_buffer_t *src;
+    u8 *dest;
+    u32 dest_w;
+    u32 dest_h;
+    u32 dest_pitch;
+    u16 *x_table;
+    i16 *fx_table;
+} upscale_work_t;
+
+typedef struct {
+    u32 src_w;
+    u32 dest_w;
+    u16 x_table[UPSCALE_MAX_WIDTH]; // Left source texel of each destination pixel.
+    i16 fx_table[UPSCALE_MAX_WIDTH]; // Weight of the right texel, 0-128.
+    upscale_work_t work;
+} upscaler_t;
+
+// Bilinearly scales destination rows begin to end. Each destination row first
+// blends the two source rows it lies between into 16 bit channels, kept in
+// the thread's scratch arena, then blends horizontally. Weights are 7 bit,
+// rounded, so the signed 16 bit products cannot overflow.
+static void upscale_rows(void *user, u32 begin, u32 end, wq_context_t *context)
+{
+    upscale_work_t *work = (upscale_work_t *)user;
+    game_frame_buffer_t *src = work->src;
+    u16 *row = push_array(context->scratch, UPSCALE_MAX_WIDTH * 4, u16);
+    __m128i zero = _mm_setzero_si128();
+    __m128i half = _mm_set1_epi16(64); // Rounds the weighted differences.
+    f32 scale_y = (f32)src->h / (f32)work->dest_h;
+
+    for (u32 y = begin; y < end; ++y) {
+        f32 src_y = ((f32)y + 0.5f) * scale_y - 0.5f;
+        if (src_y < 0.0f) {
+            src_y = 0.0f;
+        }
+        u32 y0 = (u32)src_y;
+        if (y0 > src->h - 1) {
+            y0 = src->h - 1;
+        }
+        u32 y1 = y0 + 1 < src->h ? y0 + 1 : y0;
+        __m128i fy = _mm_set1_epi16((i16)((src_y - y0) * 128.0f + 0.5f));
+
+        u8 *row0 = src->data + y0 * src->pitch;
+        u8 *row1 = src->data + y1 * src->pitch;
+        for (u32 x = 0; x < src->w; x += 2) {
+            __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)(row0 + x * GG_BYTES_PP)), zero);
+            __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)(row1 + x * GG_BYTES_PP)), zero);
+            __m128i v = _mm_add_epi16(a, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(b, a), fy), half), 7));
+            _mm_storeu_si128((__m128i *)(row + x * 4), v);
+        }
+
+        u32 *out = (u32 *)(work->dest + y * work->dest_pitch);
+        for (u32 x = 0; x < work->dest_w; ++x) {
+            __m128i left = _mm_loadu_si128((__m128i *)(row + work->x_table[x] * 4));
+            __m128i right = _mm_srli_si128(left, 8);
+            __m128i fx = _mm_set1_epi16(work->fx_table[x]);
+            __m128i v = _mm_add_epi16(left, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(right, left), fx), half), 7));
+            out[x] = (u32)_mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+        }
+    }
+}
+
+static void upscale_frame_buffer(upscaler_t *upscaler,
+                                 game_frame_buffer_t *src,
+                                 u8 *dest,
+                                 u32 dest_w,
+                                 u32 dest_h,
+                                 u32 dest_pitch,
+                                 wq_t *work_queue)
+{
+    assert(dest_w <= UPSCALE_MAX_WIDTH);
+    assert((src->w & 1) == 0 && src->w >= 2);
+    if (upscaler->src_w != src->w || upscaler->dest_w != dest_w) {
+        f32 scale_x = (f32)src->w / (f32)dest_w;
+        for (u32 x = 0; x < dest_w; ++x) {
+            f32 src_x = ((f32)x + 0.5f) * scale_x - 0.5f;
+            if (src_x < 0.0f) {
+                src_x = 0.0f;
+            }
+            u32 x0 = (u32)src_x;
+            i16 fx = (i16)((src_x - x0) * 128.0f + 0.5f);
+            if (x0 >= src->w - 1) {
+                x0 = src->w - 2;
+                fx = 128;
+            }
+            upscaler->x_table[x] = (u16)x0;
+            upscaler->fx_table[x] = fx;
+        }
+        upscaler->src_w = src->w;
+        upscaler->dest_w = dest_w;
+    }
+
+    upscale_work_t *work = &upscaler->work;
+    work->src = src;
+    work->dest = dest;
+    work->dest_w = dest_w;
+    work->dest_h = dest_h;
+    work->dest_pitch = dest_pitch;
+    work->x_table = upscaler->x_table;
+    work->fx_table = upscaler->fx_table;
+    wqParallelFor(work_queue, dest_h, 0, upscale_rows, work);
+}
+
+// One pixel at a time in floats with the same texel positions, to check
+// upscale_frame_buffer against.
+static void upscale_frame_buffer_reference(game_frame_buffer_t *src, u8 *dest, u32 dest_w, u32 dest_h, u32 dest_pitch)
+{
+    f32 scale_x = (f32)src->w / (f32)dest_w;
+    f32 scale_y = (f32)src->h / (f32)dest_h;
+    for (u32 y = 0; y < dest_h; ++y) {
+        f32 src_y = ((f32)y + 0.5f) * scale_y - 0.5f;
+        src_y = src_y < 0.0f ? 0.0f : (src_y > (f32)(src->h - 1) ? (f32)(src->h - 1) : src_y);
+        u32 y0 = (u32)src_y;
+        u32 y1 = y0 + 1 < src->h ? y0 + 1 : y0;
+        f32 fy = src_y - (f32)y0;
+
+        u32 *out = (u32 *)(dest + y * dest_pitch);
+        for (u32 x = 0; x < dest_w; ++x) {
+            f32 src_x = ((f32)x + 0.5f) * scale_x - 0.5f;
+            src_x = src_x < 0.0f ? 0.0f : (src_x > (f32)(src->w - 1) ? (f32)(src->w - 1) : src_x);
+            u32 x0 = (u32)src_x;
+            u32 x1 = x0 + 1 < src->w ? x0 + 1 : x0;
+            f32 fx = src_x - (f32)x0;
+
+            u32 a = ((u32 *)(src->data + y0 * src->pitch))[x0];
+            u32 b = ((u32 *)(src->data + y0 * src->pitch))[x1];
+            u32 c = ((u32 *)(src->data + y1 * src->pitch))[x0];
+            u32 d = ((u32 *)(src->data + y1 * src->pitch))[x1];
+            u32 result = 0;
+            for (u32 shift = 0; shift < 32; shift += 8) {
+                f32 top = ((a >> shift) & 0xFF) * (1.0f - fx) + ((b >> shift) & 0xFF) * fx;
+                f32 bottom = ((c >> shift) & 0xFF) * (1.0f - fx) + ((d >> shift) & 0xFF) * fx;
+                u32 value = (u32)(top * (1.0f - fy) + bottom * fy + 0.5f);
+                result |= (value > 255 ? 255 : value) << shift;
+            }
+            out[x] = result;
+        }
+    }
+}
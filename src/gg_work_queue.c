@@ -0,0 +1,783 @@
+// NOTE(Wes): The work queue is shared by every host. It is included after the
+// OS specific platform file which provides the atomics, semaphores and threads.
+
+// Queue stuff ===============================
+
+// NOTE(Wes): Every worker owns a Chase-Lev deque. The owner pushes and pops
+// at the bottom without contention while idle workers steal from the top of
+// a random victim, so threads only fight over the last entry of a deque.
+// Deque 0 belongs to whichever thread outside the pool adds work, the main
+// thread, and like the old shared ring only one such thread may add work.
+// Each thread has a deque per lane, see wq_lane_t.
+//
+// Threads with nothing to do spin for a little while, as work tends to come
+// in bursts, then sleep on an address until they are woken. Workers sleep on
+// the queue's wake epoch, threads waiting for work to finish sleep on the
+// count they are waiting on.
+
+typedef struct {
+    wq_fn work_fn;
+    void *data;
+    wq_counter_t *counter; // Null for work added with wqEnqueue.
+    u32 lane;
+} wq_entry_t;
+
+#define WQ_SIZE 1024 // Entries per deque, a power of two.
+#define WQ_CACHE_LINE 64
+#define WQ_SPIN_COUNT 256 // Dequeue attempts before a thread goes to sleep.
+#define WQ_WAKE_ALL 0x7FFFFFFF
+#define WQ_SCRATCH_SIZE (512 * 1024) // Scratch arena of each thread, see wq_context_t.
+
+typedef struct {
+    // NOTE(Wes): top is advanced by thieves with a CAS and bottom is only
+    // written by the owner, so they are kept on separate cache lines.
+    volatile i32 top;
+    u8 top_pad[WQ_CACHE_LINE - sizeof(i32)];
+    volatile i32 bottom;
+    u8 bottom_pad[WQ_CACHE_LINE - sizeof(i32)];
+    wq_entry_t entries[WQ_SIZE];
+
+    // NOTE(Wes): Only touched by the owner.
+    u32 random_state;
+    u32 steal_count;      // Entries this thread took from other deques.
+    u32 steal_miss_count; // Steals lost to another thread taking the same entry.
+    u8 stats_pad[WQ_CACHE_LINE - 3 * sizeof(u32)];
+} wq_deque_t;
+
+#define WQ_GRAIN_SITES 64
+
+// The chunk size parallel_for settled on for a range function.
+typedef struct {
+    wq_range_fn fn;
+    u32 grain;
+} wq_grain_t;
+
+typedef struct wq_t {
+    u32 deque_count; // Workers + 1.
+    volatile i32 remaining_work_count;  // Frame and normal entries, see wqFinishWork.
+    volatile i32 background_work_count;
+    u8 remaining_pad[WQ_CACHE_LINE - 3 * sizeof(i32)];
+
+    // NOTE(Wes): Adding work bumps the epoch and wakes as many sleeping
+    // workers as there are new entries, once per batch rather than per entry.
+    volatile i32 wake_epoch;
+    volatile i32 sleeping_count;
+    u8 wake_pad[WQ_CACHE_LINE - 2 * sizeof(i32)];
+
+    // NOTE(Wes): Per deque index, WQ_SCRATCH_SIZE each once the threads start.
+    memory_arena_t scratch[WQ_MAX_THREADS + 1];
+    volatile i32 grain_lock;
+    wq_grain_t grains[WQ_GRAIN_SITES];
+
+    wq_deque_t deques[wq_lane_count][WQ_MAX_THREADS + 1];
+} wq_t;
+
+// NOTE(Wes): Which deque the calling thread owns. Threads outside every pool
+// use deque 0 of whichever queue they add to.
+static GG_THREAD_LOCAL wq_t *wq_thread_queue;
+static GG_THREAD_LOCAL u32 wq_thread_deque;
+// NOTE(Wes): The lane of the entry the calling thread is running, so work
+// added from inside a job can keep its priority.
+static GG_THREAD_LOCAL u32 wq_thread_lane;
+
+void wqCreate(wq_t *wq)
+{
+    wq->deque_count = 1;
+    wq->remaining_work_count = 0;
+    wq->background_work_count = 0;
+    wq->wake_epoch = 0;
+    wq->sleeping_count = 0;
+    for (u32 i = 0; i < ARRAY_LEN(wq->scratch); ++i) {
+        init_arena(&wq->scratch[i], 0, 0);
+    }
+    wq->grain_lock = 0;
+    for (u32 i = 0; i < WQ_GRAIN_SITES; ++i) {
+        wq->grains[i].fn = 0;
+        wq->grains[i].grain = 0;
+    }
+    for (u32 lane = 0; lane < wq_lane_count; ++lane) {
+        for (u32 i = 0; i < ARRAY_LEN(wq->deques[lane]); ++i) {
+            wq_deque_t *deque = &wq->deques[lane][i];
+            deque->top = 0;
+            deque->bottom = 0;
+            deque->random_state = 0x9E3779B9u * (lane * ARRAY_LEN(wq->deques[lane]) + i + 1);
+            deque->steal_count = 0;
+            deque->steal_miss_count = 0;
+        }
+    }
+}
+
+static wq_deque_t *wq_get_own_deque(wq_t *wq, u32 lane)
+{
+    return &wq->deques[lane][wq_thread_queue == wq ? wq_thread_deque : 0];
+}
+
+// Counts the entries finish_work waits on, background entries are not.
+static volatile i32 *wq_get_lane_count(wq_t *wq, u32 lane)
+{
+    return lane == wq_lane_background ? &wq->background_work_count : &wq->remaining_work_count;
+}
+
+// Owner only.
+static b8 wq_push(wq_deque_t *deque, wq_fn work_fn, void *data, wq_counter_t *counter, u32 lane)
+{
+    i32 bottom = deque->bottom;
+    i32 top = deque->top;
+    if (bottom - top >= WQ_SIZE) {
+        return 0;
+    }
+
+    wq_entry_t *entry = &deque->entries[bottom & (WQ_SIZE - 1)];
+    entry->work_fn = work_fn;
+    entry->data = data;
+    entry->counter = counter;
+    entry->lane = lane;
+    // NOTE(Wes): The entry must be visible before the bottom that publishes it.
+    memory_barrier();
+    deque->bottom = bottom + 1;
+    return 1;
+}
+
+// Owner only, takes the newest entry.
+static b8 wq_pop(wq_deque_t *deque, wq_entry_t *entry)
+{
+    i32 bottom = deque->bottom - 1;
+    deque->bottom = bottom;
+    // NOTE(Wes): Thieves must see the reserved bottom before top is read,
+    // otherwise both sides could take the last entry.
+    memory_barrier();
+    i32 top = deque->top;
+    if (top > bottom) {
+        deque->bottom = bottom + 1;
+        return 0;
+    }
+
+    *entry = deque->entries[bottom & (WQ_SIZE - 1)];
+    if (top == bottom) {
+        // NOTE(Wes): The last entry goes to whoever advances top first.
+        b8 won = atomic_cas(&deque->top, top + 1, top) == top;
+        deque->bottom = bottom + 1;
+        return won;
+    }
+    return 1;
+}
+
+typedef enum {
+    wq_steal_empty,
+    wq_steal_taken,
+    wq_steal_lost, // Another thread took the entry first.
+} wq_steal_result_t;
+
+// Any thread, takes the oldest entry.
+static wq_steal_result_t wq_steal(wq_deque_t *deque, wq_entry_t *entry)
+{
+    i32 top = deque->top;
+    memory_barrier();
+    i32 bottom = deque->bottom;
+    if (top >= bottom) {
+        return wq_steal_empty;
+    }
+
+    *entry = deque->entries[top & (WQ_SIZE - 1)];
+    if (atomic_cas(&deque->top, top + 1, top) != top) {
+        return wq_steal_lost;
+    }
+    return wq_steal_taken;
+}
+
+// Wakes up to count sleeping workers for newly added entries.
+static void wq_wake_workers(wq_t *wq, u32 count)
+{
+    // NOTE(Wes): The entries are published before sleeping_count is read and
+    // a worker counts itself as sleeping before it looks for entries one last
+    // time, so either it finds them or it is woken here.
+    memory_barrier();
+    i32 sleeping = wq->sleeping_count;
+    if (sleeping > 0 && count) {
+        atomic_increment(&wq->wake_epoch);
+        wake_by_address(&wq->wake_epoch, (i32)count < sleeping ? (i32)count : sleeping);
+    }
+}
+
+b8 wqEnqueue(wq_t *wq, wq_lane_t lane, wq_fn work_fn, void *data)
+{
+    // NOTE(Wes): Counted first so the entry is never finished before it is added.
+    volatile i32 *lane_count = wq_get_lane_count(wq, lane);
+    atomic_increment(lane_count);
+    if (!wq_push(wq_get_own_deque(wq, lane), work_fn, data, 0, lane)) {
+        // Deque is full.
+        atomic_decrement(lane_count);
+        return 0;
+    }
+    DBG_MARK(add_work);
+
+    wq_wake_workers(wq, 1);
+    return 1;
+}
+
+// Takes an entry from the calling thread's own deque of lane, or failing
+// that steals one starting from a random victim.
+static b8 wq_dequeue_lane(wq_t *wq, u32 lane, wq_entry_t *entry)
+{
+    wq_deque_t *own = wq_get_own_deque(wq, lane);
+    if (wq_pop(own, entry)) {
+        return 1;
+    }
+
+    // xorshift32
+    u32 x = own->random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    own->random_state = x;
+
+    u32 deque_count = wq->deque_count;
+    for (u32 i = 0; i < deque_count; ++i) {
+        wq_deque_t *victim = &wq->deques[lane][(x + i) % deque_count];
+        if (victim == own) {
+            continue;
+        }
+        wq_steal_result_t result = wq_steal(victim, entry);
+        while (result == wq_steal_lost) {
+            ++own->steal_miss_count;
+            result = wq_steal(victim, entry);
+        }
+        if (result == wq_steal_taken) {
+            ++own->steal_count;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Takes an entry from the highest lane that has one, down to last_lane.
+b8 wqDequeue(wq_t *wq, wq_entry_t *entry, wq_lane_t last_lane)
+{
+    for (u32 lane = 0; lane <= (u32)last_lane; ++lane) {
+        if (wq_dequeue_lane(wq, lane, entry)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Counters ==================================
+
+static void wq_lock(volatile i32 *lock)
+{
+    while (atomic_cas(lock, 1, 0) != 0) {
+    }
+}
+
+static void wq_unlock(volatile i32 *lock)
+{
+    atomic_cas(lock, 0, 1);
+}
+
+static void wq_counter_lock(wq_counter_t *counter)
+{
+    wq_lock(&counter->lock);
+}
+
+static void wq_counter_unlock(wq_counter_t *counter)
+{
+    wq_unlock(&counter->lock);
+}
+
+static void wq_start_batch(wq_t *wq, wq_counter_t *counter);
+
+// NOTE(Wes): Marks the waiting list of a counter that has reached zero.
+#define WQ_COUNTER_CLOSED ((wq_counter_t *)1)
+
+// Counts off one job, or the batch having started. The last one starts every
+// batch chained after the counter.
+static void wq_counter_decrement(wq_t *wq, wq_counter_t *counter)
+{
+    for (;;) {
+        i32 count = counter->count;
+        if (count == 1) {
+            break;
+        }
+        if (atomic_cas(&counter->count, count - 1, count) == count) {
+            return;
+        }
+    }
+
+    // NOTE(Wes): Nothing else is left to count so only chaining can race
+    // with us. The list is closed under the lock so a batch chained after it
+    // either makes the list or starts right away. Zero is the last write as
+    // the counter may be reused, or gone, as soon as it reads zero. Waking
+    // an address that is no longer a counter is harmless.
+    wq_counter_lock(counter);
+    wq_counter_t *waiting = counter->waiting;
+    counter->waiting = WQ_COUNTER_CLOSED;
+    wq_counter_unlock(counter);
+    counter->count = 0;
+    wake_by_address(&counter->count, WQ_WAKE_ALL);
+
+    while (waiting) {
+        wq_counter_t *next = waiting->next;
+        wq_start_batch(wq, waiting);
+        waiting = next;
+    }
+}
+
+// Calls fn with the calling thread's scratch arena and gives back whatever it
+// pushed.
+static void wq_call(wq_t *wq, wq_fn fn, void *data)
+{
+    wq_context_t context;
+    context.thread_index = wq_thread_queue == wq ? wq_thread_deque : 0;
+    context.scratch = &wq->scratch[context.thread_index];
+    temp_memory_t temp = begin_temp_memory(context.scratch);
+    fn(data, &context);
+    end_temp_memory(temp);
+}
+
+static void wq_run_entry(wq_t *wq, wq_entry_t *entry)
+{
+    u32 outer_lane = wq_thread_lane;
+    wq_thread_lane = entry->lane;
+    // NOTE(Wes): Background entries may span the end of the frame, when the
+    // profiler resets every thread's buffer, so they are not recorded.
+    b8 background = entry->lane == wq_lane_background;
+    if (background) {
+        dbg_pause_recording();
+    }
+    BEGIN_BLOCK(work_entry);
+    wq_call(wq, entry->work_fn, entry->data);
+    END_BLOCK(work_entry);
+    if (background) {
+        dbg_resume_recording();
+    }
+    wq_thread_lane = outer_lane;
+    if (entry->counter) {
+        wq_counter_decrement(wq, entry->counter);
+    }
+    // NOTE(Wes): After the counter so chained batches are already counted.
+    volatile i32 *lane_count = wq_get_lane_count(wq, entry->lane);
+    if (atomic_decrement(lane_count) == 0) {
+        wake_by_address(lane_count, WQ_WAKE_ALL);
+    }
+}
+
+static void wq_start_batch(wq_t *wq, wq_counter_t *counter)
+{
+    wq_deque_t *own = wq_get_own_deque(wq, counter->lane);
+    volatile i32 *lane_count = wq_get_lane_count(wq, counter->lane);
+    u32 pushed_count = 0;
+    for (u32 i = 0; i < counter->job_count; ++i) {
+        wq_job_t *job = &counter->jobs[i];
+        atomic_increment(lane_count);
+        if (wq_push(own, job->work_fn, job->data, counter, counter->lane)) {
+            ++pushed_count;
+        } else {
+            // NOTE(Wes): The deque is full, the job is run right away instead.
+            wq_entry_t entry = {job->work_fn, job->data, counter, counter->lane};
+            wq_run_entry(wq, &entry);
+        }
+    }
+    DBG_MARK(add_jobs);
+    wq_wake_workers(wq, pushed_count);
+    // NOTE(Wes): The count holds one more than the jobs until every job has
+    // been added so it cannot reach zero part way through.
+    wq_counter_decrement(wq, counter);
+}
+
+void wqAddJobs(wq_t *wq, wq_lane_t lane, wq_job_t *jobs, u32 job_count, wq_counter_t *counter, wq_counter_t *after)
+{
+    counter->count = (i32)job_count + 1;
+    counter->lane = lane;
+    counter->waiting = 0;
+    counter->next = 0;
+    counter->jobs = jobs;
+    counter->job_count = job_count;
+
+    if (after) {
+        wq_counter_lock(after);
+        if (after->waiting != WQ_COUNTER_CLOSED && after->count > 0) {
+            counter->next = after->waiting;
+            after->waiting = counter;
+            wq_counter_unlock(after);
+            return;
+        }
+        wq_counter_unlock(after);
+    }
+    wq_start_batch(wq, counter);
+}
+
+// ===========================================
+
+// Tries to dequeue for a while. Gives up early once *count reaches zero.
+static b8 wq_spin_dequeue(wq_t *wq, wq_entry_t *entry, wq_lane_t last_lane, volatile i32 *count)
+{
+    for (u32 i = 0; i < WQ_SPIN_COUNT; ++i) {
+        if (wqDequeue(wq, entry, last_lane)) {
+            return 1;
+        }
+        if (count && *count <= 0) {
+            return 0;
+        }
+        cpu_pause();
+    }
+    return 0;
+}
+
+// NOTE(Wes): The calling thread runs any entry down to last_lane it can get,
+// not just the ones it waits on. Lower lanes are left alone so a long
+// background job never holds up a wait on frame work. Once there is nothing
+// left to take it sleeps until the last entry, which another thread is
+// running, brings the count to zero.
+static void wq_wait_for_zero(wq_t *wq, volatile i32 *count, wq_lane_t last_lane)
+{
+    wq_entry_t entry;
+    while (*count > 0) {
+        if (wq_spin_dequeue(wq, &entry, last_lane, count)) {
+            wq_run_entry(wq, &entry);
+            continue;
+        }
+        i32 observed = *count;
+        if (observed > 0) {
+            wait_on_address(count, observed);
+        }
+    }
+}
+
+// NOTE(Wes): Time in wait_counter and finish_work outside of work entries is
+// spent spinning or sleeping on entries other threads are still running.
+void wqWaitCounter(wq_t *wq, wq_counter_t *counter)
+{
+    BEGIN_BLOCK(wait_counter);
+    wq_wait_for_zero(wq, &counter->count, (wq_lane_t)counter->lane);
+    END_BLOCK(wait_counter);
+}
+
+void wqFinishWork(wq_t *wq)
+{
+    BEGIN_BLOCK(finish_work);
+    wq_wait_for_zero(wq, &wq->remaining_work_count, wq_lane_normal);
+    END_BLOCK(finish_work);
+}
+
+// Parallel for ==============================
+
+// NOTE(Wes): A loop is split into grain sized chunks which a job per thread
+// claims one after another, so threads that get cheap chunks take more of
+// them. The calling thread works on the loop too while it waits.
+//
+// With an automatic grain every call times its chunks and moves the grain
+// of its range function towards chunks of WQ_CHUNK_TARGET_CYCLES. Shorter
+// chunks spend more time claiming, longer ones balance worse.
+#define WQ_CHUNK_TARGET_CYCLES 100000
+
+typedef struct {
+    wq_t *wq;
+    wq_range_fn fn;
+    void *user;
+    u32 count;
+    u32 grain;
+    u32 chunk_count;
+    volatile i32 next_chunk;
+} wq_loop_t;
+
+typedef struct {
+    wq_loop_t *loop;
+    u64 cycles; // Spent in chunks, for the automatic grain.
+    u32 item_count;
+} wq_loop_job_t;
+
+static void wq_loop_job(void *data, wq_context_t *context)
+{
+    wq_loop_job_t *job = (wq_loop_job_t *)data;
+    wq_loop_t *loop = job->loop;
+
+    for (;;) {
+        i32 chunk = loop->next_chunk;
+        if (chunk >= (i32)loop->chunk_count) {
+            break;
+        }
+        if (atomic_cas(&loop->next_chunk, chunk + 1, chunk) != chunk) {
+            continue;
+        }
+        u32 begin = (u32)chunk * loop->grain;
+        u32 end = begin + loop->grain < loop->count ? begin + loop->grain : loop->count;
+        u64 start = rdtsc();
+        temp_memory_t temp = begin_temp_memory(context->scratch);
+        loop->fn(loop->user, begin, end, context);
+        end_temp_memory(temp);
+        job->cycles += rdtsc() - start;
+        job->item_count += end - begin;
+    }
+}
+
+// Returns the grain slot of fn, or null once every slot is taken.
+static wq_grain_t *wq_find_grain(wq_t *wq, wq_range_fn fn)
+{
+    for (u32 i = 0; i < WQ_GRAIN_SITES; ++i) {
+        wq_grain_t *grain = &wq->grains[i];
+        if (grain->fn == fn) {
+            return grain;
+        }
+        if (!grain->fn) {
+            grain->fn = fn;
+            grain->grain = 0;
+            return grain;
+        }
+    }
+    return 0;
+}
+
+// NOTE(Wes): Chunks run in the lane of the job that calls parallel_for, the
+// frame lane when called outside of any job.
+void wqParallelFor(wq_t *wq, u32 count, u32 grain, wq_range_fn fn, void *user)
+{
+    if (!count) {
+        return;
+    }
+    BEGIN_BLOCK(parallel_for);
+
+    // NOTE(Wes): No chunk is ever so big that a thread is left without one.
+    u32 thread_count = wq->deque_count;
+    u32 max_grain = count / thread_count ? count / thread_count : 1;
+    b8 automatic = grain == 0;
+    if (automatic) {
+        wq_lock(&wq->grain_lock);
+        wq_grain_t *site = wq_find_grain(wq, fn);
+        grain = site ? site->grain : 0;
+        wq_unlock(&wq->grain_lock);
+        if (!grain) {
+            grain = count / (thread_count * 4);
+        }
+        grain = grain < max_grain ? grain : max_grain;
+        grain = grain ? grain : 1;
+    }
+
+    wq_loop_t loop;
+    loop.wq = wq;
+    loop.fn = fn;
+    loop.user = user;
+    loop.count = count;
+    loop.grain = grain;
+    loop.chunk_count = (count + grain - 1) / grain;
+    loop.next_chunk = 0;
+
+    u32 job_count = loop.chunk_count < thread_count ? loop.chunk_count : thread_count;
+    wq_loop_job_t loop_jobs[WQ_MAX_THREADS + 1];
+    wq_job_t jobs[WQ_MAX_THREADS + 1];
+    for (u32 i = 0; i < job_count; ++i) {
+        loop_jobs[i].loop = &loop;
+        loop_jobs[i].cycles = 0;
+        loop_jobs[i].item_count = 0;
+        jobs[i].work_fn = wq_loop_job;
+        jobs[i].data = &loop_jobs[i];
+    }
+
+    if (job_count == 1) {
+        wq_call(wq, wq_loop_job, &loop_jobs[0]);
+    } else {
+        wq_counter_t done = {0};
+        wqAddJobs(wq, (wq_lane_t)wq_thread_lane, jobs, job_count, &done, 0);
+        wqWaitCounter(wq, &done);
+    }
+
+    if (automatic) {
+        u64 cycles = 0;
+        u64 item_count = 0;
+        for (u32 i = 0; i < job_count; ++i) {
+            cycles += loop_jobs[i].cycles;
+            item_count += loop_jobs[i].item_count;
+        }
+        u64 cycles_per_item = item_count ? cycles / item_count : 0;
+        u64 target = WQ_CHUNK_TARGET_CYCLES / (cycles_per_item ? cycles_per_item : 1);
+        target = target ? target : 1;
+
+        // NOTE(Wes): Halfway there each call, a single slow frame should not
+        // throw the grain off.
+        wq_lock(&wq->grain_lock);
+        wq_grain_t *site = wq_find_grain(wq, fn);
+        if (site) {
+            u64 old_grain = site->grain ? site->grain : grain;
+            u64 new_grain = (old_grain + target + 1) / 2;
+            site->grain = new_grain < 0x7FFFFFFF ? (u32)new_grain : 0x7FFFFFFF;
+        }
+        wq_unlock(&wq->grain_lock);
+    }
+
+    END_BLOCK_N(parallel_for, count);
+}
+
+// ===========================================
+
+// Thread stuff
+// ===========================================
+typedef struct {
+    u32 index;
+    wq_t *work_queue;
+    i32 cpu; // Logical CPU the worker keeps to, -1 lets it float.
+} thread_info_t;
+
+static THREAD_PROC(wq_thread_proc)
+{
+    thread_info_t *thread_info = (thread_info_t *)data;
+    wq_t *work_queue = thread_info->work_queue;
+    wq_thread_queue = work_queue;
+    wq_thread_deque = thread_info->index + 1;
+    if (thread_info->cpu >= 0) {
+        pin_thread_to_cpu((u32)thread_info->cpu);
+    }
+
+    wq_entry_t entry;
+    for (;;) {
+        if (wq_spin_dequeue(work_queue, &entry, wq_lane_background, 0)) {
+            wq_run_entry(work_queue, &entry);
+            continue;
+        }
+
+        // NOTE(Wes): The epoch is read before looking one last time so an
+        // entry added after the look bumps it and the wait returns at once.
+        // Not timed, the profile is merged while workers sleep and idle shows
+        // up as gaps in traces.
+        i32 epoch = work_queue->wake_epoch;
+        atomic_increment(&work_queue->sleeping_count);
+        if (wqDequeue(work_queue, &entry, wq_lane_background)) {
+            atomic_decrement(&work_queue->sleeping_count);
+            wq_run_entry(work_queue, &entry);
+            continue;
+        }
+        wait_on_address(&work_queue->wake_epoch, epoch);
+        atomic_decrement(&work_queue->sleeping_count);
+    }
+    return 0;
+}
+
+// Starts thread_count workers that sleep while the queue is empty. At most
+// WQ_MAX_THREADS, the rest are not started. With cpus set worker i keeps to
+// logical CPU cpus[i].
+static void wqStartThreads(wq_t *wq, thread_info_t *thread_infos, u32 thread_count, const u32 *cpus)
+{
+    thread_count = thread_count < WQ_MAX_THREADS ? thread_count : WQ_MAX_THREADS;
+    // NOTE(Wes): The deques are counted before any worker starts stealing.
+    wq->deque_count = thread_count + 1;
+    u8 *scratch = (u8 *)calloc(thread_count + 1, WQ_SCRATCH_SIZE);
+    for (u32 i = 0; i < thread_count + 1; ++i) {
+        init_arena(&wq->scratch[i], WQ_SCRATCH_SIZE, scratch + (u64)i * WQ_SCRATCH_SIZE);
+    }
+    for (u32 i = 0; i < thread_count; i++) {
+        thread_info_t *thread_info = thread_infos + i;
+        thread_info->index = i;
+        thread_info->work_queue = wq;
+        thread_info->cpu = cpus ? (i32)cpus[i] : -1;
+        create_thread(wq_thread_proc, thread_info);
+    }
+}
+
+// NOTE(Wes): Grain slots are keyed by range function, which move when the
+// game library is reloaded, so the platform clears them on every reload
+// rather than let the old addresses fill the table.
+static void wqResetGrains(wq_t *wq)
+{
+    wq_lock(&wq->grain_lock);
+    for (u32 i = 0; i < WQ_GRAIN_SITES; ++i) {
+        wq->grains[i].fn = 0;
+        wq->grains[i].grain = 0;
+    }
+    wq_unlock(&wq->grain_lock);
+}
+
+// Returns the most scratch memory any thread of the queue has used at once.
+static u32 wqScratchHighWater(wq_t *wq)
+{
+    u32 high_water = 0;
+    for (u32 i = 0; i < wq->deque_count; ++i) {
+        high_water = wq->scratch[i].high_water > high_water ? wq->scratch[i].high_water : high_water;
+    }
+    return high_water;
+}
+
+// ===========================================
+
+// Worker topology
+// ===========================================
+
+// NOTE(Wes): Read from WQ_CONFIG_PATH when it exists, then overridden by the
+// host's command line. The file has one key = value per line, # comments:
+//
+//     # Workers besides the main thread, 0 runs everything on the main thread.
+//     workers = 6
+//     # Keep the main thread and every worker on their own physical core.
+//     pin_threads = 1
+#define WQ_CONFIG_PATH "gg.cfg"
+
+typedef struct {
+    i32 worker_count; // -1 sizes the pool from the cores.
+    b8 pin_threads;
+} wq_config_t;
+
+static void wqDefaultConfig(wq_config_t *config)
+{
+    config->worker_count = -1;
+    config->pin_threads = 0;
+}
+
+// Returns 0 if the file could not be read, leaving config untouched.
+static b8 wqLoadConfig(wq_config_t *config, const char *path)
+{
+    FILE *handle = fopen(path, "r");
+    if (!handle) {
+        return 0;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), handle)) {
+        char key[64];
+        i32 value = 0;
+        if (line[0] == '#' || sscanf(line, " %63[a-z_] = %d", key, &value) != 2) {
+            continue;
+        }
+        if (strcmp(key, "workers") == 0) {
+            config->worker_count = value;
+        } else if (strcmp(key, "pin_threads") == 0) {
+            config->pin_threads = value != 0;
+        }
+    }
+    fclose(handle);
+    return 1;
+}
+
+// Returns the number of workers to start for config on this machine.
+static u32 wqWorkerCount(wq_config_t *config, cpu_topology_t *topology)
+{
+    // NOTE(Wes): The main thread works too while it waits on the queue, so
+    // it counts as one of the threads. Unpinned, every logical CPU gets a
+    // thread as the rasterizer still gains a little from SMT. Pinned, only
+    // the other physical cores do so the main thread's core stays its own.
+    i32 worker_count = config->worker_count;
+    if (worker_count < 0) {
+        u32 cpu_count = config->pin_threads ? topology->physical_count : topology->logical_count;
+        worker_count = (i32)cpu_count - 1;
+    }
+    return (u32)worker_count < WQ_MAX_THREADS ? (u32)worker_count : WQ_MAX_THREADS;
+}
+
+// Starts the workers described by config, thread_infos holds WQ_MAX_THREADS.
+// Pinned, the main thread takes the first CPU of topology and the workers the
+// first CPU of each other physical core, never an SMT sibling, so the main
+// thread has a core to itself. Returns the number of workers started.
+static u32 wqStartPool(wq_t *wq, thread_info_t *thread_infos, wq_config_t *config, cpu_topology_t *topology)
+{
+    u32 worker_count = wqWorkerCount(config, topology);
+    u32 cpus[WQ_MAX_THREADS];
+    if (config->pin_threads) {
+        pin_thread_to_cpu(topology->cpus[0]);
+        u32 worker_core_count = topology->physical_count - 1;
+        for (u32 i = 0; i < worker_count; ++i) {
+            // NOTE(Wes): More workers than cores share them round robin. With
+            // a single core there is nothing to keep apart.
+            cpus[i] = worker_core_count ? topology->cpus[1 + i % worker_core_count] : topology->cpus[0];
+        }
+    }
+    wqStartThreads(wq, thread_infos, worker_count, config->pin_threads ? cpus : 0);
+    return worker_count;
+}
+// ===========================================